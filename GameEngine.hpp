@@ -61,7 +61,7 @@ struct GamePlayer {
     // Progress
     std::vector<std::string> completedQuests;
     std::vector<std::string> unlockedAchievements;
-    std::vector<std::string> inventory;
+    FitnessDB::SymbolList inventory;  // item names, interned
     
     // Timestamps
     std::string lastLoginDate;
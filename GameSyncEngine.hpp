@@ -13,8 +13,14 @@
 #include <unordered_map>
 #include <vector>
 #include <memory>
+#include <array>
+#include <map>
+#include <string>
+#include <chrono>
+#include <algorithm>
 #include "services.hpp"
 #include "utils.hpp"
+#include "notification_hub.hpp"
 #include "shared-models/shared-models.hpp"
 
 namespace FitnessQuest {
@@ -86,6 +92,157 @@ public:
     }
 };
 
+// ============================================================================
+// STATE CHANGE LOG
+// ============================================================================
+
+// What a client holds of a player: scalar stats plus named entry lists
+// ("achievements", "completedExercises").
+struct PlayerSnapshot {
+    std::map<std::string, int> fields;
+    std::map<std::string, std::vector<std::string>> lists;
+};
+
+// Answer to "what changed since version N". `full` means N is unknown or
+// older than the log reaches back: `fields` and `added` then hold the whole
+// state and the client replaces what it has.
+struct StateDelta {
+    uint64_t version = 0;
+    bool full = false;
+    std::map<std::string, int> fields;
+    std::map<std::string, std::vector<std::string>> added;
+    std::map<std::string, std::vector<std::string>> removed;
+    
+    bool empty() const { return fields.empty() && added.empty() && removed.empty(); }
+};
+
+// The last changes to one player, newest overwriting oldest. Every change
+// observed in one refresh shares a sequence number; clients use the
+// newest as their version.
+class PlayerChangeLog {
+public:
+    static constexpr size_t capacity = 64;
+    
+    enum class Kind { Set, Added, Removed };
+    
+    struct Change {
+        uint64_t seq = 0;
+        Kind kind = Kind::Set;
+        std::string collection;   // list name; empty for Set
+        std::string name;         // field or entry
+        int value = 0;            // Set only
+    };
+    
+    std::mutex mutex;
+    bool initialized = false;
+    uint64_t observedVersion = 0;   // Config::Database::userVersion at the last refresh
+    
+private:
+    std::array<Change, capacity> ring;
+    size_t next = 0;
+    size_t count = 0;
+    uint64_t horizon = 0;   // clients at or past this version can be sent a delta
+    uint64_t latest = 0;
+    PlayerSnapshot current;
+    
+    void push(Change change) {
+        if (count == capacity) {
+            horizon = std::max(horizon, ring[next].seq);
+        } else {
+            count++;
+        }
+        ring[next] = std::move(change);
+        next = (next + 1) % capacity;
+    }
+    
+    static void toggle(std::vector<std::string>& from, std::vector<std::string>& to, const std::string& entry) {
+        auto it = std::find(from.begin(), from.end(), entry);
+        if (it != from.end()) from.erase(it);
+        else to.push_back(entry);
+    }
+    
+public:
+    uint64_t version() const { return latest; }
+    
+    void reset(PlayerSnapshot snapshot, uint64_t seq) {
+        current = std::move(snapshot);
+        count = next = 0;
+        horizon = latest = seq;
+        initialized = true;
+    }
+    
+    // Logs the differences from the current snapshot under `seq`; returns
+    // false (and logs nothing) when there are none.
+    bool record(PlayerSnapshot snapshot, uint64_t seq) {
+        bool changed = false;
+        for (const auto& [name, value] : snapshot.fields) {
+            auto it = current.fields.find(name);
+            if (it == current.fields.end() || it->second != value) {
+                push({seq, Kind::Set, {}, name, value});
+                changed = true;
+            }
+        }
+        for (const auto& [list, entries] : snapshot.lists) {
+            const auto& before = current.lists[list];
+            for (const auto& entry : entries) {
+                if (std::find(before.begin(), before.end(), entry) == before.end()) {
+                    push({seq, Kind::Added, list, entry, 0});
+                    changed = true;
+                }
+            }
+            for (const auto& entry : before) {
+                if (std::find(entries.begin(), entries.end(), entry) == entries.end()) {
+                    push({seq, Kind::Removed, list, entry, 0});
+                    changed = true;
+                }
+            }
+        }
+        current = std::move(snapshot);
+        if (changed) latest = seq;
+        return changed;
+    }
+    
+    // Net changes after version `since`, collapsed: the latest value per
+    // field, and entries both added and removed since then cancel out.
+    StateDelta since(uint64_t since) const {
+        StateDelta delta;
+        delta.version = latest;
+        if (since == latest) return delta;
+        
+        if (since < horizon || since > latest) {
+            delta.full = true;
+            delta.fields = current.fields;
+            for (const auto& [list, entries] : current.lists) {
+                if (!entries.empty()) delta.added[list] = entries;
+            }
+            return delta;
+        }
+        
+        size_t oldest = (next + capacity - count) % capacity;
+        for (size_t i = 0; i < count; i++) {
+            const Change& change = ring[(oldest + i) % capacity];
+            if (change.seq <= since) continue;
+            switch (change.kind) {
+                case Kind::Set:
+                    delta.fields[change.name] = change.value;
+                    break;
+                case Kind::Added:
+                    toggle(delta.removed[change.collection], delta.added[change.collection], change.name);
+                    break;
+                case Kind::Removed:
+                    toggle(delta.added[change.collection], delta.removed[change.collection], change.name);
+                    break;
+            }
+        }
+        for (auto* lists : {&delta.added, &delta.removed}) {
+            for (auto it = lists->begin(); it != lists->end();) {
+                it = it->second.empty() ? lists->erase(it) : std::next(it);
+            }
+        }
+        return delta;
+    }
+};
+
 // ============================================================================
 // SIMPLE GAME SYNC ENGINE (Minimal Version)
 // ============================================================================
@@ -98,6 +255,43 @@ private:
     std::atomic<bool> running;
     std::thread workerThread;
     
+    std::shared_ptr<Events::NotificationHub> hub = std::make_shared<Events::NotificationHub>();
+    
+    // Change logs for recently synced players. Sequence numbers start at
+    // the clock in microseconds, so a version handed out before a restart
+    // (or before a log was evicted) is older than any log's horizon and
+    // gets a full resync rather than a wrong delta.
+    std::mutex changeLogsMutex;
+    std::unordered_map<std::string, std::shared_ptr<PlayerChangeLog>> changeLogs;
+    size_t changeLogLimit;
+    std::atomic<uint64_t> changeSeq{static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count())};
+    
+    std::shared_ptr<PlayerChangeLog> changeLogFor(const std::string& userId) {
+        std::lock_guard<std::mutex> lock(changeLogsMutex);
+        auto it = changeLogs.find(userId);
+        if (it != changeLogs.end()) return it->second;
+        if (changeLogs.size() >= changeLogLimit) changeLogs.erase(changeLogs.begin());
+        return changeLogs.emplace(userId, std::make_shared<PlayerChangeLog>()).first->second;
+    }
+    
+    PlayerSnapshot readSnapshot(const std::string& userId) {
+        PlayerSnapshot snapshot;
+        snapshot.fields = getPlayerGameState(userId);
+        auto& achievements = snapshot.lists["achievements"];
+        auto& exercises = snapshot.lists["completedExercises"];
+        try {
+            database->withUser(userId, [&](const FitnessDB::CompactUser& user) {
+                for (FitnessDB::Symbol symbol : user.achievements()) achievements.push_back(FitnessDB::symbol_name(symbol));
+                for (FitnessDB::Symbol symbol : user.completed_exercises()) exercises.push_back(FitnessDB::symbol_name(symbol));
+            });
+        } catch (...) {
+            // Unknown user: same defaults as getPlayerGameState
+        }
+        return snapshot;
+    }
+    
     void workerLoop() {
         while (running) {
             if (!syncQueue.isEmpty()) {
@@ -116,7 +310,8 @@ private:
 public:
     GameSyncEngine(std::shared_ptr<Config::Database> db,
                   std::shared_ptr<Services::RewardService> rewardSvc)
-        : database(db), rewardService(rewardSvc), running(false) {}
+        : database(db), rewardService(rewardSvc), running(false),
+          changeLogLimit(static_cast<size_t>(std::max(1, Config::Environment::getStateCacheEntries()))) {}
     
     ~GameSyncEngine() {
         stop();
@@ -134,6 +329,11 @@ public:
         }
     }
     
+    // Where player changes are announced to /api/game/events waiters
+    std::shared_ptr<Events::NotificationHub> notifications() const {
+        return hub;
+    }
+    
     // Simple sync method
     void syncWorkout(const std::string& userId, const std::string& workoutId) {
         SyncJob job;
@@ -147,6 +347,7 @@ public:
             // send data to game server or update game state
             std::cout << "[GameSync] Syncing workout " << workoutId 
                       << " for user " << userId << std::endl;
+            hub->publish(userId, {"workoutSynced", workoutId});
         };
         
         syncQueue.push(job);
@@ -157,17 +358,22 @@ public:
         std::map<std::string, int> gameState;
         
         try {
-            FitnessDB::User user = database->getUser(userId);
+            int level = 0, xp = 0;
+            database->withUser(userId, [&](const FitnessDB::CompactUser& user) {
+                level = user.fitness_level;
+                xp = user.experience_points;
+            });
             
             // Basic game stats derived from fitness data
-            gameState["level"] = user.fitness_level;
-            gameState["xp"] = user.experience_points;
-            gameState["strength"] = user.fitness_level * 10;
-            gameState["stamina"] = user.fitness_level * 15;
-            gameState["gold"] = user.experience_points / 10; // Convert XP to gold
+            gameState["level"] = level;
+            gameState["xp"] = xp;
+            gameState["strength"] = level * 10;
+            gameState["stamina"] = level * 15;
+            gameState["gold"] = xp / 10; // Convert XP to gold
             
-            // Add workout-based stats
-            auto workouts = database->getUserWorkouts(userId);
+            // Add workout-based stats. Every state refresh lands here, so
+            // only recent workouts count: older ones sit in on-disk segments.
+            auto workouts = database->getRecentUserWorkouts(userId);
             gameState["workouts_completed"] = static_cast<int>(workouts.size());
             gameState["total_calories"] = 0;
             
@@ -189,9 +395,29 @@ public:
         return gameState;
     }
     
-    // Get available quests for player
-    std::vector<std::map<std::string, std::string>> getAvailableQuests(const std::string& userId) {
+    // Changes to the player since `since` (a version from an earlier
+    // reply; 0 for everything). Reads the database only when the user's
+    // version moved since the last call.
+    StateDelta getGameStateSince(const std::string& userId, uint64_t since) {
+        auto log = changeLogFor(userId);
+        std::lock_guard<std::mutex> lock(log->mutex);
+        
+        uint64_t version = database->userVersion(userId);
+        if (!log->initialized) {
+            log->reset(readSnapshot(userId), ++changeSeq);
+        } else if (version != log->observedVersion) {
+            log->record(readSnapshot(userId), ++changeSeq);
+        }
+        log->observedVersion = version;
+        return log->since(since);
+    }
+    
+    // Get available quests for player. `fallback`, when given, is set if the
+    // catalog could not be read and the default quest was returned instead.
+    std::vector<std::map<std::string, std::string>> getAvailableQuests(const std::string& userId,
+                                                                       bool* fallback = nullptr) {
         std::vector<std::map<std::string, std::string>> quests;
+        if (fallback) *fallback = false;
         
         try {
             auto userQuests = database->getAllQuests();
@@ -209,6 +435,8 @@ public:
             }
         } catch (...) {
             // Return some default quests
+            if (fallback) *fallback = true;
+            quests.clear();
             std::map<std::string, std::string> defaultQuest;
             defaultQuest["id"] = "quest_1";
             defaultQuest["title"] = "First Workout";
@@ -0,0 +1,455 @@
+// ============================================================================
+// MICRO-BENCHMARKS - FITNESS QUEST DATABASE
+// Compile: g++ -std=c++20 -O2 -o benchmark_suite benchmark_suite.cpp -pthread
+// Handlers: add -DBENCHMARK_HANDLERS -lcpprest -lssl -lcrypto
+// Run: ./benchmark_suite [records] [users]
+// ============================================================================
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <filesystem>
+#include <future>
+
+#include "database/complete_database.h"
+#ifdef BENCHMARK_HANDLERS
+#include "controllers.hpp"
+#endif
+
+// Live heap bytes and allocation count, for the memory benchmarks. Every
+// allocation carries a header with its size so operator delete can
+// subtract it.
+static std::atomic<size_t> liveHeapBytes{0};
+static std::atomic<uint64_t> heapAllocations{0};
+
+void* operator new(size_t size) {
+    void* block = std::malloc(size + sizeof(std::max_align_t));
+    if (!block) throw std::bad_alloc();
+    *static_cast<size_t*>(block) = size;
+    liveHeapBytes.fetch_add(size, std::memory_order_relaxed);
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    return static_cast<char*>(block) + sizeof(std::max_align_t);
+}
+
+void operator delete(void* ptr) noexcept {
+    if (!ptr) return;
+    void* block = static_cast<char*>(ptr) - sizeof(std::max_align_t);
+    liveHeapBytes.fetch_sub(*static_cast<size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete[](void* ptr) noexcept { operator delete(ptr); }
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { operator delete(ptr); }
+
+namespace FitnessQuest {
+namespace Benchmarks {
+
+using Clock = std::chrono::steady_clock;
+using Batch = std::vector<std::pair<std::string, int>>;
+
+// ============================================================================
+// HELPERS
+// ============================================================================
+
+double timeMs(const std::function<void()>& body) {
+    auto start = Clock::now();
+    body();
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void report(const std::string& name, size_t records, double ms) {
+    std::cout << "  " << std::left << std::setw(44) << name
+              << std::right << std::setw(10) << std::fixed << std::setprecision(1) << ms << " ms"
+              << std::setw(14) << static_cast<size_t>(records / (ms / 1000.0)) << " rec/s" << std::endl;
+}
+
+// Keys shaped like the real ones ("USER_<epoch>_<n>"), in random order.
+Batch makeBatch(size_t count, unsigned seed) {
+    std::mt19937 rng(seed);
+    Batch batch;
+    batch.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        batch.emplace_back("USER_1765130866_" + std::to_string(rng() % (count * 4)), static_cast<int>(i));
+    }
+    return batch;
+}
+
+// ============================================================================
+// BATCH INSERT
+// ============================================================================
+
+void benchmarkBatchInsert(size_t records) {
+    std::cout << "\nBatch insert (" << records << " records)" << std::endl;
+
+    Batch existing = makeBatch(records, 1);
+    Batch incoming = makeBatch(records, 2);
+
+    for (bool populated : {false, true}) {
+        std::string label = populated ? "into populated tree" : "into empty tree";
+
+        FitnessDB::CompleteBTree<std::string, int> loopTree;
+        FitnessDB::CompleteBTree<std::string, int> batchTree;
+        if (populated) {
+            loopTree.bulk_load(existing);
+            batchTree.bulk_load(existing);
+        }
+
+        double loopMs = timeMs([&]() {
+            for (const auto& kv : incoming) {
+                loopTree.insert(kv.first, kv.second);
+            }
+        });
+        double batchMs = timeMs([&]() {
+            batchTree.insert_batch(incoming);
+        });
+
+        report("insert() loop " + label, records, loopMs);
+        report("insert_batch() " + label, records, batchMs);
+        std::cout << "  speedup: " << std::setprecision(2) << loopMs / batchMs << "x"
+                  << (loopTree.get_size() == batchTree.get_size() ? "" : "  (SIZE MISMATCH)") << std::endl;
+    }
+}
+
+// ============================================================================
+// CONCURRENT USER TABLE
+// ============================================================================
+
+// Mixed lookups and upserts (9:1, like getUser/updateUser traffic) from
+// `threads` threads against one table.
+template <typename Read, typename Write>
+double runMixed(const Batch& keys, unsigned threads, size_t opsPerThread, Read read, Write write) {
+    return timeMs([&]() {
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                std::mt19937 rng(t);
+                for (size_t i = 0; i < opsPerThread; i++) {
+                    const auto& kv = keys[rng() % keys.size()];
+                    if (rng() % 10 == 0) {
+                        write(kv.first, static_cast<int>(i));
+                    } else {
+                        read(kv.first);
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+    });
+}
+
+void benchmarkConcurrentTable(size_t records) {
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "\nConcurrent user table (" << records << " records, 90% reads)" << std::endl;
+
+    Batch keys = makeBatch(records, 3);
+    FitnessDB::CompleteBTree<std::string, int> locked;
+    std::mutex lock;
+    FitnessDB::ConcurrentBLinkTree<std::string, int> blink;
+    locked.bulk_load(keys);
+    blink.insert_batch(keys);
+
+    for (unsigned threads = 1; threads <= cores; threads *= 2) {
+        size_t ops = records / threads;
+        double lockedMs = runMixed(keys, threads, ops,
+            [&](const std::string& key) { std::lock_guard<std::mutex> g(lock); return locked.exists(key); },
+            [&](const std::string& key, int v) { std::lock_guard<std::mutex> g(lock); locked.insert(key, v); });
+        double blinkMs = runMixed(keys, threads, ops,
+            [&](const std::string& key) { return blink.exists(key); },
+            [&](const std::string& key, int v) { blink.insert(key, v); });
+
+        std::string suffix = " (" + std::to_string(threads) + " threads)";
+        report("mutex + CompleteBTree" + suffix, ops * threads, lockedMs);
+        report("ConcurrentBLinkTree" + suffix, ops * threads, blinkMs);
+    }
+}
+
+// ============================================================================
+// USER RECORD FOOTPRINT
+// ============================================================================
+
+// Synthetic user shaped like the ones create_user() and record_workout()
+// produce.
+FitnessDB::User makeUser(size_t i, std::mt19937& rng) {
+    FitnessDB::User user;
+    user.id = "USER_1765130866_" + std::to_string(i);
+    user.username = "athlete_" + std::to_string(i);
+    user.email = "athlete_" + std::to_string(i) + "@fitnessquest.com";
+    user.password_hash = std::to_string(std::hash<std::string>{}(user.email));
+    user.fitness_level = 1 + static_cast<int>(rng() % 10);
+    user.experience_points = static_cast<int>(rng() % 50000);
+    size_t exercises = rng() % 7;
+    for (size_t e = 0; e < exercises; e++) {
+        user.completed_exercises.push_back("EX00" + std::to_string(1 + rng() % 8));
+    }
+    if (rng() % 4 == 0) user.achievements.push_back("First Workout");
+    user.created_at = 1765130866 + static_cast<time_t>(i);
+    user.last_login = user.created_at;
+    return user;
+}
+
+// Heap bytes per record held by `build`, plus the record itself.
+template <typename Record>
+double bytesPerRecord(size_t users, const std::function<Record(size_t, std::mt19937&)>& build) {
+    std::mt19937 rng(4);
+    std::vector<Record> records;
+    records.reserve(users);
+    size_t before = liveHeapBytes.load();
+    for (size_t i = 0; i < users; i++) {
+        records.push_back(build(i, rng));
+    }
+    size_t heap = liveHeapBytes.load() - before;
+    return sizeof(Record) + static_cast<double>(heap) / users;
+}
+
+void benchmarkUserFootprint(size_t users) {
+    std::cout << "\nUser record footprint (" << users << " users)" << std::endl;
+
+    double full = bytesPerRecord<FitnessDB::User>(users, makeUser);
+    double compact = bytesPerRecord<FitnessDB::CompactUser>(users, [](size_t i, std::mt19937& rng) {
+        return FitnessDB::CompactUser::pack(makeUser(i, rng));
+    });
+
+    std::cout << "  " << std::left << std::setw(44) << "User" << std::right << std::setw(10)
+              << std::fixed << std::setprecision(1) << full << " B/user  (sizeof " << sizeof(FitnessDB::User) << ")" << std::endl;
+    std::cout << "  " << std::left << std::setw(44) << "CompactUser" << std::right << std::setw(10)
+              << compact << " B/user  (sizeof " << sizeof(FitnessDB::CompactUser) << ")" << std::endl;
+    std::cout << "  reduction: " << std::setprecision(2) << full / compact << "x" << std::endl;
+}
+
+// ============================================================================
+// TABLE ENGINES
+// ============================================================================
+
+// Append-mostly workout traffic: new sessions with an occasional update,
+// snapshotted every `checkpointEvery` writes like the database checkpoint,
+// followed by point lookups.
+void benchmarkTableEngines(size_t records) {
+    const size_t checkpointEvery = 1024;
+    std::cout << "\nWorkout table engines (" << records << " sessions, snapshot every "
+              << checkpointEvery << " writes)" << std::endl;
+
+    std::string dir = "./benchmark_tables";
+    FitnessDB::create_directory(dir);
+    auto backend = FitnessDB::make_persistence_backend();
+
+    for (const std::string engine : {"btree", "lsm"}) {
+        using Tree = FitnessDB::CompleteBTree<std::string, FitnessDB::WorkoutSession,
+                                              FitnessDB::SlabStorage<FitnessDB::WorkoutSession>>;
+        auto table = FitnessDB::make_table_engine<FitnessDB::WorkoutSession, Tree>(
+            engine, dir + "/workouts_" + engine, *backend);
+
+        std::mt19937 rng(5);
+        double writeMs = timeMs([&]() {
+            for (size_t i = 0; i < records; i++) {
+                FitnessDB::WorkoutSession session;
+                size_t n = rng() % 10 == 0 && i > 0 ? rng() % i : i;
+                session.id = "WORKOUT_1765130866_" + std::to_string(n);
+                session.user_id = "USER_1765130866_" + std::to_string(n % 1000);
+                session.exercises = {"EX001", "EX002"};
+                table->insert(session.id, session);
+                if ((i + 1) % checkpointEvery == 0) table->snapshot(0);
+            }
+            table->snapshot(0);
+        });
+        double flushMs = timeMs([&]() { backend->flush(); });
+        double readMs = timeMs([&]() {
+            for (size_t i = 0; i < records; i++) {
+                table->exists("WORKOUT_1765130866_" + std::to_string(rng() % records));
+            }
+        });
+
+        report(engine + ": writes + snapshots", records, writeMs + flushMs);
+        report(engine + ": point lookups", records, readMs);
+
+        auto files = table->files();
+        table.reset();
+        for (const auto& file : files) std::remove(file.c_str());
+    }
+}
+
+#ifdef BENCHMARK_HANDLERS
+// ============================================================================
+// REQUEST HANDLERS
+// ============================================================================
+
+// POST /api/workouts written as the continuation chain the coroutine
+// handler replaced: each .then() allocates a task, a continuation and
+// copies of its captures. Does the same work as WorkoutController.
+class ChainedWorkoutHandler {
+private:
+    std::shared_ptr<Config::Database> database;
+    Services::RewardService rewardService;
+
+public:
+    explicit ChainedWorkoutHandler(std::shared_ptr<Config::Database> db) : database(db), rewardService(db) {}
+
+    void logWorkout(http_request request) {
+        request.extract_json().then([this, request](web::json::value body) mutable {
+            std::string userId = Utils::JWT::verifyToken(Utils::Request::extractToken(request));
+            Models::WorkoutType type = Models::stringToWorkoutType(Utils::Request::getStringField(body, "type"));
+            double duration = Utils::Request::getDoubleField(body, "duration");
+            double intensity = Utils::Request::getDoubleField(body, "intensity");
+            Models::Validation::validateWorkoutDuration(duration);
+            Models::Validation::validateIntensity(intensity);
+
+            FitnessDB::WorkoutSession session;
+            session.user_id = userId;
+            session.end_time = time(nullptr);
+            session.start_time = session.end_time - static_cast<time_t>(duration * 60);
+
+            return Async::Executors::db().submit([this, userId, session, type, duration, intensity]() {
+                Services::RewardBundle rewardBundle;
+                std::string workoutId;
+                {
+                    auto txn = database->begin();
+                    FitnessDB::User user = txn.getUser(userId);
+                    rewardBundle = rewardService.calculateWorkoutRewards(user, type, duration, intensity, std::nullopt);
+                    workoutId = txn.logWorkout(session, static_cast<int>(rewardBundle.experience),
+                                               rewardBundle.levelUp ? rewardBundle.newLevel : 0);
+                    txn.commit();
+                }
+
+                web::json::value response = web::json::value::object();
+                response[U("success")] = web::json::value::boolean(true);
+                response[U("workoutId")] = web::json::value::string(utility::conversions::to_string_t(workoutId));
+                web::json::value rewards = web::json::value::object();
+                rewards[U("experience")] = web::json::value::number(rewardBundle.experience);
+                rewards[U("gold")] = web::json::value::number(rewardBundle.gold);
+                response[U("gameRewards")] = rewards;
+                response[U("message")] = web::json::value::string(utility::conversions::to_string_t(rewardBundle.message));
+                return response;
+            });
+        }).then([request](pplx::task<web::json::value> result) {
+            Utils::Response::sendResult(request, status_codes::Created, result);
+        });
+    }
+};
+
+// Sends `requests` workouts through `handle` one at a time, waiting for
+// each reply. Returns heap allocations per request.
+template <typename Handle>
+double runWorkoutRequests(const std::string& label, size_t requests, const std::string& token, Handle handle) {
+    web::json::value body = web::json::value::object();
+    body[U("type")] = web::json::value::string(U("CARDIO"));
+    body[U("duration")] = web::json::value::number(30.0);
+    body[U("intensity")] = web::json::value::number(7.0);
+
+    uint64_t before = heapAllocations.load();
+    double ms = timeMs([&]() {
+        for (size_t i = 0; i < requests; i++) {
+            http_request request(methods::POST);
+            request.headers().add(U("Authorization"), utility::conversions::to_string_t("Bearer " + token));
+            request.set_body(body);
+            handle(request);
+            request.get_response().wait();
+        }
+    });
+    double allocations = static_cast<double>(heapAllocations.load() - before) / requests;
+
+    report(label, requests, ms);
+    std::cout << "  " << std::left << std::setw(44) << "" << std::right << std::setw(10)
+              << std::fixed << std::setprecision(1) << allocations << " allocs/request" << std::endl;
+    return allocations;
+}
+
+void benchmarkWorkoutHandlers(size_t requests) {
+    std::cout << "\nPOST /api/workouts handlers (" << requests << " requests)" << std::endl;
+
+    std::string dir = "./benchmark_handlers";
+    auto database = std::make_shared<Config::Database>(dir);
+    database->connect();
+    std::string userId = database->createUser("bench_runner", "bench_runner@fitnessquest.com", "benchmark-password");
+    std::string token = Utils::JWT::generateToken(userId);
+
+    ChainedWorkoutHandler chained(database);
+    Controllers::WorkoutController coroutine(database, std::make_shared<Events::NotificationHub>());
+
+    // Warm the pools and the tables before counting.
+    runWorkoutRequests("warm-up", 100, token, [&](http_request r) { coroutine.logWorkout(r); });
+
+    double chainedAllocs = runWorkoutRequests(".then().wait() chain", requests, token,
+                                              [&](http_request r) { chained.logWorkout(r); });
+    double coroutineAllocs = runWorkoutRequests("co_await coroutine", requests, token,
+                                                [&](http_request r) { coroutine.logWorkout(r); });
+    std::cout << "  saved: " << std::setprecision(1) << chainedAllocs - coroutineAllocs
+              << " allocs/request" << std::endl;
+
+    database->disconnect();
+    std::filesystem::remove_all(dir);
+}
+
+// Runs a coroutine to completion without a request behind it.
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+Detached hopBetweenPools(size_t rounds, std::promise<void>& done) {
+    for (size_t i = 0; i < rounds; i++) {
+        co_await Async::Executors::db();
+        co_await Async::Executors::cpu();
+    }
+    done.set_value();
+}
+
+// The db/cpu hops every handler makes, on their own. They touch only the
+// executor, not cpprest, so this part is the same with any cpprest build.
+void benchmarkExecutorHops(size_t hops) {
+    std::cout << "\nco_await executor hops (" << hops << " hops)" << std::endl;
+
+    auto run = [](size_t rounds) {
+        std::promise<void> done;
+        auto finished = done.get_future();
+        hopBetweenPools(rounds, done);
+        finished.wait();
+    };
+    run(1000);   // start the pools' threads
+
+    uint64_t before = heapAllocations.load();
+    double ms = timeMs([&]() { run(hops / 2); });
+    double allocations = static_cast<double>(heapAllocations.load() - before) / hops;
+
+    report("db <-> cpu hop", hops, ms);
+    std::cout << "  " << std::left << std::setw(44) << "" << std::right << std::setw(10)
+              << std::fixed << std::setprecision(3) << allocations << " allocs/hop" << std::endl;
+}
+#endif
+
+} // namespace Benchmarks
+} // namespace FitnessQuest
+
+int main(int argc, char* argv[]) {
+    size_t records = argc > 1 ? static_cast<size_t>(std::stoul(argv[1])) : 100000;
+
+    std::cout << "==========================================" << std::endl;
+    std::cout << "FITNESS QUEST MICRO-BENCHMARKS" << std::endl;
+    std::cout << "==========================================" << std::endl;
+
+    FitnessQuest::Benchmarks::benchmarkBatchInsert(records);
+    FitnessQuest::Benchmarks::benchmarkConcurrentTable(records);
+    FitnessQuest::Benchmarks::benchmarkTableEngines(records);
+    FitnessQuest::Benchmarks::benchmarkUserFootprint(argc > 2 ? static_cast<size_t>(std::stoul(argv[2])) : 1000000);
+#ifdef BENCHMARK_HANDLERS
+    FitnessQuest::Benchmarks::benchmarkExecutorHops(records);
+    FitnessQuest::Benchmarks::benchmarkWorkoutHandlers(records / 10);
+#endif
+    return 0;
+}
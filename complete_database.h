@@ -15,6 +15,7 @@
 #include <fstream>
 #include <stdexcept>
 #include <queue>
+#include <deque>
 #include <functional>
 #include <unordered_map>
 #include <algorithm>
@@ -22,13 +23,24 @@
 #include <chrono>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <iterator>
+#include <utility>
 #include <sstream>
 #include <iomanip>
 #include <cmath>
 #include <list>
 #include <set>
 #include <cstring>
+#include <optional>
+#include <type_traits>
+#include <initializer_list>
+#include <string_view>
+#include <cerrno>
 #include <sys/stat.h>
+#include "persistence_backend.h"
 using namespace std;
 
 #ifdef _WIN32
@@ -69,11 +81,63 @@ inline bool file_exists(const std::string& filename) {
     #endif
 }
 
+inline size_t file_size(const std::string& filename) {
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0) return 0;
+    return static_cast<size_t>(info.st_size);
+}
+
+// Whole file contents; empty when the file cannot be read.
+inline std::string read_file(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) return std::string();
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+// Runs independent tasks on up to `workers` threads and rethrows the first
+// failure once every task has finished. workers == 0 uses all cores.
+inline void run_parallel(const std::vector<std::function<void()>>& tasks, unsigned workers = 0) {
+    if (workers == 0) {
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers = std::min<unsigned>(workers, static_cast<unsigned>(tasks.size()));
+
+    if (workers <= 1) {
+        for (const auto& task : tasks) task();
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::exception_ptr first_error;
+    std::mutex error_mutex;
+
+    auto worker = [&]() {
+        for (size_t i = next++; i < tasks.size(); i = next++) {
+            try {
+                tasks[i]();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!first_error) first_error = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    for (unsigned i = 1; i < workers; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : threads) t.join();
+
+    if (first_error) std::rethrow_exception(first_error);
+}
+
 // ============================================================
 // 1. SERIALIZATION HELPER FUNCTIONS
 // ============================================================
 
-inline void write_string(std::ofstream& os, const std::string& str) {
+inline void write_string(std::ostream& os, const std::string& str) {
     size_t len = str.size();
     os.write(reinterpret_cast<const char*>(&len), sizeof(len));
     if (len > 0) {
@@ -81,7 +145,7 @@ inline void write_string(std::ofstream& os, const std::string& str) {
     }
 }
 
-inline void read_string(std::ifstream& is, std::string& str) {
+inline void read_string(std::istream& is, std::string& str) {
     size_t len;
     is.read(reinterpret_cast<char*>(&len), sizeof(len));
     if (len > 0 && len < 1000000) { // Sanity check
@@ -92,7 +156,7 @@ inline void read_string(std::ifstream& is, std::string& str) {
     }
 }
 
-inline void write_vector_string(std::ofstream& os, const std::vector<std::string>& vec) {
+inline void write_vector_string(std::ostream& os, const std::vector<std::string>& vec) {
     size_t count = vec.size();
     os.write(reinterpret_cast<const char*>(&count), sizeof(count));
     for (const auto& s : vec) {
@@ -100,7 +164,7 @@ inline void write_vector_string(std::ofstream& os, const std::vector<std::string
     }
 }
 
-inline void read_vector_string(std::ifstream& is, std::vector<std::string>& vec) {
+inline void read_vector_string(std::istream& is, std::vector<std::string>& vec) {
     size_t count;
     is.read(reinterpret_cast<char*>(&count), sizeof(count));
     if (count < 10000) { // Sanity check
@@ -114,128 +178,1051 @@ inline void read_vector_string(std::ifstream& is, std::vector<std::string>& vec)
 }
 
 // ============================================================
-// 2. COMPLETE B-TREE IMPLEMENTATION WITH PERSISTENCE
+// 1b. TABLE FILES
+// A table file is [count][record...] in key order. An optional "<file>.idx"
+// sidecar records the byte offset of every stride-th record so the table can
+// be parsed in parallel chunks. Shared by every tree implementation.
 // ============================================================
 
+inline std::string table_index_path(const std::string& filename) {
+    return filename + ".idx";
+}
+
+template<typename K, typename V>
+bool read_table_records(std::istream& file, size_t records,
+                        const std::function<void(std::istream&, K&, V&)>& load_func,
+                        std::vector<std::pair<K, V>>& out) {
+    for (size_t i = 0; i < records; i++) {
+        K key;
+        V value;
+        try {
+            load_func(file, key, value);
+        } catch (...) {
+            return false;
+        }
+        if (!file) return false;
+        out.emplace_back(std::move(key), std::move(value));
+    }
+    return true;
+}
+
+// Accepts the sidecar only if it describes exactly this data file.
+inline bool read_table_index(const std::string& filename, size_t count,
+                             size_t& stride, std::vector<size_t>& offsets) {
+    std::ifstream index(table_index_path(filename), std::ios::binary);
+    if (!index) return false;
+
+    size_t indexed_count = 0, data_size = 0, offset_count = 0;
+    index.read(reinterpret_cast<char*>(&stride), sizeof(stride));
+    index.read(reinterpret_cast<char*>(&indexed_count), sizeof(indexed_count));
+    index.read(reinterpret_cast<char*>(&data_size), sizeof(data_size));
+    index.read(reinterpret_cast<char*>(&offset_count), sizeof(offset_count));
+    if (!index || stride == 0 || indexed_count != count ||
+        data_size != file_size(filename) ||
+        offset_count != (count + stride - 1) / stride) {
+        return false;
+    }
+
+    offsets.resize(offset_count);
+    index.read(reinterpret_cast<char*>(offsets.data()), offset_count * sizeof(size_t));
+    return static_cast<bool>(index) && std::is_sorted(offsets.begin(), offsets.end());
+}
+
+// Serializes the records produced by `for_each` (which must visit in key
+// order) into `data` and, with index_stride > 0, the sidecar into `index`.
+// Returns the number of records written.
+template<typename K, typename V, typename ForEach>
+size_t serialize_table(const ForEach& for_each, std::string& data, std::string& index,
+                     const std::function<void(std::ostream&, const K&, const V&)>& save_func,
+                     size_t index_stride = 0) {
+    std::ostringstream file(std::ios::binary);
+    
+    size_t count = 0;
+    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    
+    std::vector<size_t> offsets;
+    for_each([&](const K& key, const V& value) {
+        if (index_stride > 0 && count % index_stride == 0) {
+            offsets.push_back(static_cast<size_t>(file.tellp()));
+        }
+        save_func(file, key, value);
+        count++;
+    });
+    
+    size_t data_size = static_cast<size_t>(file.tellp());
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    data = file.str();
+    
+    index.clear();
+    if (index_stride == 0) {
+        return count;
+    }
+    
+    std::ostringstream idx(std::ios::binary);
+    size_t offset_count = offsets.size();
+    idx.write(reinterpret_cast<const char*>(&index_stride), sizeof(index_stride));
+    idx.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    idx.write(reinterpret_cast<const char*>(&data_size), sizeof(data_size));
+    idx.write(reinterpret_cast<const char*>(&offset_count), sizeof(offset_count));
+    idx.write(reinterpret_cast<const char*>(offsets.data()), offset_count * sizeof(size_t));
+    index = idx.str();
+    return count;
+}
+
+inline std::string table_filter_path(const std::string& filename) {
+    return filename + ".bloom";
+}
+
+// Reads a table file back in key order. workers == 1 parses sequentially;
+// anything else splits the file along its .idx offsets (when present and
+// consistent) and parses the chunks on up to `workers` threads (0 = all
+// cores). Parsing stops at the first damaged record.
 template<typename K, typename V>
+std::vector<std::pair<K, V>> read_table_file(const std::string& filename,
+                                             const std::function<void(std::istream&, K&, V&)>& load_func,
+                                             unsigned workers = 1) {
+    std::vector<std::pair<K, V>> items;
+    if (!file_exists(filename)) {
+        return items;
+    }
+    
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        return items;
+    }
+    
+    size_t count;
+    file.read(reinterpret_cast<char*>(&count), sizeof(count));
+    
+    if (!file || count > 1000000) { // Sanity check
+        file.close();
+        return items;
+    }
+    
+    size_t stride = 0;
+    std::vector<size_t> offsets;
+    bool chunked = workers != 1 && read_table_index(filename, count, stride, offsets) &&
+                   offsets.size() > 1;
+    
+    if (!chunked) {
+        items.reserve(count);
+        read_table_records(file, count, load_func, items);
+        file.close();
+        return items;
+    }
+    file.close();
+    
+    std::vector<std::vector<std::pair<K, V>>> chunks(offsets.size());
+    std::vector<char> complete(offsets.size(), 0);
+    std::vector<std::function<void()>> tasks;
+    for (size_t c = 0; c < offsets.size(); c++) {
+        tasks.push_back([&, c]() {
+            std::ifstream chunk_file(filename, std::ios::binary);
+            if (!chunk_file) return;
+            chunk_file.seekg(static_cast<std::streamoff>(offsets[c]));
+            size_t records = std::min(stride, count - c * stride);
+            chunks[c].reserve(records);
+            complete[c] = read_table_records(chunk_file, records, load_func, chunks[c]);
+        });
+    }
+    run_parallel(tasks, workers);
+    
+    // Keep the sequential semantics: stop at the first damaged chunk.
+    items.reserve(count);
+    for (size_t c = 0; c < chunks.size(); c++) {
+        std::move(chunks[c].begin(), chunks[c].end(), std::back_inserter(items));
+        if (!complete[c]) break;
+    }
+    return items;
+}
+
+// ============================================================
+// 1c. INTERNED SYMBOLS
+// Exercise IDs, muscle names, reward labels and item names come from a small
+// vocabulary. Records store them as 32-bit symbols from one process-wide
+// table instead of separate heap strings.
+// ============================================================
+
+using Symbol = uint32_t;
+
+class InternTable {
+private:
+    static constexpr size_t CHUNK_BITS = 12;
+    static constexpr size_t CHUNK_SIZE = size_t(1) << CHUNK_BITS;
+    static constexpr size_t MAX_CHUNKS = 4096;  // 16M symbols
+    
+    // Names live in fixed chunks that never move, so name() reads without a
+    // lock; interning a new name takes the mutex.
+    std::atomic<std::string*> chunks[MAX_CHUNKS];
+    std::atomic<size_t> count{0};
+    std::mutex intern_mutex;
+    std::unordered_map<std::string, Symbol> ids;
+    
+    InternTable() {
+        for (auto& chunk : chunks) chunk.store(nullptr, std::memory_order_relaxed);
+    }
+    
+    ~InternTable() {
+        for (auto& chunk : chunks) delete[] chunk.load();
+    }
+    
+public:
+    static InternTable& global() {
+        static InternTable table;
+        return table;
+    }
+    
+    InternTable(const InternTable&) = delete;
+    InternTable& operator=(const InternTable&) = delete;
+    
+    Symbol intern(const std::string& name) {
+        std::lock_guard<std::mutex> lock(intern_mutex);
+        auto it = ids.find(name);
+        if (it != ids.end()) return it->second;
+        
+        size_t id = count.load(std::memory_order_relaxed);
+        if ((id >> CHUNK_BITS) >= MAX_CHUNKS) {
+            throw std::runtime_error("Intern table full");
+        }
+        if (!chunks[id >> CHUNK_BITS].load(std::memory_order_relaxed)) {
+            chunks[id >> CHUNK_BITS].store(new std::string[CHUNK_SIZE], std::memory_order_release);
+        }
+        chunks[id >> CHUNK_BITS].load(std::memory_order_relaxed)[id & (CHUNK_SIZE - 1)] = name;
+        ids.emplace(name, static_cast<Symbol>(id));
+        count.store(id + 1, std::memory_order_release);
+        return static_cast<Symbol>(id);
+    }
+    
+    // Looks a name up without interning it.
+    std::optional<Symbol> find(const std::string& name) {
+        std::lock_guard<std::mutex> lock(intern_mutex);
+        auto it = ids.find(name);
+        if (it == ids.end()) return std::nullopt;
+        return it->second;
+    }
+    
+    // Empty for symbols this table never handed out.
+    const std::string& name(Symbol symbol) const {
+        static const std::string unknown;
+        if (symbol >= count.load(std::memory_order_acquire)) return unknown;
+        return chunks[symbol >> CHUNK_BITS].load(std::memory_order_acquire)[symbol & (CHUNK_SIZE - 1)];
+    }
+    
+    size_t size() const {
+        return count.load(std::memory_order_acquire);
+    }
+    
+    // Dictionary block: [count][name...] in symbol order, from `first` on.
+    void serialize(std::ostream& os, size_t first = 0) const {
+        size_t last = size();
+        size_t n = last > first ? last - first : 0;
+        os.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        for (size_t i = first; i < last; i++) {
+            write_string(os, name(static_cast<Symbol>(i)));
+        }
+    }
+};
+
+inline Symbol intern(const std::string& name) {
+    return InternTable::global().intern(name);
+}
+
+inline const std::string& symbol_name(Symbol symbol) {
+    return InternTable::global().name(symbol);
+}
+
+// Maps the symbol ids of files being loaded to this process's ids. A
+// database installs one while it reads its snapshot and WAL; symbol ids read
+// outside a scope are taken as they are. Legacy files predate the dictionary
+// and store names, which are interned as they are read. The scope applies to
+// the thread that created it; Bind extends it to loader threads, so readers
+// on other threads (e.g. compaction) are never translated by accident.
+class SymbolLoadScope {
+private:
+    static std::mutex& load_mutex() {
+        static std::mutex m;
+        return m;
+    }
+    
+    static SymbolLoadScope*& active() {
+        static thread_local SymbolLoadScope* scope = nullptr;
+        return scope;
+    }
+    
+    std::lock_guard<std::mutex> lock;
+    std::vector<Symbol> remap;
+    bool legacy;
+    
+public:
+    explicit SymbolLoadScope(bool legacy_files) : lock(load_mutex()), legacy(legacy_files) {
+        active() = this;
+    }
+    
+    ~SymbolLoadScope() {
+        active() = nullptr;
+    }
+    
+    SymbolLoadScope(const SymbolLoadScope&) = delete;
+    SymbolLoadScope& operator=(const SymbolLoadScope&) = delete;
+    
+    static SymbolLoadScope* current() {
+        return active();
+    }
+    
+    // Makes `scope` current on this thread until the Bind goes away.
+    class Bind {
+    private:
+        SymbolLoadScope* previous;
+        
+    public:
+        explicit Bind(SymbolLoadScope* scope) : previous(active()) { active() = scope; }
+        ~Bind() { active() = previous; }
+        Bind(const Bind&) = delete;
+        Bind& operator=(const Bind&) = delete;
+    };
+    
+    // Reads a dictionary block naming file ids [first, first + count). Ids
+    // seen before are skipped; a gap means the block cannot be used.
+    bool read_dictionary(std::istream& is, size_t first) {
+        size_t n = 0;
+        is.read(reinterpret_cast<char*>(&n), sizeof(n));
+        if (!is || n > (size_t(1) << 24) || first > remap.size()) return false;
+        for (size_t i = 0; i < n; i++) {
+            std::string name;
+            read_string(is, name);
+            if (!is) return false;
+            if (first + i == remap.size()) remap.push_back(intern(name));
+        }
+        return true;
+    }
+    
+    size_t size() const {
+        return remap.size();
+    }
+    
+    Symbol translate(Symbol file_symbol) const {
+        return file_symbol < remap.size() ? remap[file_symbol] : file_symbol;
+    }
+    
+    bool is_legacy() const {
+        return legacy;
+    }
+    
+    // True when file ids equal process ids, so no rewrite is needed.
+    bool identity() const {
+        if (legacy) return false;
+        for (size_t i = 0; i < remap.size(); i++) {
+            if (remap[i] != i) return false;
+        }
+        return true;
+    }
+};
+
+// A list of interned names. Behaves like a vector of strings for the usual
+// push_back / size / operator[] uses but stores 4 bytes per entry, and
+// membership tests compare integers.
+class SymbolList {
+private:
+    std::vector<Symbol> symbols;
+    
+public:
+    SymbolList() = default;
+    
+    SymbolList(std::initializer_list<std::string> names) {
+        symbols.reserve(names.size());
+        for (const auto& name : names) symbols.push_back(intern(name));
+    }
+    
+    void push_back(const std::string& name) {
+        symbols.push_back(intern(name));
+    }
+    
+    void push_symbol(Symbol symbol) {
+        symbols.push_back(symbol);
+    }
+    
+    bool contains(Symbol symbol) const {
+        return std::find(symbols.begin(), symbols.end(), symbol) != symbols.end();
+    }
+    
+    bool contains(const std::string& name) const {
+        auto symbol = InternTable::global().find(name);
+        return symbol && contains(*symbol);
+    }
+    
+    const std::string& operator[](size_t i) const {
+        return symbol_name(symbols[i]);
+    }
+    
+    Symbol symbol(size_t i) const { return symbols[i]; }
+    const std::vector<Symbol>& ids() const { return symbols; }
+    size_t size() const { return symbols.size(); }
+    bool empty() const { return symbols.empty(); }
+    void clear() { symbols.clear(); }
+    
+    std::vector<std::string> strings() const {
+        std::vector<std::string> out;
+        out.reserve(symbols.size());
+        for (Symbol symbol : symbols) out.push_back(symbol_name(symbol));
+        return out;
+    }
+    
+    bool operator==(const SymbolList& other) const { return symbols == other.symbols; }
+    
+    void serialize(std::ostream& os) const {
+        size_t count = symbols.size();
+        os.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        if (count > 0) {
+            os.write(reinterpret_cast<const char*>(symbols.data()), count * sizeof(Symbol));
+        }
+    }
+    
+    void deserialize(std::istream& is) {
+        SymbolLoadScope* scope = SymbolLoadScope::current();
+        if (scope && scope->is_legacy()) {
+            std::vector<std::string> names;
+            read_vector_string(is, names);
+            symbols.clear();
+            for (const auto& name : names) symbols.push_back(intern(name));
+            return;
+        }
+        
+        size_t count = 0;
+        is.read(reinterpret_cast<char*>(&count), sizeof(count));
+        if (!is || count >= 10000) { // Sanity check
+            symbols.clear();
+            return;
+        }
+        symbols.resize(count);
+        if (count > 0) {
+            is.read(reinterpret_cast<char*>(symbols.data()), count * sizeof(Symbol));
+        }
+        if (scope) {
+            for (auto& symbol : symbols) symbol = scope->translate(symbol);
+        }
+    }
+};
+
+// ============================================================
+// 2. COMPLETE B-TREE IMPLEMENTATION WITH PERSISTENCE
+// ============================================================
+
+// Maps a key to an 8-byte big-endian word whose unsigned order agrees with
+// the key order, so most node comparisons are a single integer compare.
+// Equal words are ties and fall back to comparing the full keys.
+template<typename K>
+struct KeyNormalizer {
+    static constexpr bool enabled = false;
+};
+
+template<>
+struct KeyNormalizer<std::string> {
+    static constexpr bool enabled = true;
+    
+    // Bytes [skip, skip + 8) of the key, zero padded.
+    static uint64_t normalize(const std::string& key, size_t skip) {
+        uint64_t word = 0;
+        for (size_t i = 0; i < 8; i++) {
+            size_t pos = skip + i;
+            unsigned char byte = pos < key.size() ? static_cast<unsigned char>(key[pos]) : 0;
+            word = (word << 8) | byte;
+        }
+        return word;
+    }
+    
+    static size_t common_prefix(const std::string& a, const std::string& b, size_t limit) {
+        size_t n = std::min(limit, std::min(a.size(), b.size()));
+        size_t i = 0;
+        while (i < n && a[i] == b[i]) i++;
+        return i;
+    }
+    
+    // Orders `key` against the first `len` bytes of `prefix_source`.
+    static int compare_prefix(const std::string& key, const std::string& prefix_source, size_t len) {
+        return key.compare(0, len, prefix_source, 0, len);
+    }
+};
+
+// Value storage policies for CompleteBTree. A policy decides what a node
+// entry holds next to its key (the Slot) and owns the records themselves.
+
+// Records live inside the nodes (the original layout).
+template<typename V>
+class InlineStorage {
+public:
+    using Slot = V;
+    
+    Slot make(V value) { return value; }
+    const V& get(const Slot& slot) const { return slot; }
+    void assign(Slot& slot, const V& value) { slot = value; }
+    void clear() {}
+};
+
+// Records live in a per-tree slab and nodes hold 4-byte handles, so node
+// shifts and splits move only keys and handles, and updates overwrite the
+// record in place. std::deque does not relocate records when it grows.
+template<typename V>
+class SlabStorage {
+private:
+    std::deque<V> slab;
+    
+public:
+    using Slot = uint32_t;
+    
+    Slot make(V value) {
+        slab.push_back(std::move(value));
+        return static_cast<Slot>(slab.size() - 1);
+    }
+    const V& get(Slot slot) const { return slab[slot]; }
+    void assign(Slot slot, const V& value) { slab[slot] = value; }
+    void clear() { slab.clear(); }
+};
+
+// Blocked Bloom filter for fast negative lookups. Each key maps to one
+// 64-byte block (a single cache line) and sets one bit in each of its eight
+// words, so a probe costs one line and a handful of multiplies. A present key
+// is never reported absent. Words are atomic so the concurrent tree can add
+// keys while readers probe; reset() and assignment need exclusive access.
+template<typename K>
+class BlockedBloomFilter {
+private:
+    static constexpr size_t WORDS_PER_BLOCK = 8;
+    static constexpr size_t BITS_PER_KEY = 16;
+    static constexpr size_t MIN_KEYS = 1024;
+    static constexpr uint64_t SIDECAR_MAGIC = 0x314d4f4f4c42ULL; // "BLOOM1"
+    
+    size_t blocks = 0;
+    std::unique_ptr<std::atomic<uint64_t>[]> words;
+    std::atomic<size_t> keys{0}; // keys that set a new bit: distinct keys minus false positives
+    
+    static uint64_t hash(const K& key) {
+        uint64_t h = std::hash<K>{}(key); // finalizer from MurmurHash3
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+    
+    size_t block_of(uint64_t h) const {
+        return static_cast<size_t>(((h >> 32) * blocks) >> 32);
+    }
+    
+    static uint64_t bit_of(uint64_t h, size_t word) {
+        static constexpr uint32_t SALT[WORDS_PER_BLOCK] = {
+            0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+            0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+        };
+        uint32_t x = static_cast<uint32_t>(h) * SALT[word];
+        return 1ULL << (x >> 26);
+    }
+    
+public:
+    explicit BlockedBloomFilter(size_t expected_keys = MIN_KEYS) {
+        reset(expected_keys);
+    }
+    
+    BlockedBloomFilter(BlockedBloomFilter&& other) noexcept
+        : blocks(other.blocks), words(std::move(other.words)), keys(other.keys.load()) {}
+    
+    BlockedBloomFilter& operator=(BlockedBloomFilter&& other) noexcept {
+        blocks = other.blocks;
+        words = std::move(other.words);
+        keys.store(other.keys.load());
+        return *this;
+    }
+    
+    // Empties the filter and sizes it for `expected_keys`.
+    void reset(size_t expected_keys) {
+        size_t bits = std::max(expected_keys, MIN_KEYS) * BITS_PER_KEY;
+        blocks = (bits + WORDS_PER_BLOCK * 64 - 1) / (WORDS_PER_BLOCK * 64);
+        words.reset(new std::atomic<uint64_t>[blocks * WORDS_PER_BLOCK]);
+        for (size_t i = 0; i < blocks * WORDS_PER_BLOCK; i++) {
+            words[i].store(0, std::memory_order_relaxed);
+        }
+        keys.store(0);
+    }
+    
+    void add(const K& key) {
+        uint64_t h = hash(key);
+        std::atomic<uint64_t>* block = &words[block_of(h) * WORDS_PER_BLOCK];
+        bool fresh = false;
+        for (size_t i = 0; i < WORDS_PER_BLOCK; i++) {
+            uint64_t bit = bit_of(h, i);
+            if (!(block[i].fetch_or(bit, std::memory_order_relaxed) & bit)) fresh = true;
+        }
+        if (fresh) keys.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    bool may_contain(const K& key) const {
+        uint64_t h = hash(key);
+        const std::atomic<uint64_t>* block = &words[block_of(h) * WORDS_PER_BLOCK];
+        for (size_t i = 0; i < WORDS_PER_BLOCK; i++) {
+            uint64_t bit = bit_of(h, i);
+            if (!(block[i].load(std::memory_order_relaxed) & bit)) return false;
+        }
+        return true;
+    }
+    
+    // Keys the filter was sized for.
+    size_t capacity() const {
+        return blocks * WORDS_PER_BLOCK * 64 / BITS_PER_KEY;
+    }
+    
+    // Past capacity the false-positive rate climbs; the owner re-sizes.
+    bool overloaded() const {
+        return keys.load(std::memory_order_relaxed) > capacity();
+    }
+    
+    // Sidecar stored next to a table snapshot:
+    // [magic][records][data file size][blocks][keys][words...]
+    std::string serialize(size_t records, size_t data_size) const {
+        std::string out;
+        uint64_t header[5] = {SIDECAR_MAGIC, records, data_size, blocks, keys.load()};
+        out.append(reinterpret_cast<const char*>(header), sizeof(header));
+        out.reserve(out.size() + blocks * WORDS_PER_BLOCK * sizeof(uint64_t));
+        for (size_t i = 0; i < blocks * WORDS_PER_BLOCK; i++) {
+            uint64_t word = words[i].load(std::memory_order_relaxed);
+            out.append(reinterpret_cast<const char*>(&word), sizeof(word));
+        }
+        return out;
+    }
+    
+    // Adopts a sidecar only if it was written for exactly this data file.
+    bool deserialize(const std::string& bytes, size_t records, size_t data_size) {
+        uint64_t header[5];
+        if (bytes.size() < sizeof(header)) return false;
+        std::memcpy(header, bytes.data(), sizeof(header));
+        if (header[0] != SIDECAR_MAGIC || header[1] != records || header[2] != data_size ||
+            header[3] == 0 || bytes.size() != sizeof(header) + header[3] * WORDS_PER_BLOCK * sizeof(uint64_t)) {
+            return false;
+        }
+        
+        blocks = static_cast<size_t>(header[3]);
+        words.reset(new std::atomic<uint64_t>[blocks * WORDS_PER_BLOCK]);
+        const char* src = bytes.data() + sizeof(header);
+        for (size_t i = 0; i < blocks * WORDS_PER_BLOCK; i++) {
+            uint64_t word;
+            std::memcpy(&word, src + i * sizeof(word), sizeof(word));
+            words[i].store(word, std::memory_order_relaxed);
+        }
+        keys.store(static_cast<size_t>(header[4]));
+        return true;
+    }
+};
+
+template<typename K, typename V, typename Storage = InlineStorage<V>>
 class CompleteBTree {
 private:
+    using Slot = typename Storage::Slot;
+    using Entry = std::pair<K, Slot>;
+    
+    using Normalizer = KeyNormalizer<K>;
+    
     struct BTreeNode {
         bool is_leaf;
-        vector<std::pair<K, V>> keys;
+        vector<Entry> keys;
         std::vector<std::shared_ptr<BTreeNode>> children;
         
+        // Bytes shared by every key in the node (taken from keys[0]) and, per
+        // slot, the normalized word of the bytes that follow it.
+        size_t prefix_len = 0;
+        std::vector<uint64_t> normalized;
+        
         BTreeNode(bool leaf = true) : is_leaf(leaf) {}
         
-        int find_key_position(const K& key) const {
-            for (size_t i = 0; i < keys.size(); i++) {
-                if (key <= keys[i].first) {
-                    return static_cast<int>(i);
+        // Must run after every change to `keys`.
+        void reindex() {
+            if constexpr (Normalizer::enabled) {
+                prefix_len = keys.empty() ? 0 : keys[0].first.size();
+                for (size_t i = 1; i < keys.size() && prefix_len > 0; i++) {
+                    prefix_len = Normalizer::common_prefix(keys[0].first, keys[i].first, prefix_len);
+                }
+                normalized.resize(keys.size());
+                for (size_t i = 0; i < keys.size(); i++) {
+                    normalized[i] = Normalizer::normalize(keys[i].first, prefix_len);
                 }
             }
-            return static_cast<int>(keys.size());
         }
         
-        void insert_key(const K& key, const V& value) {
-            int pos = find_key_position(key);
-            // Update if exists, insert if new
-            if (pos < static_cast<int>(keys.size()) && keys[pos].first == key) {
-                keys[pos].second = value;
+        // Index of the first key >= `key`; `found` tells whether it is equal.
+        size_t lower_bound(const K& key, bool& found) const {
+            found = false;
+            size_t i = 0;
+            if constexpr (Normalizer::enabled) {
+                if (keys.empty()) return 0;
+                int order = Normalizer::compare_prefix(key, keys[0].first, prefix_len);
+                if (order < 0) return 0;
+                if (order > 0) return keys.size();
+                
+                uint64_t probe = Normalizer::normalize(key, prefix_len);
+                while (i < normalized.size() && normalized[i] < probe) {
+                    i++;
+                }
+                // Full compares only among slots whose words tie with the probe.
+                while (i < keys.size() && normalized[i] == probe && keys[i].first < key) {
+                    i++;
+                }
             } else {
-                keys.insert(keys.begin() + pos, {key, value});
+                while (i < keys.size() && keys[i].first < key) {
+                    i++;
+                }
             }
+            found = i < keys.size() && keys[i].first == key;
+            return i;
         }
         
-        bool search_key(const K& key, V& value) const {
-            for (const auto& kv : keys) {
-                if (kv.first == key) {
-                    value = kv.second;
-                    return true;
-                }
-            }
-            return false;
+        size_t find_key_position(const K& key) const {
+            bool found;
+            return lower_bound(key, found);
         }
     };
     
     std::shared_ptr<BTreeNode> root;
+    Storage storage;
+    BlockedBloomFilter<K> filter;
     const int ORDER = 3;
     const int MIN_KEYS = ORDER - 1;
     const int MAX_KEYS = 2 * ORDER - 1;
     
-    void split_child(std::shared_ptr<BTreeNode> parent, int child_index) {
+    // Update if exists, insert if new
+    void insert_into_leaf(BTreeNode& node, const K& key, const V& value) {
+        bool found;
+        size_t pos = node.lower_bound(key, found);
+        if (found) {
+            storage.assign(node.keys[pos].second, value);
+        } else {
+            node.keys.insert(node.keys.begin() + pos, Entry(key, storage.make(value)));
+            node.reindex();
+        }
+    }
+    
+    void split_child(std::shared_ptr<BTreeNode> parent, size_t child_index) {
         auto child = parent->children[child_index];
         auto new_child = std::make_shared<BTreeNode>(child->is_leaf);
         
         int mid_index = MIN_KEYS;
-        auto mid_key = child->keys[mid_index];
+        Entry mid_key = std::move(child->keys[mid_index]);
         
-        for (size_t i = mid_index + 1; i < child->keys.size(); i++) {
-            new_child->keys.push_back(child->keys[i]);
-        }
+        new_child->keys.assign(std::make_move_iterator(child->keys.begin() + mid_index + 1),
+                               std::make_move_iterator(child->keys.end()));
         child->keys.resize(mid_index);
         
         if (!child->is_leaf) {
-            for (size_t i = mid_index + 1; i < child->children.size(); i++) {
-                new_child->children.push_back(child->children[i]);
-            }
+            new_child->children.assign(std::make_move_iterator(child->children.begin() + mid_index + 1),
+                                       std::make_move_iterator(child->children.end()));
             child->children.resize(mid_index + 1);
         }
         
-        parent->insert_key(mid_key.first, mid_key.second);
+        // A separator coming up from a child is never already in the parent.
+        parent->keys.insert(parent->keys.begin() + parent->find_key_position(mid_key.first),
+                            std::move(mid_key));
         parent->children.insert(parent->children.begin() + child_index + 1, new_child);
+        
+        child->reindex();
+        new_child->reindex();
+        parent->reindex();
     }
     
     void insert_non_full(std::shared_ptr<BTreeNode> node, const K& key, const V& value) {
         if (node->is_leaf) {
-            node->insert_key(key, value);
+            insert_into_leaf(*node, key, value);
             return;
         }
         
-        int i = static_cast<int>(node->keys.size()) - 1;
-        while (i >= 0 && key < node->keys[i].first) {
-            i--;
+        bool found;
+        size_t i = node->lower_bound(key, found);
+        // Update in place if the key lives in this internal node; descending
+        // would leave a shadowed duplicate in a leaf.
+        if (found) {
+            storage.assign(node->keys[i].second, value);
+            return;
         }
-        i++;
         
-        if (static_cast<size_t>(i) < node->children.size() && 
+        if (i < node->children.size() && 
             node->children[i]->keys.size() == static_cast<size_t>(MAX_KEYS)) {
             split_child(node, i);
+            if (key == node->keys[i].first) {
+                storage.assign(node->keys[i].second, value);
+                return;
+            }
             if (key > node->keys[i].first) {
                 i++;
             }
         }
         
-        if (static_cast<size_t>(i) < node->children.size()) {
+        if (i < node->children.size()) {
             insert_non_full(node->children[i], key, value);
         }
     }
     
-    bool search_node(std::shared_ptr<BTreeNode> node, const K& key, V& value) const {
-        if (!node) return false;
-        
-        int i = 0;
-        while (i < static_cast<int>(node->keys.size()) && key > node->keys[i].first) {
-            i++;
+    // Separators and new right siblings produced by splitting a node, in key order.
+    using Overflow = std::vector<std::pair<Entry, std::shared_ptr<BTreeNode>>>;
+    
+    // Splits an overfull node into as many pieces of at most MAX_KEYS keys as
+    // needed. The node keeps the first piece; the rest go up to the parent.
+    Overflow split_overfull(BTreeNode& node) {
+        Overflow out;
+        size_t n = node.keys.size();
+        if (n <= static_cast<size_t>(MAX_KEYS)) {
+            node.reindex();
+            return out;
         }
         
-        if (i < static_cast<int>(node->keys.size()) && key == node->keys[i].first) {
-            value = node->keys[i].second;
-            return true;
-        }
+        size_t pieces = (n + 1 + MAX_KEYS) / (MAX_KEYS + 1);
+        size_t piece_keys = n - (pieces - 1);
+        size_t base = piece_keys / pieces;
+        size_t extra = piece_keys % pieces;
         
-        if (node->is_leaf) {
-            return false;
-        }
+        std::vector<Entry> keys = std::move(node.keys);
+        std::vector<std::shared_ptr<BTreeNode>> children = std::move(node.children);
+        node.keys.clear();
+        node.children.clear();
         
-        if (static_cast<size_t>(i) < node->children.size()) {
-            return search_node(node->children[i], key, value);
-        }
+        size_t k = 0, c = 0;
+        for (size_t p = 0; p < pieces; p++) {
+            std::shared_ptr<BTreeNode> sibling;
+            BTreeNode* target = &node;
+            if (p > 0) {
+                sibling = std::make_shared<BTreeNode>(node.is_leaf);
+                target = sibling.get();
+                out.emplace_back(std::move(keys[k++]), sibling);
+            }
+            
+            size_t take = base + (p < extra ? 1 : 0);
+            target->keys.assign(std::make_move_iterator(keys.begin() + k),
+                                std::make_move_iterator(keys.begin() + k + take));
+            k += take;
+            if (!node.is_leaf) {
+                target->children.assign(std::make_move_iterator(children.begin() + c),
+                                        std::make_move_iterator(children.begin() + c + take + 1));
+                c += take + 1;
+            }
+            target->reindex();
+        }
+        return out;
+    }
+    
+    // Merges the sorted, duplicate-free items[lo, hi) into the subtree in a
+    // single pass, upserting keys that already exist.
+    Overflow merge_batch(BTreeNode& node, std::vector<std::pair<K, V>>& items, size_t lo, size_t hi) {
+        if (node.is_leaf) {
+            std::vector<Entry> merged;
+            merged.reserve(node.keys.size() + (hi - lo));
+            size_t i = 0;
+            for (size_t j = lo; j < hi; j++) {
+                while (i < node.keys.size() && node.keys[i].first < items[j].first) {
+                    merged.push_back(std::move(node.keys[i++]));
+                }
+                if (i < node.keys.size() && node.keys[i].first == items[j].first) {
+                    storage.assign(node.keys[i].second, items[j].second);
+                    merged.push_back(std::move(node.keys[i++]));
+                } else {
+                    merged.emplace_back(std::move(items[j].first), storage.make(std::move(items[j].second)));
+                }
+            }
+            std::move(node.keys.begin() + i, node.keys.end(), std::back_inserter(merged));
+            node.keys = std::move(merged);
+            return split_overfull(node);
+        }
         
-        return false;
+        std::vector<Entry> keys;
+        std::vector<std::shared_ptr<BTreeNode>> children;
+        keys.reserve(node.keys.size());
+        children.reserve(node.children.size());
+        
+        size_t j = lo;
+        for (size_t c = 0; c < node.children.size(); c++) {
+            // Items below separator c belong to child c; the rest to the last child.
+            size_t end = hi;
+            if (c < node.keys.size()) {
+                end = j;
+                while (end < hi && items[end].first < node.keys[c].first) {
+                    end++;
+                }
+            }
+            
+            Overflow child_overflow;
+            if (end > j) {
+                child_overflow = merge_batch(*node.children[c], items, j, end);
+            }
+            children.push_back(std::move(node.children[c]));
+            for (auto& split : child_overflow) {
+                keys.push_back(std::move(split.first));
+                children.push_back(std::move(split.second));
+            }
+            j = end;
+            
+            if (c < node.keys.size()) {
+                if (j < hi && items[j].first == node.keys[c].first) {
+                    storage.assign(node.keys[c].second, items[j].second);
+                    j++;
+                }
+                keys.push_back(std::move(node.keys[c]));
+            }
+        }
+        
+        node.keys = std::move(keys);
+        node.children = std::move(children);
+        return split_overfull(node);
     }
     
+    // Largest number of keys a subtree of the given height can hold.
+    size_t subtree_capacity(int height) const {
+        size_t capacity = MAX_KEYS;
+        for (int h = 1; h < height; h++) {
+            capacity = capacity * (MAX_KEYS + 1) + MAX_KEYS;
+        }
+        return capacity;
+    }
+
+    std::shared_ptr<BTreeNode> build_subtree(std::vector<Entry>& items,
+                                             size_t lo, size_t hi, int height) {
+        auto node = std::make_shared<BTreeNode>(height == 1);
+        size_t n = hi - lo;
+
+        if (height == 1) {
+            node->keys.reserve(n);
+            for (size_t i = lo; i < hi; i++) {
+                node->keys.push_back(std::move(items[i]));
+            }
+            node->reindex();
+            return node;
+        }
+
+        // Use as few children as fit, then spread the keys evenly so every
+        // leaf ends up at the same depth.
+        size_t child_capacity = subtree_capacity(height - 1);
+        size_t child_count = std::max<size_t>(2, (n + child_capacity + 1) / (child_capacity + 1));
+        size_t child_keys = n - (child_count - 1);
+        size_t base = child_keys / child_count;
+        size_t extra = child_keys % child_count;
+
+        node->keys.reserve(child_count - 1);
+        node->children.reserve(child_count);
+
+        size_t pos = lo;
+        for (size_t c = 0; c < child_count; c++) {
+            size_t take = base + (c < extra ? 1 : 0);
+            node->children.push_back(build_subtree(items, pos, pos + take, height - 1));
+            pos += take;
+            if (c + 1 < child_count) {
+                node->keys.push_back(std::move(items[pos++]));
+            }
+        }
+        node->reindex();
+        return node;
+    }
+
+    // Sorts by key and keeps the last value written for duplicate keys,
+    // matching what repeated insert() calls would have produced.
+    static void normalize_sorted(std::vector<std::pair<K, V>>& items) {
+        auto by_key = [](const std::pair<K, V>& a, const std::pair<K, V>& b) {
+            return a.first < b.first;
+        };
+        if (std::is_sorted(items.begin(), items.end(), by_key)) {
+            bool unique = std::adjacent_find(items.begin(), items.end(),
+                [](const std::pair<K, V>& a, const std::pair<K, V>& b) {
+                    return a.first == b.first;
+                }) == items.end();
+            if (unique) return;
+        }
+
+        std::stable_sort(items.begin(), items.end(), by_key);
+        size_t out = 0;
+        for (size_t i = 0; i < items.size(); i++) {
+            if (out > 0 && items[out - 1].first == items[i].first) {
+                items[out - 1] = std::move(items[i]);
+            } else {
+                if (out != i) items[out] = std::move(items[i]);
+                out++;
+            }
+        }
+        items.resize(out);
+    }
+
+    // Sizes the filter for twice the current key count and refills it.
+    void rebuild_filter() {
+        size_t count = 0;
+        for_each([&](const K&, const V&) { count++; });
+        filter.reset(count * 2);
+        for_each([&](const K& key, const V&) { filter.add(key); });
+    }
+
+    // Builds the nodes from sorted, unique items; leaves the filter alone.
+    void build_from_sorted(std::vector<std::pair<K, V>>& items) {
+        root = std::make_shared<BTreeNode>(true);
+        storage.clear();
+        if (items.empty()) return;
+
+        std::vector<Entry> entries;
+        entries.reserve(items.size());
+        for (auto& item : items) {
+            entries.emplace_back(std::move(item.first), storage.make(std::move(item.second)));
+        }
+
+        int height = 1;
+        while (subtree_capacity(height) < entries.size()) {
+            height++;
+        }
+        root = build_subtree(entries, 0, entries.size(), height);
+    }
+
 public:
     CompleteBTree() : root(std::make_shared<BTreeNode>(true)) {}
+
+    // Replaces the tree contents with `items`, building the nodes bottom-up
+    // in O(n) instead of descending from the root once per record.
+    void bulk_load(std::vector<std::pair<K, V>> items) {
+        normalize_sorted(items);
+        filter.reset(items.size() * 2);
+        for (const auto& item : items) filter.add(item.first);
+        build_from_sorted(items);
+    }
+
+    // Sorted batch upsert: sorts `items` (the last value wins for duplicate
+    // keys) and merges them in one walk down the tree instead of descending
+    // from the root once per record.
+    void insert_batch(std::vector<std::pair<K, V>> items) {
+        if (items.empty()) return;
+        if (root->is_leaf && root->keys.empty()) {
+            bulk_load(std::move(items));
+            return;
+        }
+        
+        normalize_sorted(items);
+        for (const auto& item : items) filter.add(item.first);
+        Overflow overflow = merge_batch(*root, items, 0, items.size());
+        while (!overflow.empty()) {
+            auto new_root = std::make_shared<BTreeNode>(false);
+            new_root->children.push_back(root);
+            for (auto& split : overflow) {
+                new_root->keys.push_back(std::move(split.first));
+                new_root->children.push_back(std::move(split.second));
+            }
+            root = new_root;
+            overflow = split_overfull(*root);
+        }
+        if (filter.overloaded()) rebuild_filter();
+    }
+    
+    // In-order traversal; visits every entry once in key order.
+    void for_each(const std::function<void(const K&, const V&)>& visit) const {
+        std::function<void(const BTreeNode*)> traverse = [&](const BTreeNode* node) {
+            for (size_t i = 0; i < node->keys.size(); i++) {
+                if (!node->is_leaf && i < node->children.size()) {
+                    traverse(node->children[i].get());
+                }
+                visit(node->keys[i].first, storage.get(node->keys[i].second));
+            }
+            if (!node->is_leaf && node->keys.size() < node->children.size()) {
+                traverse(node->children[node->keys.size()].get());
+            }
+        };
+        traverse(root.get());
+    }
     
     void insert(const K& key, const V& value) {
         if (root->keys.size() == static_cast<size_t>(MAX_KEYS)) {
@@ -244,20 +1231,56 @@ public:
             split_child(new_root, 0);
             root = new_root;
         }
+        filter.add(key);
         insert_non_full(root, key, value);
+        if (filter.overloaded()) rebuild_filter();
+    }
+    
+    // Zero-copy lookup: points at the stored value, or nullptr when absent.
+    // The pointer is invalidated by the next insert, bulk_load or clear.
+    const V* find(const K& key) const {
+        if (!filter.may_contain(key)) return nullptr;
+        const BTreeNode* node = root.get();
+        while (node) {
+            bool found;
+            size_t i = node->lower_bound(key, found);
+            if (found) {
+                return &storage.get(node->keys[i].second);
+            }
+            if (node->is_leaf || i >= node->children.size()) {
+                return nullptr;
+            }
+            node = node->children[i].get();
+        }
+        return nullptr;
+    }
+    
+    // Runs fn on the stored value; false when the key is absent.
+    template <typename Fn>
+    bool visit(const K& key, Fn&& fn) const {
+        const V* value = find(key);
+        if (!value) return false;
+        fn(*value);
+        return true;
     }
     
     V search(const K& key) const {
-        V value;
-        if (search_node(root, key, value)) {
-            return value;
+        if (const V* value = find(key)) {
+            return *value;
         }
         throw std::runtime_error("Key not found in B-Tree");
     }
     
+    // Non-throwing lookup; most misses are answered by the filter alone.
+    std::optional<V> try_get(const K& key) const {
+        if (const V* value = find(key)) {
+            return *value;
+        }
+        return std::nullopt;
+    }
+    
     bool exists(const K& key) const {
-        V value;
-        return search_node(root, key, value);
+        return find(key) != nullptr;
     }
     
     std::vector<K> get_all_keys() const {
@@ -306,7 +1329,7 @@ public:
                 
                 for (const auto& kv : node->keys) {
                     if (kv.first >= start && kv.first <= end) {
-                        results.push_back(kv.second);
+                        results.push_back(storage.get(kv.second));
                     }
                 }
                 
@@ -321,324 +1344,2579 @@ public:
         return results;
     }
     
+    // Serializes the table into `data`, its .idx sidecar into `index` (see
+    // serialize_table) and, when asked, its filter into `bloom`.
+    void serialize_to(std::string& data, std::string& index,
+                      const std::function<void(std::ostream&, const K&, const V&)>& save_func,
+                      size_t index_stride = 0, std::string* bloom = nullptr) const {
+        size_t count = serialize_table<K, V>([this](const std::function<void(const K&, const V&)>& visit) {
+            for_each(visit);
+        }, data, index, save_func, index_stride);
+        if (bloom) *bloom = filter.serialize(count, data.size());
+    }
+    
+    // Synchronous variant of serialize_to that writes straight to disk.
     void save_to_file(const std::string& filename, 
-                     std::function<void(std::ofstream&, const K&, const V&)> save_func) const {
+                     std::function<void(std::ostream&, const K&, const V&)> save_func,
+                     size_t index_stride = 0) const {
+        std::string data, index;
+        serialize_to(data, index, save_func, index_stride);
+        
         std::ofstream file(filename, std::ios::binary);
         if (!file) {
             throw std::runtime_error("Cannot open file for writing: " + filename);
         }
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        file.close();
         
-        auto keys = get_all_keys();
-        size_t count = keys.size();
-        file.write(reinterpret_cast<const char*>(&count), sizeof(count));
-        
-        for (const auto& key : keys) {
-            try {
-                V value = search(key);
-                save_func(file, key, value);
-            } catch (...) {
-                // Skip if not found
-            }
+        if (index.empty()) {
+            return;
         }
         
-        file.close();
+        std::ofstream index_file(table_index_path(filename), std::ios::binary);
+        if (!index_file) return;
+        index_file.write(index.data(), static_cast<std::streamsize>(index.size()));
+        index_file.close();
     }
     
+    // Loads a table written by serialize_to (see read_table_file). Into an
+    // empty tree, a matching .bloom sidecar is adopted instead of rehashing
+    // every key.
     void load_from_file(const std::string& filename,
-                       std::function<void(std::ifstream&, K&, V&)> load_func) {
-        if (!file_exists(filename)) {
+                       std::function<void(std::istream&, K&, V&)> load_func,
+                       unsigned workers = 1) {
+        auto items = read_table_file<K, V>(filename, load_func, workers);
+        if (root->is_leaf && root->keys.empty() &&
+            filter.deserialize(read_file(table_filter_path(filename)), items.size(), file_size(filename))) {
+            normalize_sorted(items);
+            build_from_sorted(items);
             return;
         }
-        
-        std::ifstream file(filename, std::ios::binary);
-        if (!file) {
-            return;
-        }
-        
-        size_t count;
-        file.read(reinterpret_cast<char*>(&count), sizeof(count));
-        
-        if (count > 1000000) { // Sanity check
-            file.close();
-            return;
-        }
-        
-        for (size_t i = 0; i < count; i++) {
-            K key;
-            V value;
-            try {
-                load_func(file, key, value);
-                insert(key, value);
-            } catch (...) {
-                break;
-            }
-        }
-        
-        file.close();
+        insert_batch(std::move(items));
     }
     
+    // The filter is re-sized as keys are inserted; nothing to catch up on.
+    void maintain_filter() {}
+    
     void clear() {
         root = std::make_shared<BTreeNode>(true);
+        storage.clear();
+        filter.reset(0);
     }
 };
 
 // ============================================================
-// 3. UPDATED DATA MODELS WITH SERIALIZATION
+// 2b. CONCURRENT B-LINK TREE (OPTIMISTIC LOCK COUPLING)
 // ============================================================
 
-enum class ExerciseDifficulty { BEGINNER = 0, INTERMEDIATE = 1, ADVANCED = 2, EXPERT = 3 };
-enum class ExerciseType { STRENGTH = 0, CARDIO = 1, FLEXIBILITY = 2, BALANCE = 3, CORE = 4 };
-
-struct Exercise {
-    std::string id;
-    std::string name;
-    ExerciseType type;
-    ExerciseDifficulty difficulty;
-    std::string description;
-    std::vector<std::string> target_muscles;
-    int calories_per_minute;
-    std::vector<std::string> prerequisites;
-    std::vector<std::string> next_exercises;
-    time_t created_at;
+// Epoch-based reclamation. Readers pin the global epoch while they hold raw
+// pointers into a concurrent structure; a retired object is freed only once
+// no reader pinned at or before its retirement epoch is still running.
+class EpochReclaimer {
+private:
+    static constexpr size_t SLOTS = 256;
+    static constexpr size_t RECLAIM_BATCH = 64;
     
-    Exercise() : type(ExerciseType::STRENGTH), 
-                difficulty(ExerciseDifficulty::BEGINNER),
-                calories_per_minute(0),
-                created_at(time(nullptr)) {}
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{0};  // 0 = not pinned
+    };
     
-    bool operator<(const Exercise& other) const { return id < other.id; }
+    struct Retired {
+        uint64_t epoch;
+        const void* ptr;
+        void (*destroy)(const void*);
+    };
     
-    void serialize(std::ofstream& os) const {
-        write_string(os, id);
-        write_string(os, name);
-        os.write(reinterpret_cast<const char*>(&type), sizeof(type));
-        os.write(reinterpret_cast<const char*>(&difficulty), sizeof(difficulty));
-        write_string(os, description);
-        write_vector_string(os, target_muscles);
-        os.write(reinterpret_cast<const char*>(&calories_per_minute), sizeof(calories_per_minute));
-        write_vector_string(os, prerequisites);
-        write_vector_string(os, next_exercises);
-        os.write(reinterpret_cast<const char*>(&created_at), sizeof(created_at));
+    Slot slots[SLOTS];
+    std::atomic<uint64_t> global_epoch{1};
+    std::mutex limbo_mutex;
+    std::vector<Retired> limbo;
+    
+    template<typename T>
+    static void destroy(const void* ptr) {
+        delete static_cast<const T*>(ptr);
     }
     
-    void deserialize(std::ifstream& is) {
-        read_string(is, id);
-        read_string(is, name);
-        is.read(reinterpret_cast<char*>(&type), sizeof(type));
-        is.read(reinterpret_cast<char*>(&difficulty), sizeof(difficulty));
-        read_string(is, description);
-        read_vector_string(is, target_muscles);
-        is.read(reinterpret_cast<char*>(&calories_per_minute), sizeof(calories_per_minute));
-        read_vector_string(is, prerequisites);
-        read_vector_string(is, next_exercises);
-        is.read(reinterpret_cast<char*>(&created_at), sizeof(created_at));
+    size_t acquire_slot() {
+        size_t i = std::hash<std::thread::id>{}(std::this_thread::get_id()) % SLOTS;
+        for (;; i = (i + 1) % SLOTS) {
+            uint64_t idle = 0;
+            if (slots[i].epoch.compare_exchange_strong(idle, global_epoch.load())) {
+                return i;
+            }
+        }
     }
-};
-
-struct User {
-    std::string id;
-    std::string username;
-    std::string email;
-    std::string password_hash;
-    int fitness_level;
-    int experience_points;
-    std::vector<std::string> completed_exercises;
-    std::vector<std::string> achievements;
-    time_t created_at;
-    time_t last_login;
     
-    User() : fitness_level(1), experience_points(0), 
-            created_at(time(nullptr)), last_login(time(nullptr)) {}
+public:
+    class Guard {
+    private:
+        EpochReclaimer& owner;
+        size_t slot;
+        
+    public:
+        explicit Guard(EpochReclaimer& reclaimer) : owner(reclaimer), slot(reclaimer.acquire_slot()) {}
+        ~Guard() { owner.slots[slot].epoch.store(0); }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
     
-    bool operator<(const User& other) const { return id < other.id; }
+    EpochReclaimer() = default;
+    EpochReclaimer(const EpochReclaimer&) = delete;
+    EpochReclaimer& operator=(const EpochReclaimer&) = delete;
     
-    void serialize(std::ofstream& os) const {
-        write_string(os, id);
-        write_string(os, username);
-        write_string(os, email);
-        write_string(os, password_hash);
-        os.write(reinterpret_cast<const char*>(&fitness_level), sizeof(fitness_level));
-        os.write(reinterpret_cast<const char*>(&experience_points), sizeof(experience_points));
-        write_vector_string(os, completed_exercises);
-        write_vector_string(os, achievements);
-        os.write(reinterpret_cast<const char*>(&created_at), sizeof(created_at));
-        os.write(reinterpret_cast<const char*>(&last_login), sizeof(last_login));
+    ~EpochReclaimer() {
+        drain();
     }
     
-    void deserialize(std::ifstream& is) {
-        read_string(is, id);
-        read_string(is, username);
-        read_string(is, email);
-        read_string(is, password_hash);
-        is.read(reinterpret_cast<char*>(&fitness_level), sizeof(fitness_level));
-        is.read(reinterpret_cast<char*>(&experience_points), sizeof(experience_points));
-        read_vector_string(is, completed_exercises);
-        read_vector_string(is, achievements);
-        is.read(reinterpret_cast<char*>(&created_at), sizeof(created_at));
-        is.read(reinterpret_cast<char*>(&last_login), sizeof(last_login));
+    Guard pin() {
+        return Guard(*this);
+    }
+    
+    // Hands an object that is no longer reachable to the reclaimer.
+    template<typename T>
+    void retire(const T* ptr) {
+        std::vector<Retired> ready;
+        {
+            std::lock_guard<std::mutex> lock(limbo_mutex);
+            limbo.push_back({global_epoch.load(), ptr, &destroy<T>});
+            if (limbo.size() < RECLAIM_BATCH) return;
+            
+            global_epoch.fetch_add(1);
+            uint64_t oldest = UINT64_MAX;
+            for (const auto& slot : slots) {
+                uint64_t epoch = slot.epoch.load();
+                if (epoch != 0) oldest = std::min(oldest, epoch);
+            }
+            auto keep = std::partition(limbo.begin(), limbo.end(),
+                                       [oldest](const Retired& r) { return r.epoch >= oldest; });
+            ready.assign(keep, limbo.end());
+            limbo.erase(keep, limbo.end());
+        }
+        for (const auto& r : ready) r.destroy(r.ptr);
+    }
+    
+    // Frees everything retired so far. Only safe with no reader pinned.
+    void drain() {
+        std::lock_guard<std::mutex> lock(limbo_mutex);
+        for (const auto& r : limbo) r.destroy(r.ptr);
+        limbo.clear();
     }
 };
 
-struct Quest {
-    std::string id;
-    std::string title;
-    std::string description;
-    int priority;
-    int difficulty;
-    std::vector<std::string> required_exercises;
-    std::vector<std::string> rewards;
-    time_t deadline;
-    bool completed;
+// B-link tree (Lehman-Yao) with optimistic lock coupling. Every node carries
+// a version word that is odd while a writer holds it; readers never write
+// shared memory, they re-check the version after reading a node and restart
+// if it moved. Each node also has a right-sibling link and an exclusive high
+// key, so a reader that lands on a node which was split under it just walks
+// right. Writers latch only the node they modify (plus the parent when a
+// split propagates), so lookups and updates on different leaves never block
+// each other.
+//
+// Keys and values are immutable heap objects: a node holds pointers, splits
+// copy pointers, and an update swaps in a new value and retires the old one
+// through the epoch reclaimer. Keys are never removed, so key objects live
+// until clear() or destruction.
+//
+// insert, visit, search, exists and for_each are safe to call concurrently;
+// bulk_load, insert_batch, load_from_file and clear require exclusive access.
+template<typename K, typename V>
+class ConcurrentBLinkTree {
+private:
+    static constexpr int CAPACITY = 32;
     
-    Quest() : priority(1), difficulty(1), completed(false), deadline(0) {}
+    struct Node {
+        std::atomic<uint64_t> version{0};
+        const int level;  // 0 = leaf
+        std::atomic<int> count{0};
+        std::atomic<const K*> keys[CAPACITY];
+        std::atomic<const V*> values[CAPACITY];    // leaves
+        std::atomic<Node*> children[CAPACITY + 1]; // inner nodes
+        std::atomic<Node*> right{nullptr};         // next node on the same level
+        std::atomic<const K*> high_key{nullptr};   // exclusive bound; nullptr = +inf
+        Node* next_allocated = nullptr;
+        
+        explicit Node(int lvl) : level(lvl) {
+            for (auto& k : keys) k.store(nullptr, std::memory_order_relaxed);
+            for (auto& v : values) v.store(nullptr, std::memory_order_relaxed);
+            for (auto& c : children) c.store(nullptr, std::memory_order_relaxed);
+        }
+    };
     
-    bool operator<(const Quest& other) const { return id < other.id; }
+    struct KeyBox {
+        K key;
+        KeyBox* next;
+    };
     
-    void serialize(std::ofstream& os) const {
-        write_string(os, id);
-        write_string(os, title);
-        write_string(os, description);
-        os.write(reinterpret_cast<const char*>(&priority), sizeof(priority));
-        os.write(reinterpret_cast<const char*>(&difficulty), sizeof(difficulty));
-        write_vector_string(os, required_exercises);
-        write_vector_string(os, rewards);
-        os.write(reinterpret_cast<const char*>(&deadline), sizeof(deadline));
-        os.write(reinterpret_cast<const char*>(&completed), sizeof(completed));
+    std::atomic<Node*> root{nullptr};
+    std::atomic<Node*> allocated_nodes{nullptr};
+    std::atomic<KeyBox*> allocated_keys{nullptr};
+    std::atomic<size_t> size{0};
+    BlockedBloomFilter<K> filter;
+    mutable EpochReclaimer reclaimer;
+    
+    Node* make_node(int level) {
+        Node* node = new Node(level);
+        node->next_allocated = allocated_nodes.load();
+        while (!allocated_nodes.compare_exchange_weak(node->next_allocated, node)) {}
+        return node;
     }
     
-    void deserialize(std::ifstream& is) {
-        read_string(is, id);
-        read_string(is, title);
-        read_string(is, description);
-        is.read(reinterpret_cast<char*>(&priority), sizeof(priority));
-        is.read(reinterpret_cast<char*>(&difficulty), sizeof(difficulty));
-        read_vector_string(is, required_exercises);
-        read_vector_string(is, rewards);
-        is.read(reinterpret_cast<char*>(&deadline), sizeof(deadline));
-        is.read(reinterpret_cast<char*>(&completed), sizeof(completed));
+    const K* make_key(const K& key) {
+        KeyBox* box = new KeyBox{key, allocated_keys.load()};
+        while (!allocated_keys.compare_exchange_weak(box->next, box)) {}
+        return &box->key;
     }
-};
-
-struct WorkoutSession {
-    std::string id;
-    std::string user_id;
-    time_t start_time;
-    time_t end_time;
-    std::vector<std::string> exercises;
-    int total_calories;
-    bool validated;
-    float form_score;
     
-    WorkoutSession() : total_calories(0), validated(false), form_score(0.0f), 
-                       start_time(time(nullptr)), end_time(0) {
-        id = "WORKOUT_" + std::to_string(time(nullptr)) + "_" + std::to_string(rand() % 1000);
+    // Version protocol: read_version waits out a writer, validate confirms
+    // nothing changed since, try_lock turns a read into a write latch.
+    static uint64_t read_version(const Node* node) {
+        uint64_t v = node->version.load();
+        while (v & 1) {
+            std::this_thread::yield();
+            v = node->version.load();
+        }
+        return v;
     }
     
-    bool operator<(const WorkoutSession& other) const { return id < other.id; }
+    static bool validate(const Node* node, uint64_t v) {
+        return node->version.load() == v;
+    }
     
-    void serialize(std::ofstream& os) const {
-        write_string(os, id);
-        write_string(os, user_id);
-        os.write(reinterpret_cast<const char*>(&start_time), sizeof(start_time));
-        os.write(reinterpret_cast<const char*>(&end_time), sizeof(end_time));
-        write_vector_string(os, exercises);
-        os.write(reinterpret_cast<const char*>(&total_calories), sizeof(total_calories));
-        os.write(reinterpret_cast<const char*>(&validated), sizeof(validated));
-        os.write(reinterpret_cast<const char*>(&form_score), sizeof(form_score));
+    static bool try_lock(Node* node, uint64_t v) {
+        return node->version.compare_exchange_strong(v, v + 1);
     }
     
-    void deserialize(std::ifstream& is) {
-        read_string(is, id);
-        read_string(is, user_id);
-        is.read(reinterpret_cast<char*>(&start_time), sizeof(start_time));
-        is.read(reinterpret_cast<char*>(&end_time), sizeof(end_time));
-        read_vector_string(is, exercises);
-        is.read(reinterpret_cast<char*>(&total_calories), sizeof(total_calories));
-        is.read(reinterpret_cast<char*>(&validated), sizeof(validated));
-        is.read(reinterpret_cast<char*>(&form_score), sizeof(form_score));
+    static void unlock(Node* node) {
+        node->version.fetch_add(1);
+    }
+    
+    // A torn read can see any count; keep it inside the arrays.
+    static int read_count(const Node* node) {
+        int count = node->count.load();
+        return std::max(0, std::min(count, CAPACITY));
+    }
+    
+    // Optimistic descent to the node on `level` whose range covers `key`.
+    // Returns nullptr when a concurrent writer forces a restart.
+    Node* descend(const K& key, int level, uint64_t& version) const {
+        Node* node = root.load();
+        uint64_t v = read_version(node);
+        if (node->level < level) return nullptr;
+        
+        for (;;) {
+            const K* high = node->high_key.load();
+            if (high && !(key < *high)) {
+                Node* right = node->right.load();
+                if (!right || !validate(node, v)) return nullptr;
+                node = right;
+                v = read_version(node);
+                continue;
+            }
+            if (node->level == level) {
+                version = v;
+                return node;
+            }
+            
+            int count = read_count(node);
+            int i = 0;
+            for (; i < count; i++) {
+                const K* separator = node->keys[i].load();
+                if (!separator) return nullptr;
+                if (key < *separator) break;
+            }
+            Node* child = node->children[i].load();
+            if (!child || !validate(node, v)) return nullptr;
+            node = child;
+            v = read_version(node);
+        }
+    }
+    
+    // Latches the node on `level` covering `key`. The high key was checked
+    // under the version the latch was taken at, so it still covers `key`.
+    Node* lock_node(const K& key, int level) {
+        for (;;) {
+            uint64_t v;
+            Node* node = descend(key, level, v);
+            if (node && try_lock(node, v)) return node;
+        }
+    }
+    
+    // Caller holds an epoch guard, which keeps the returned value alive.
+    const V* lookup(const K& key) const {
+        for (;;) {
+            uint64_t v;
+            Node* leaf = descend(key, 0, v);
+            if (!leaf) continue;
+            
+            int count = read_count(leaf);
+            const V* value = nullptr;
+            bool torn = false;
+            for (int i = 0; i < count; i++) {
+                const K* k = leaf->keys[i].load();
+                if (!k) {
+                    torn = true;
+                    break;
+                }
+                if (key < *k) break;
+                if (*k == key) {
+                    value = leaf->values[i].load();
+                    break;
+                }
+            }
+            if (!torn && validate(leaf, v)) return value;
+        }
+    }
+    
+    // Index of the first key >= `key` in a latched node.
+    static int position(const Node* node, const K& key) {
+        int count = node->count.load();
+        int pos = 0;
+        while (pos < count && *node->keys[pos].load() < key) pos++;
+        return pos;
+    }
+    
+    // `node` is latched and full. Inserts the entry at `pos`, moves the upper
+    // half to a new right sibling and posts the separator one level up.
+    void split_and_insert(Node* node, int pos, const K* key, const V* value, Node* child) {
+        constexpr int TOTAL = CAPACITY + 1;
+        const bool leaf = node->level == 0;
+        
+        const K* keys[TOTAL];
+        const V* values[TOTAL];
+        Node* children[TOTAL + 1];
+        for (int i = 0, j = 0; i < TOTAL; i++) {
+            if (i == pos) {
+                keys[i] = key;
+                values[i] = value;
+            } else {
+                keys[i] = node->keys[j].load();
+                values[i] = node->values[j].load();
+                j++;
+            }
+        }
+        if (!leaf) {
+            for (int i = 0, j = 0; i <= TOTAL; i++) {
+                children[i] = (i == pos + 1) ? child : node->children[j++].load();
+            }
+        }
+        
+        // Leaves keep [0, mid) and hand [mid, TOTAL) to the sibling; inner
+        // nodes push keys[mid] up and keep only the children on either side.
+        const int mid = TOTAL / 2;
+        const K* separator = keys[mid];
+        Node* sibling = make_node(node->level);
+        int first = leaf ? mid : mid + 1;
+        for (int i = first; i < TOTAL; i++) {
+            sibling->keys[i - first].store(keys[i]);
+            if (leaf) sibling->values[i - first].store(values[i]);
+        }
+        if (!leaf) {
+            for (int i = first; i <= TOTAL; i++) {
+                sibling->children[i - first].store(children[i]);
+            }
+        }
+        sibling->count.store(TOTAL - first);
+        sibling->right.store(node->right.load());
+        sibling->high_key.store(node->high_key.load());
+        
+        for (int i = 0; i < mid; i++) {
+            node->keys[i].store(keys[i]);
+            if (leaf) node->values[i].store(values[i]);
+        }
+        if (!leaf) {
+            for (int i = 0; i <= mid; i++) {
+                node->children[i].store(children[i]);
+            }
+        }
+        node->count.store(mid);
+        node->high_key.store(separator);
+        node->right.store(sibling);
+        
+        // Nobody reaches the sibling before the latch drops, so the new
+        // root is in place before anyone can try to post to it.
+        if (root.load() == node) {
+            Node* new_root = make_node(node->level + 1);
+            new_root->keys[0].store(separator);
+            new_root->children[0].store(node);
+            new_root->children[1].store(sibling);
+            new_root->count.store(1);
+            root.store(new_root);
+            unlock(node);
+            return;
+        }
+        
+        int level = node->level;
+        unlock(node);
+        insert_separator(level + 1, separator, sibling);
+    }
+    
+    void insert_separator(int level, const K* separator, Node* child) {
+        Node* node = lock_node(*separator, level);
+        int count = node->count.load();
+        int pos = position(node, *separator);
+        if (count == CAPACITY) {
+            split_and_insert(node, pos, separator, nullptr, child);
+            return;
+        }
+        for (int i = count; i > pos; i--) {
+            node->keys[i].store(node->keys[i - 1].load());
+        }
+        for (int i = count + 1; i > pos + 1; i--) {
+            node->children[i].store(node->children[i - 1].load());
+        }
+        node->keys[pos].store(separator);
+        node->children[pos + 1].store(child);
+        node->count.store(count + 1);
+        unlock(node);
+    }
+    
+    void destroy_all() {
+        Node* node = allocated_nodes.exchange(nullptr);
+        while (node) {
+            Node* next = node->next_allocated;
+            if (node->level == 0) {
+                int count = node->count.load();
+                for (int i = 0; i < count; i++) delete node->values[i].load();
+            }
+            delete node;
+            node = next;
+        }
+        KeyBox* box = allocated_keys.exchange(nullptr);
+        while (box) {
+            KeyBox* next = box->next;
+            delete box;
+            box = next;
+        }
+        reclaimer.drain();
+        root.store(nullptr);
+        size.store(0);
+    }
+    
+    void upsert(const K& key, const V& value, bool add_to_filter) {
+        auto guard = reclaimer.pin();
+        const V* fresh = new V(value);
+        
+        Node* leaf = lock_node(key, 0);
+        int count = leaf->count.load();
+        int pos = position(leaf, key);
+        if (pos < count && *leaf->keys[pos].load() == key) {
+            const V* old = leaf->values[pos].exchange(fresh);
+            unlock(leaf);
+            reclaimer.retire(old);
+            return;
+        }
+        
+        // The filter must cover the key before the key becomes visible.
+        if (add_to_filter) filter.add(key);
+        const K* stored_key = make_key(key);
+        size.fetch_add(1);
+        if (count == CAPACITY) {
+            split_and_insert(leaf, pos, stored_key, fresh, nullptr);
+            return;
+        }
+        for (int i = count; i > pos; i--) {
+            leaf->keys[i].store(leaf->keys[i - 1].load());
+            leaf->values[i].store(leaf->values[i - 1].load());
+        }
+        leaf->keys[pos].store(stored_key);
+        leaf->values[pos].store(fresh);
+        leaf->count.store(count + 1);
+        unlock(leaf);
+    }
+    
+    void rebuild_filter() {
+        filter.reset(size.load() * 2);
+        for_each([&](const K& key, const V&) { filter.add(key); });
+    }
+    
+public:
+    ConcurrentBLinkTree() {
+        root.store(make_node(0));
+    }
+    
+    ConcurrentBLinkTree(const ConcurrentBLinkTree&) = delete;
+    ConcurrentBLinkTree& operator=(const ConcurrentBLinkTree&) = delete;
+    
+    ~ConcurrentBLinkTree() {
+        destroy_all();
+    }
+    
+    // Upsert. Latches only the target leaf, plus one node per level while a
+    // split propagates upwards. The filter is not re-sized here; see
+    // maintain_filter().
+    void insert(const K& key, const V& value) {
+        upsert(key, value, true);
+    }
+    
+    // Runs `fn` on the stored value without copying it; false when absent.
+    // The reference must not outlive the call.
+    template<typename Fn>
+    bool visit(const K& key, Fn&& fn) const {
+        if (!filter.may_contain(key)) return false;
+        auto guard = reclaimer.pin();
+        const V* value = lookup(key);
+        if (!value) return false;
+        fn(*value);
+        return true;
+    }
+    
+    V search(const K& key) const {
+        if (auto value = try_get(key)) {
+            return std::move(*value);
+        }
+        throw std::runtime_error("Key not found in B-Tree");
+    }
+    
+    // Non-throwing lookup; most misses are answered by the filter alone.
+    std::optional<V> try_get(const K& key) const {
+        if (!filter.may_contain(key)) return std::nullopt;
+        auto guard = reclaimer.pin();
+        if (const V* value = lookup(key)) {
+            return *value;
+        }
+        return std::nullopt;
+    }
+    
+    bool exists(const K& key) const {
+        if (!filter.may_contain(key)) return false;
+        auto guard = reclaimer.pin();
+        return lookup(key) != nullptr;
+    }
+    
+    // Walks the leaf level left to right, visiting each key once in order.
+    // Every leaf is read consistently; under concurrent writes the walk is
+    // not a snapshot of the whole tree.
+    void for_each(const std::function<void(const K&, const V&)>& visit) const {
+        auto guard = reclaimer.pin();
+        
+        Node* node;
+        for (;;) {
+            node = root.load();
+            bool restart = false;
+            while (node->level > 0) {
+                uint64_t v = read_version(node);
+                Node* child = node->children[0].load();
+                if (!child || !validate(node, v)) {
+                    restart = true;
+                    break;
+                }
+                node = child;
+            }
+            if (!restart) break;
+        }
+        
+        const K* last = nullptr;
+        const K* keys[CAPACITY];
+        const V* values[CAPACITY];
+        while (node) {
+            uint64_t v = read_version(node);
+            int count = read_count(node);
+            bool torn = false;
+            for (int i = 0; i < count; i++) {
+                keys[i] = node->keys[i].load();
+                values[i] = node->values[i].load();
+                if (!keys[i] || !values[i]) torn = true;
+            }
+            Node* right = node->right.load();
+            if (torn || !validate(node, v)) continue;
+            
+            for (int i = 0; i < count; i++) {
+                if (last && !(*last < *keys[i])) continue;
+                visit(*keys[i], *values[i]);
+                last = keys[i];
+            }
+            node = right;
+        }
+    }
+    
+    std::vector<K> get_all_keys() const {
+        std::vector<K> keys;
+        for_each([&](const K& key, const V&) { keys.push_back(key); });
+        return keys;
+    }
+    
+    int get_height() const {
+        return root.load()->level + 1;
+    }
+    
+    size_t get_size() const {
+        return size.load();
+    }
+    
+    void insert_batch(std::vector<std::pair<K, V>> items) {
+        std::stable_sort(items.begin(), items.end(),
+                         [](const std::pair<K, V>& a, const std::pair<K, V>& b) {
+                             return a.first < b.first;
+                         });
+        for (const auto& item : items) {
+            insert(item.first, item.second);
+        }
+        maintain_filter();
+    }
+    
+    // Re-sizes the filter once concurrent inserts have outgrown it. Needs
+    // exclusive access; the owner calls it at quiet points (checkpoints).
+    void maintain_filter() {
+        if (filter.overloaded()) rebuild_filter();
+    }
+    
+    void bulk_load(std::vector<std::pair<K, V>> items) {
+        clear();
+        insert_batch(std::move(items));
+    }
+    
+    void serialize_to(std::string& data, std::string& index,
+                      const std::function<void(std::ostream&, const K&, const V&)>& save_func,
+                      size_t index_stride = 0, std::string* bloom = nullptr) const {
+        size_t count = serialize_table<K, V>([this](const std::function<void(const K&, const V&)>& visit) {
+            for_each(visit);
+        }, data, index, save_func, index_stride);
+        if (bloom) *bloom = filter.serialize(count, data.size());
+    }
+    
+    // Into an empty tree, a matching .bloom sidecar is adopted instead of
+    // rehashing every key.
+    void load_from_file(const std::string& filename,
+                        std::function<void(std::istream&, K&, V&)> load_func,
+                        unsigned workers = 1) {
+        auto items = read_table_file<K, V>(filename, load_func, workers);
+        if (size.load() == 0 &&
+            filter.deserialize(read_file(table_filter_path(filename)), items.size(), file_size(filename))) {
+            for (const auto& item : items) {
+                upsert(item.first, item.second, false);
+            }
+            return;
+        }
+        insert_batch(std::move(items));
+    }
+    
+    void clear() {
+        destroy_all();
+        filter.reset(0);
+        root.store(make_node(0));
     }
 };
 
 // ============================================================
-// 4. PERSISTENT FITNESS DATABASE
+// 3. UPDATED DATA MODELS WITH SERIALIZATION
 // ============================================================
 
-class PersistentFitnessDatabase {
+enum class ExerciseDifficulty { BEGINNER = 0, INTERMEDIATE = 1, ADVANCED = 2, EXPERT = 3 };
+enum class ExerciseType { STRENGTH = 0, CARDIO = 1, FLEXIBILITY = 2, BALANCE = 3, CORE = 4 };
+
+struct Exercise {
+    std::string id;
+    std::string name;
+    ExerciseType type;
+    ExerciseDifficulty difficulty;
+    std::string description;
+    SymbolList target_muscles;
+    int calories_per_minute;
+    std::vector<std::string> prerequisites;
+    std::vector<std::string> next_exercises;
+    time_t created_at;
+    
+    Exercise() : type(ExerciseType::STRENGTH), 
+                difficulty(ExerciseDifficulty::BEGINNER),
+                calories_per_minute(0),
+                created_at(time(nullptr)) {}
+    
+    bool operator<(const Exercise& other) const { return id < other.id; }
+    
+    void serialize(std::ostream& os) const {
+        write_string(os, id);
+        write_string(os, name);
+        os.write(reinterpret_cast<const char*>(&type), sizeof(type));
+        os.write(reinterpret_cast<const char*>(&difficulty), sizeof(difficulty));
+        write_string(os, description);
+        target_muscles.serialize(os);
+        os.write(reinterpret_cast<const char*>(&calories_per_minute), sizeof(calories_per_minute));
+        write_vector_string(os, prerequisites);
+        write_vector_string(os, next_exercises);
+        os.write(reinterpret_cast<const char*>(&created_at), sizeof(created_at));
+    }
+    
+    void deserialize(std::istream& is) {
+        read_string(is, id);
+        read_string(is, name);
+        is.read(reinterpret_cast<char*>(&type), sizeof(type));
+        is.read(reinterpret_cast<char*>(&difficulty), sizeof(difficulty));
+        read_string(is, description);
+        target_muscles.deserialize(is);
+        is.read(reinterpret_cast<char*>(&calories_per_minute), sizeof(calories_per_minute));
+        read_vector_string(is, prerequisites);
+        read_vector_string(is, next_exercises);
+        is.read(reinterpret_cast<char*>(&created_at), sizeof(created_at));
+    }
+};
+
+struct User {
+    std::string id;
+    std::string username;
+    std::string email;
+    std::string password_hash;
+    int fitness_level;
+    int experience_points;
+    SymbolList completed_exercises;
+    std::vector<std::string> achievements;
+    time_t created_at;
+    time_t last_login;
+    
+    User() : fitness_level(1), experience_points(0), 
+            created_at(time(nullptr)), last_login(time(nullptr)) {}
+    
+    bool operator<(const User& other) const { return id < other.id; }
+    
+    void serialize(std::ostream& os) const {
+        write_string(os, id);
+        write_string(os, username);
+        write_string(os, email);
+        write_string(os, password_hash);
+        os.write(reinterpret_cast<const char*>(&fitness_level), sizeof(fitness_level));
+        os.write(reinterpret_cast<const char*>(&experience_points), sizeof(experience_points));
+        completed_exercises.serialize(os);
+        write_vector_string(os, achievements);
+        os.write(reinterpret_cast<const char*>(&created_at), sizeof(created_at));
+        os.write(reinterpret_cast<const char*>(&last_login), sizeof(last_login));
+    }
+    
+    void deserialize(std::istream& is) {
+        read_string(is, id);
+        read_string(is, username);
+        read_string(is, email);
+        read_string(is, password_hash);
+        is.read(reinterpret_cast<char*>(&fitness_level), sizeof(fitness_level));
+        is.read(reinterpret_cast<char*>(&experience_points), sizeof(experience_points));
+        completed_exercises.deserialize(is);
+        read_vector_string(is, achievements);
+        is.read(reinterpret_cast<char*>(&created_at), sizeof(created_at));
+        is.read(reinterpret_cast<char*>(&last_login), sizeof(last_login));
+    }
+};
+
+// Vector with room for N elements inside the object; only longer lists
+// allocate. For trivially copyable element types.
+template<typename T, uint32_t N>
+class SmallVector {
+private:
+    static_assert(std::is_trivially_copyable<T>::value, "SmallVector holds trivially copyable types");
+    
+    union {
+        T local[N];
+        T* heap;
+    };
+    uint32_t count = 0;
+    uint32_t capacity = N;
+    
+    bool inline_storage() const { return capacity == N; }
+    
+public:
+    SmallVector() {}
+    
+    SmallVector(const SmallVector& other) {
+        assign(other.data(), other.size());
+    }
+    
+    SmallVector(SmallVector&& other) noexcept {
+        if (other.inline_storage()) {
+            std::memcpy(local, other.local, sizeof(T) * other.count);
+        } else {
+            heap = other.heap;
+            capacity = other.capacity;
+            other.capacity = N;
+        }
+        count = other.count;
+        other.count = 0;
+    }
+    
+    SmallVector& operator=(SmallVector other) noexcept {
+        this->~SmallVector();
+        new (this) SmallVector(std::move(other));
+        return *this;
+    }
+    
+    ~SmallVector() {
+        if (!inline_storage()) delete[] heap;
+    }
+    
+    void assign(const T* items, size_t n) {
+        count = 0;
+        reserve(n);
+        if (n > 0) std::memcpy(data(), items, sizeof(T) * n);
+        count = static_cast<uint32_t>(n);
+    }
+    
+    void reserve(size_t n) {
+        if (n <= capacity) return;
+        T* grown = new T[n];
+        if (count > 0) std::memcpy(grown, data(), sizeof(T) * count);
+        if (!inline_storage()) delete[] heap;
+        heap = grown;
+        capacity = static_cast<uint32_t>(n);
+    }
+    
+    void push_back(T value) {
+        if (count == capacity) reserve(static_cast<size_t>(capacity) * 2);
+        data()[count++] = value;
+    }
+    
+    T* data() { return inline_storage() ? local : heap; }
+    const T* data() const { return inline_storage() ? local : heap; }
+    const T* begin() const { return data(); }
+    const T* end() const { return data() + count; }
+    const T& operator[](size_t i) const { return data()[i]; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    
+    // Heap bytes owned beyond the object itself.
+    size_t heap_bytes() const { return inline_storage() ? 0 : sizeof(T) * capacity; }
+};
+
+// Packed in-memory form of User, used by the users table. The numeric fields
+// the hot paths read share the first cache line; the password hash is kept
+// as its 64-bit digest; id, username and email live in one heap block and
+// are handed out as string_views, materialized into std::string only by
+// unpack(); exercise and achievement lists are symbols stored inline while
+// short. serialize()/deserialize() use the User record format.
+class CompactUser {
+public:
+    time_t created_at = 0;
+    time_t last_login = 0;
+    int fitness_level = 1;
+    int experience_points = 0;
+    
 private:
-    CompleteBTree<std::string, Exercise> exercise_btree;
-    CompleteBTree<std::string, User> user_btree;
-    CompleteBTree<std::string, WorkoutSession> workout_btree;
-    CompleteBTree<std::string, Quest> quest_btree;
+    uint64_t password_digest = 0;
+    uint32_t id_len = 0;
+    uint32_t username_len = 0;
+    uint32_t email_len = 0;
+    uint32_t raw_hash_len = 0;  // > 0 when the hash is not a decimal digest
+    std::unique_ptr<char[]> text;  // id | username | email | raw hash
+    SmallVector<Symbol, 4> completed;
+    SmallVector<Symbol, 2> achieved;
+    
+    std::string_view slice(size_t offset, size_t len) const {
+        return len == 0 ? std::string_view() : std::string_view(text.get() + offset, len);
+    }
+    
+    // password_hash is the decimal form of a std::hash value; anything else
+    // is kept verbatim.
+    static bool parse_digest(const std::string& hash, uint64_t& digest) {
+        if (hash.empty() || hash.size() > 20 || hash[0] == '0') return false;
+        if (!std::all_of(hash.begin(), hash.end(), [](char c) { return c >= '0' && c <= '9'; })) return false;
+        errno = 0;
+        digest = std::strtoull(hash.c_str(), nullptr, 10);
+        return errno == 0 && std::to_string(digest) == hash;
+    }
+    
+public:
+    CompactUser() = default;
+    
+    CompactUser(const CompactUser& other)
+        : created_at(other.created_at), last_login(other.last_login),
+          fitness_level(other.fitness_level), experience_points(other.experience_points),
+          password_digest(other.password_digest), id_len(other.id_len),
+          username_len(other.username_len), email_len(other.email_len),
+          raw_hash_len(other.raw_hash_len), completed(other.completed), achieved(other.achieved) {
+        size_t bytes = other.text_bytes();
+        if (bytes > 0) {
+            text.reset(new char[bytes]);
+            std::memcpy(text.get(), other.text.get(), bytes);
+        }
+    }
+    
+    CompactUser(CompactUser&&) noexcept = default;
+    CompactUser& operator=(CompactUser&&) noexcept = default;
+    
+    CompactUser& operator=(const CompactUser& other) {
+        if (this != &other) *this = CompactUser(other);
+        return *this;
+    }
+    
+    static CompactUser pack(const User& user) {
+        CompactUser packed;
+        packed.created_at = user.created_at;
+        packed.last_login = user.last_login;
+        packed.fitness_level = user.fitness_level;
+        packed.experience_points = user.experience_points;
+        
+        packed.id_len = static_cast<uint32_t>(user.id.size());
+        packed.username_len = static_cast<uint32_t>(user.username.size());
+        packed.email_len = static_cast<uint32_t>(user.email.size());
+        if (!parse_digest(user.password_hash, packed.password_digest)) {
+            packed.raw_hash_len = static_cast<uint32_t>(user.password_hash.size());
+        }
+        
+        size_t bytes = packed.text_bytes();
+        if (bytes > 0) {
+            packed.text.reset(new char[bytes]);
+            char* out = packed.text.get();
+            for (const std::string* field : {&user.id, &user.username, &user.email}) {
+                std::memcpy(out, field->data(), field->size());
+                out += field->size();
+            }
+            std::memcpy(out, user.password_hash.data(), packed.raw_hash_len);
+        }
+        
+        packed.completed.assign(user.completed_exercises.ids().data(), user.completed_exercises.size());
+        packed.achieved.reserve(user.achievements.size());
+        for (const auto& achievement : user.achievements) {
+            packed.achieved.push_back(intern(achievement));
+        }
+        return packed;
+    }
+    
+    User unpack() const {
+        User user;
+        user.id = std::string(id());
+        user.username = std::string(username());
+        user.email = std::string(email());
+        user.password_hash = password_hash();
+        user.fitness_level = fitness_level;
+        user.experience_points = experience_points;
+        for (Symbol symbol : completed) user.completed_exercises.push_symbol(symbol);
+        for (Symbol symbol : achieved) user.achievements.push_back(symbol_name(symbol));
+        user.created_at = created_at;
+        user.last_login = last_login;
+        return user;
+    }
+    
+    std::string_view id() const { return slice(0, id_len); }
+    std::string_view username() const { return slice(id_len, username_len); }
+    std::string_view email() const { return slice(id_len + username_len, email_len); }
+    
+    std::string password_hash() const {
+        if (raw_hash_len > 0) {
+            return std::string(slice(id_len + username_len + email_len, raw_hash_len));
+        }
+        return password_digest == 0 ? std::string() : std::to_string(password_digest);
+    }
+    
+    const SmallVector<Symbol, 4>& completed_exercises() const { return completed; }
+    const SmallVector<Symbol, 2>& achievements() const { return achieved; }
+    
+    bool has_completed(Symbol exercise) const {
+        return std::find(completed.begin(), completed.end(), exercise) != completed.end();
+    }
+    
+    size_t text_bytes() const {
+        return static_cast<size_t>(id_len) + username_len + email_len + raw_hash_len;
+    }
+    
+    // Heap bytes owned beyond sizeof(CompactUser).
+    size_t heap_bytes() const {
+        return text_bytes() + completed.heap_bytes() + achieved.heap_bytes();
+    }
+    
+    void serialize(std::ostream& os) const {
+        unpack().serialize(os);
+    }
+    
+    void deserialize(std::istream& is) {
+        User user;
+        user.deserialize(is);
+        *this = pack(user);
+    }
+};
+
+struct Quest {
+    std::string id;
+    std::string title;
+    std::string description;
+    int priority;
+    int difficulty;
+    SymbolList required_exercises;
+    SymbolList rewards;
+    time_t deadline;
+    bool completed;
+    
+    Quest() : priority(1), difficulty(1), completed(false), deadline(0) {}
+    
+    bool operator<(const Quest& other) const { return id < other.id; }
+    
+    void serialize(std::ostream& os) const {
+        write_string(os, id);
+        write_string(os, title);
+        write_string(os, description);
+        os.write(reinterpret_cast<const char*>(&priority), sizeof(priority));
+        os.write(reinterpret_cast<const char*>(&difficulty), sizeof(difficulty));
+        required_exercises.serialize(os);
+        rewards.serialize(os);
+        os.write(reinterpret_cast<const char*>(&deadline), sizeof(deadline));
+        os.write(reinterpret_cast<const char*>(&completed), sizeof(completed));
+    }
+    
+    void deserialize(std::istream& is) {
+        read_string(is, id);
+        read_string(is, title);
+        read_string(is, description);
+        is.read(reinterpret_cast<char*>(&priority), sizeof(priority));
+        is.read(reinterpret_cast<char*>(&difficulty), sizeof(difficulty));
+        required_exercises.deserialize(is);
+        rewards.deserialize(is);
+        is.read(reinterpret_cast<char*>(&deadline), sizeof(deadline));
+        is.read(reinterpret_cast<char*>(&completed), sizeof(completed));
+    }
+};
+
+struct WorkoutSession {
+    std::string id;
+    std::string user_id;
+    time_t start_time;
+    time_t end_time;
+    SymbolList exercises;
+    int total_calories;
+    bool validated;
+    float form_score;
+    
+    WorkoutSession() : total_calories(0), validated(false), form_score(0.0f), 
+                       start_time(time(nullptr)), end_time(0) {
+        id = "WORKOUT_" + std::to_string(time(nullptr)) + "_" + std::to_string(rand() % 1000);
+    }
+    
+    bool operator<(const WorkoutSession& other) const { return id < other.id; }
+    
+    void serialize(std::ostream& os) const {
+        write_string(os, id);
+        write_string(os, user_id);
+        os.write(reinterpret_cast<const char*>(&start_time), sizeof(start_time));
+        os.write(reinterpret_cast<const char*>(&end_time), sizeof(end_time));
+        exercises.serialize(os);
+        os.write(reinterpret_cast<const char*>(&total_calories), sizeof(total_calories));
+        os.write(reinterpret_cast<const char*>(&validated), sizeof(validated));
+        os.write(reinterpret_cast<const char*>(&form_score), sizeof(form_score));
+    }
+    
+    void deserialize(std::istream& is) {
+        read_string(is, id);
+        read_string(is, user_id);
+        is.read(reinterpret_cast<char*>(&start_time), sizeof(start_time));
+        is.read(reinterpret_cast<char*>(&end_time), sizeof(end_time));
+        exercises.deserialize(is);
+        is.read(reinterpret_cast<char*>(&total_calories), sizeof(total_calories));
+        is.read(reinterpret_cast<char*>(&validated), sizeof(validated));
+        is.read(reinterpret_cast<char*>(&form_score), sizeof(form_score));
+    }
+};
+
+// ============================================================
+// 3b. COLD WORKOUT SEGMENTS
+// ============================================================
+
+// Byte-bounded LRU cache of raw segment blocks, shared by every segment of a
+// database. Safe for concurrent readers.
+class BlockCache {
+private:
+    struct Entry {
+        uint64_t key;
+        std::shared_ptr<const std::string> block;
+    };
+    
+    size_t capacity;
+    size_t used = 0;
+    std::list<Entry> lru;  // most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> entries;
+    mutable std::mutex mutex;
+    
+public:
+    explicit BlockCache(size_t capacity_bytes) : capacity(capacity_bytes) {}
+    
+    // Returns the cached block, or runs `load` and caches its result. The
+    // load runs outside the lock; racing readers may both load a block.
+    std::shared_ptr<const std::string> get(uint64_t key, const std::function<std::string()>& load) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = entries.find(key);
+            if (it != entries.end()) {
+                lru.splice(lru.begin(), lru, it->second);
+                return it->second->block;
+            }
+        }
+        
+        auto block = std::make_shared<const std::string>(load());
+        std::lock_guard<std::mutex> lock(mutex);
+        if (entries.count(key) || block->size() > capacity) return block;
+        lru.push_front({key, block});
+        entries[key] = lru.begin();
+        used += block->size();
+        while (used > capacity) {
+            used -= lru.back().block->size();
+            entries.erase(lru.back().key);
+            lru.pop_back();
+        }
+        return block;
+    }
+    
+    size_t size_bytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return used;
+    }
+    
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        lru.clear();
+        entries.clear();
+        used = 0;
+    }
+};
+
+// Immutable file of aged workouts. Sessions are sorted by (user_id, id) so a
+// user's history is contiguous, and a second sorted run maps workout ids to
+// data blocks. Only the block directories and two filters stay in memory;
+// blocks are read on demand through the BlockCache. Exercises are stored by
+// name, so a segment does not depend on symbols.dat.
+//
+// [data blocks][id blocks][meta][u64 meta offset][u64 magic]
+//   data block: [u32 count][session...]
+//   id block:   [u32 count][(id, u32 data block)...]
+//   meta:       [u64 records][data dir][id dir][id filter][user filter]
+//   dir:        [u64 blocks][(first key, u64 offset, u32 size)...]
+class WorkoutSegment {
+private:
+    static constexpr uint64_t MAGIC = 0x3147455357ULL; // "WSEG1"
+    static constexpr size_t BLOCK_BYTES = 16 * 1024;
+    
+    struct BlockRef {
+        std::string first_key;
+        uint64_t offset;
+        uint32_t size;
+    };
+    
+    std::string path;
+    uint32_t sequence;
+    size_t records = 0;
+    std::vector<BlockRef> data_blocks;
+    std::vector<BlockRef> id_blocks;
+    BlockedBloomFilter<std::string> ids;
+    BlockedBloomFilter<std::string> users;
+    BlockCache& cache;
+    
+    WorkoutSegment(const std::string& file, uint32_t seq, BlockCache& block_cache)
+        : path(file), sequence(seq), cache(block_cache) {}
+    
+    // Data blocks are ordered by user first; '\0' sorts below any id byte.
+    static std::string sort_key(const WorkoutSession& session) {
+        return session.user_id + '\0' + session.id;
+    }
+    
+    static void write_session(std::ostream& os, const WorkoutSession& session) {
+        write_string(os, session.id);
+        write_string(os, session.user_id);
+        os.write(reinterpret_cast<const char*>(&session.start_time), sizeof(session.start_time));
+        os.write(reinterpret_cast<const char*>(&session.end_time), sizeof(session.end_time));
+        write_vector_string(os, session.exercises.strings());
+        os.write(reinterpret_cast<const char*>(&session.total_calories), sizeof(session.total_calories));
+        os.write(reinterpret_cast<const char*>(&session.validated), sizeof(session.validated));
+        os.write(reinterpret_cast<const char*>(&session.form_score), sizeof(session.form_score));
+    }
+    
+    static void read_session(std::istream& is, WorkoutSession& session) {
+        read_string(is, session.id);
+        read_string(is, session.user_id);
+        is.read(reinterpret_cast<char*>(&session.start_time), sizeof(session.start_time));
+        is.read(reinterpret_cast<char*>(&session.end_time), sizeof(session.end_time));
+        std::vector<std::string> exercises;
+        read_vector_string(is, exercises);
+        session.exercises.clear();
+        for (const auto& name : exercises) session.exercises.push_back(name);
+        is.read(reinterpret_cast<char*>(&session.total_calories), sizeof(session.total_calories));
+        is.read(reinterpret_cast<char*>(&session.validated), sizeof(session.validated));
+        is.read(reinterpret_cast<char*>(&session.form_score), sizeof(session.form_score));
+    }
+    
+    // Appends items [0, count) to `out` in blocks of about BLOCK_BYTES.
+    // `write(os, i)` writes item i and `key(i)` is its sort key; `firsts`
+    // receives the first item of each block.
+    template <typename Write, typename Key>
+    static std::vector<BlockRef> write_blocks(std::string& out, size_t count, Write write, Key key,
+                                              std::vector<size_t>* firsts = nullptr) {
+        std::vector<BlockRef> dir;
+        size_t i = 0;
+        while (i < count) {
+            std::ostringstream block(std::ios::binary);
+            size_t first = i;
+            uint32_t n = 0;
+            block.write(reinterpret_cast<const char*>(&n), sizeof(n));
+            while (i < count && (n == 0 || static_cast<size_t>(block.tellp()) < BLOCK_BYTES)) {
+                write(block, i++);
+                n++;
+            }
+            std::string bytes = block.str();
+            std::memcpy(&bytes[0], &n, sizeof(n));
+            dir.push_back({key(first), out.size(), static_cast<uint32_t>(bytes.size())});
+            if (firsts) firsts->push_back(first);
+            out += bytes;
+        }
+        return dir;
+    }
+    
+    static void write_dir(std::ostream& os, const std::vector<BlockRef>& dir) {
+        uint64_t count = dir.size();
+        os.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        for (const auto& ref : dir) {
+            write_string(os, ref.first_key);
+            os.write(reinterpret_cast<const char*>(&ref.offset), sizeof(ref.offset));
+            os.write(reinterpret_cast<const char*>(&ref.size), sizeof(ref.size));
+        }
+    }
+    
+    static bool read_dir(std::istream& is, std::vector<BlockRef>& dir, uint64_t limit) {
+        uint64_t count = 0;
+        is.read(reinterpret_cast<char*>(&count), sizeof(count));
+        if (!is || count > limit) return false;
+        dir.resize(static_cast<size_t>(count));
+        for (auto& ref : dir) {
+            read_string(is, ref.first_key);
+            is.read(reinterpret_cast<char*>(&ref.offset), sizeof(ref.offset));
+            is.read(reinterpret_cast<char*>(&ref.size), sizeof(ref.size));
+            if (ref.offset + ref.size > limit) return false;
+        }
+        return static_cast<bool>(is);
+    }
+    
+    static void write_filter(std::ostream& os, const BlockedBloomFilter<std::string>& filter, size_t records) {
+        write_string(os, filter.serialize(records, 0));
+    }
+    
+    static bool read_filter(std::istream& is, BlockedBloomFilter<std::string>& filter, size_t records) {
+        size_t len = 0;
+        is.read(reinterpret_cast<char*>(&len), sizeof(len));
+        if (!is || len > (1ULL << 32)) return false;
+        std::string bytes(len, '\0');
+        is.read(&bytes[0], len);
+        return is && filter.deserialize(bytes, records, 0);
+    }
+    
+    // Blocks are numbered data first, then id; the cache key adds the segment.
+    std::shared_ptr<const std::string> block(size_t number) const {
+        const BlockRef& ref = number < data_blocks.size() ? data_blocks[number]
+                                                          : id_blocks[number - data_blocks.size()];
+        uint64_t key = (static_cast<uint64_t>(sequence) << 32) | number;
+        return cache.get(key, [&]() {
+            std::ifstream file(path, std::ios::binary);
+            std::string bytes(ref.size, '\0');
+            file.seekg(static_cast<std::streamoff>(ref.offset));
+            file.read(&bytes[0], ref.size);
+            if (!file) throw std::runtime_error("Failed to read workout segment: " + path);
+            return bytes;
+        });
+    }
+    
+    // Last block whose first key is <= key, or npos when key sorts first.
+    static size_t locate(const std::vector<BlockRef>& dir, const std::string& key) {
+        auto it = std::upper_bound(dir.begin(), dir.end(), key,
+            [](const std::string& k, const BlockRef& ref) { return k < ref.first_key; });
+        return it == dir.begin() ? std::string::npos : static_cast<size_t>(it - dir.begin()) - 1;
+    }
+    
+    template <typename Fn>
+    static void for_each_entry(const std::string& block, Fn&& fn) {
+        std::istringstream is(block, std::ios::binary);
+        uint32_t count = 0;
+        is.read(reinterpret_cast<char*>(&count), sizeof(count));
+        for (uint32_t i = 0; i < count && is; i++) {
+            if (!fn(is)) return;
+        }
+    }
+    
+public:
+    // Encodes `sessions` as a segment file.
+    static std::string build(std::vector<WorkoutSession> sessions) {
+        std::sort(sessions.begin(), sessions.end(), [](const WorkoutSession& a, const WorkoutSession& b) {
+            return sort_key(a) < sort_key(b);
+        });
+        
+        std::string out;
+        std::vector<size_t> firsts;
+        std::vector<BlockRef> data_dir = write_blocks(out, sessions.size(),
+            [&](std::ostream& os, size_t i) { write_session(os, sessions[i]); },
+            [&](size_t i) { return sort_key(sessions[i]); }, &firsts);
+        
+        std::vector<std::pair<std::string, uint32_t>> id_entries;
+        id_entries.reserve(sessions.size());
+        BlockedBloomFilter<std::string> id_filter(sessions.size());
+        BlockedBloomFilter<std::string> user_filter(sessions.size());
+        for (uint32_t block = 0; block < firsts.size(); block++) {
+            size_t end = block + 1 < firsts.size() ? firsts[block + 1] : sessions.size();
+            for (size_t i = firsts[block]; i < end; i++) {
+                id_entries.emplace_back(sessions[i].id, block);
+                id_filter.add(sessions[i].id);
+                user_filter.add(sessions[i].user_id);
+            }
+        }
+        std::sort(id_entries.begin(), id_entries.end());
+        
+        std::vector<BlockRef> id_dir = write_blocks(out, id_entries.size(),
+            [&](std::ostream& os, size_t i) {
+                write_string(os, id_entries[i].first);
+                os.write(reinterpret_cast<const char*>(&id_entries[i].second), sizeof(uint32_t));
+            },
+            [&](size_t i) { return id_entries[i].first; });
+        
+        std::ostringstream meta(std::ios::binary);
+        uint64_t count = sessions.size();
+        meta.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        write_dir(meta, data_dir);
+        write_dir(meta, id_dir);
+        write_filter(meta, id_filter, sessions.size());
+        write_filter(meta, user_filter, sessions.size());
+        
+        uint64_t footer[2] = {out.size(), MAGIC};
+        out += meta.str();
+        out.append(reinterpret_cast<const char*>(footer), sizeof(footer));
+        return out;
+    }
+    
+    // Reads the segment's directories and filters; nullptr if the file is
+    // missing or malformed.
+    static std::unique_ptr<WorkoutSegment> open(const std::string& file, uint32_t seq, BlockCache& cache) {
+        std::ifstream is(file, std::ios::binary | std::ios::ate);
+        if (!is) return nullptr;
+        uint64_t size = static_cast<uint64_t>(is.tellg());
+        uint64_t footer[2];
+        if (size < sizeof(footer)) return nullptr;
+        is.seekg(static_cast<std::streamoff>(size - sizeof(footer)));
+        is.read(reinterpret_cast<char*>(footer), sizeof(footer));
+        if (!is || footer[1] != MAGIC || footer[0] > size - sizeof(footer)) return nullptr;
+        
+        std::unique_ptr<WorkoutSegment> segment(new WorkoutSegment(file, seq, cache));
+        is.seekg(static_cast<std::streamoff>(footer[0]));
+        uint64_t count = 0;
+        is.read(reinterpret_cast<char*>(&count), sizeof(count));
+        segment->records = static_cast<size_t>(count);
+        if (!is || !read_dir(is, segment->data_blocks, footer[0]) || !read_dir(is, segment->id_blocks, footer[0]) ||
+            !read_filter(is, segment->ids, segment->records) || !read_filter(is, segment->users, segment->records)) {
+            return nullptr;
+        }
+        return segment;
+    }
+    
+    std::optional<WorkoutSession> find(const std::string& id) const {
+        if (!ids.may_contain(id)) return std::nullopt;
+        size_t index_block = locate(id_blocks, id);
+        if (index_block == std::string::npos) return std::nullopt;
+        
+        uint32_t data_block = UINT32_MAX;
+        for_each_entry(*block(data_blocks.size() + index_block), [&](std::istream& is) {
+            std::string key;
+            uint32_t target = 0;
+            read_string(is, key);
+            is.read(reinterpret_cast<char*>(&target), sizeof(target));
+            if (key == id) data_block = target;
+            return key < id;
+        });
+        if (data_block >= data_blocks.size()) return std::nullopt;
+        
+        std::optional<WorkoutSession> found;
+        for_each_entry(*block(data_block), [&](std::istream& is) {
+            WorkoutSession session;
+            read_session(is, session);
+            if (session.id == id) found = std::move(session);
+            return !found;
+        });
+        return found;
+    }
+    
+    // Calls fn(session) for each of the user's sessions, in id order.
+    template <typename Fn>
+    void for_user(const std::string& user_id, Fn&& fn) const {
+        if (!users.may_contain(user_id)) return;
+        size_t first = locate(data_blocks, user_id + '\0');
+        bool done = false;
+        for (size_t b = first == std::string::npos ? 0 : first; b < data_blocks.size() && !done; b++) {
+            for_each_entry(*block(b), [&](std::istream& is) {
+                WorkoutSession session;
+                read_session(is, session);
+                if (session.user_id == user_id) {
+                    fn(std::move(session));
+                } else if (session.user_id > user_id) {
+                    done = true;
+                }
+                return !done;
+            });
+        }
+    }
+    
+    uint32_t sequence_number() const { return sequence; }
+    size_t size() const { return records; }
+    const std::string& file_path() const { return path; }
+};
+
+// ============================================================
+// 3c. TABLE ENGINES
+// Every table of the database sits behind TableEngine, so each can choose
+// its storage: an in-memory B-tree rewritten in full at checkpoint, or an
+// LSM tree that only writes what changed since the last one.
+// ============================================================
+
+// Record codec for table files: the key, then the record's own format.
+template<typename V>
+struct RecordSerializer {
+    static void save_key(std::ostream& os, const std::string& key) { write_string(os, key); }
+    static void load_key(std::istream& is, std::string& key) { read_string(is, key); }
+    static void save_value(std::ostream& os, const V& value) { value.serialize(os); }
+    static void load_value(std::istream& is, V& value) { value.deserialize(is); }
+    
+    static void save(std::ostream& os, const std::string& key, const V& value) {
+        save_key(os, key);
+        save_value(os, value);
+    }
+    
+    static void load(std::istream& is, std::string& key, V& value) {
+        load_key(is, key);
+        load_value(is, value);
+    }
+};
+
+// The type-independent half of a table: persistence and housekeeping.
+class TableStorage {
+public:
+    virtual ~TableStorage() = default;
+    
+    virtual const char* engine_name() const = 0;
+    virtual size_t get_size() const = 0;
+    virtual void clear() = 0;
+    
+    // Housekeeping at checkpoint, with exclusive access.
+    virtual void maintain() {}
+    
+    // Queues the table's checkpoint files on the backend. Tables may
+    // snapshot in parallel.
+    virtual void snapshot(size_t index_stride) = 0;
+    
+    // Reads the table's files. A SymbolLoadScope bound on the calling thread
+    // applies to every record.
+    virtual void load(unsigned workers) = 0;
+    
+    // True when load() produced state that only a snapshot persists, e.g.
+    // files imported from the other engine.
+    virtual bool needs_snapshot() const { return false; }
+    
+    // Read before a backend flush and pass to on_durable() after it; lets
+    // the table drop what the flushed files have made redundant.
+    virtual uint64_t durability_mark() const { return 0; }
+    virtual void on_durable(uint64_t mark) { (void)mark; }
+    
+    // Every file the table may have written, for removal.
+    virtual std::vector<std::string> files() const = 0;
+};
+
+template<typename K, typename V, typename Serializer = RecordSerializer<V>>
+class TableEngine : public TableStorage {
+protected:
+    // Serializer::load, carrying the caller's SymbolLoadScope to the
+    // threads that parse table chunks.
+    static std::function<void(std::istream&, K&, V&)> scoped_loader() {
+        SymbolLoadScope* scope = SymbolLoadScope::current();
+        return [scope](std::istream& is, K& key, V& value) {
+            SymbolLoadScope::Bind bind(scope);
+            Serializer::load(is, key, value);
+        };
+    }
+    
+public:
+    virtual void insert(const K& key, const V& value) = 0;
+    virtual void insert_batch(std::vector<std::pair<K, V>> items) = 0;
+    // Replaces the whole contents.
+    virtual void bulk_load(std::vector<std::pair<K, V>> items) = 0;
+    // Runs fn on the stored record; false if the key is absent.
+    virtual bool visit(const K& key, const std::function<void(const V&)>& fn) const = 0;
+    virtual std::optional<V> try_get(const K& key) const = 0;
+    virtual bool exists(const K& key) const = 0;
+    // Visits every record in key order.
+    virtual void for_each(const std::function<void(const K&, const V&)>& fn) const = 0;
+    
+    V search(const K& key) const {
+        if (auto value = try_get(key)) {
+            return std::move(*value);
+        }
+        throw std::runtime_error("Key not found in B-Tree");
+    }
+    
+    std::vector<K> get_all_keys() const {
+        std::vector<K> keys;
+        keys.reserve(get_size());
+        for_each([&](const K& key, const V&) { keys.push_back(key); });
+        return keys;
+    }
+};
+
+// Immutable sorted run of an LSM table. Values stay encoded; the table
+// decodes them. Only the sparse block index and the filter are resident.
+//
+// [data blocks][meta][u64 meta offset][u64 magic]
+//   block: [u32 count][(key, u64 length, value bytes)...]
+//   meta:  [u64 records][u64 blocks][(first key, u64 offset, u32 size)...]
+//          [smallest key][largest key][filter]
+template<typename K, typename Serializer>
+class SSTable {
+private:
+    static constexpr uint64_t MAGIC = 0x315453534cULL; // "LSST1"
+    static constexpr size_t BLOCK_BYTES = 4096;
+    
+    struct BlockRef {
+        K first_key;
+        uint64_t offset;
+        uint32_t size;
+    };
+    
+    std::string path;
+    uint64_t number;
+    size_t records = 0;
+    size_t bytes = 0;
+    K smallest{};
+    K largest{};
+    std::vector<BlockRef> blocks;
+    BlockedBloomFilter<K> filter;
+    BlockCache& cache;
+    
+    // The file's bytes, kept until the backend confirms they are on disk.
+    mutable std::mutex resident_mutex;
+    std::shared_ptr<const std::string> resident;
+    std::atomic<bool> remove_on_close{false};
+    
+    SSTable(const std::string& file, uint64_t file_number, BlockCache& block_cache)
+        : path(file), number(file_number), cache(block_cache) {}
+    
+    bool read_meta(std::istream& is, uint64_t meta_offset) {
+        uint64_t count = 0, block_count = 0;
+        is.read(reinterpret_cast<char*>(&count), sizeof(count));
+        is.read(reinterpret_cast<char*>(&block_count), sizeof(block_count));
+        if (!is || block_count > meta_offset) return false;
+        records = static_cast<size_t>(count);
+        blocks.resize(static_cast<size_t>(block_count));
+        for (auto& ref : blocks) {
+            Serializer::load_key(is, ref.first_key);
+            is.read(reinterpret_cast<char*>(&ref.offset), sizeof(ref.offset));
+            is.read(reinterpret_cast<char*>(&ref.size), sizeof(ref.size));
+            if (!is || ref.offset + ref.size > meta_offset) return false;
+        }
+        Serializer::load_key(is, smallest);
+        Serializer::load_key(is, largest);
+        uint64_t filter_size = 0;
+        is.read(reinterpret_cast<char*>(&filter_size), sizeof(filter_size));
+        if (!is || filter_size > (uint64_t(1) << 32)) return false;
+        std::string filter_bytes(static_cast<size_t>(filter_size), '\0');
+        is.read(&filter_bytes[0], static_cast<std::streamsize>(filter_size));
+        return is && filter.deserialize(filter_bytes, records, 0);
+    }
+    
+    std::shared_ptr<const std::string> block(size_t index) const {
+        const BlockRef& ref = blocks[index];
+        return cache.get((number << 32) | index, [&]() {
+            std::shared_ptr<const std::string> image;
+            {
+                std::lock_guard<std::mutex> lock(resident_mutex);
+                image = resident;
+            }
+            if (image) return image->substr(static_cast<size_t>(ref.offset), ref.size);
+            
+            std::ifstream file(path, std::ios::binary);
+            std::string data(ref.size, '\0');
+            file.seekg(static_cast<std::streamoff>(ref.offset));
+            file.read(&data[0], ref.size);
+            if (!file) throw std::runtime_error("Failed to read table file: " + path);
+            return data;
+        });
+    }
+    
+    std::vector<std::pair<K, std::string>> read_block(size_t index) const {
+        std::shared_ptr<const std::string> data = block(index);
+        std::istringstream is(*data, std::ios::binary);
+        uint32_t count = 0;
+        is.read(reinterpret_cast<char*>(&count), sizeof(count));
+        std::vector<std::pair<K, std::string>> entries;
+        entries.reserve(count);
+        for (uint32_t i = 0; i < count && is; i++) {
+            entries.emplace_back();
+            Serializer::load_key(is, entries.back().first);
+            read_string(is, entries.back().second);
+        }
+        if (!is) throw std::runtime_error("Damaged table file: " + path);
+        return entries;
+    }
+    
+public:
+    // Encodes records added in strictly increasing key order.
+    class Builder {
+    private:
+        std::string out;
+        std::ostringstream block{std::ios::binary};
+        uint32_t block_records = 0;
+        size_t block_bytes = 0;
+        K block_first{};
+        std::vector<BlockRef> directory;
+        std::vector<K> keys;
+        
+        void finish_block() {
+            if (block_records == 0) return;
+            std::string data = block.str();
+            std::memcpy(&data[0], &block_records, sizeof(block_records));
+            directory.push_back({block_first, out.size(), static_cast<uint32_t>(data.size())});
+            out += data;
+            block.str(std::string());
+            block_records = 0;
+            block_bytes = 0;
+        }
+        
+    public:
+        void add(const K& key, const std::string& value) {
+            if (block_records == 0) {
+                block_first = key;
+                block.write(reinterpret_cast<const char*>(&block_records), sizeof(block_records));
+            }
+            Serializer::save_key(block, key);
+            write_string(block, value);
+            block_records++;
+            keys.push_back(key);
+            block_bytes = static_cast<size_t>(block.tellp());
+            if (block_bytes >= BLOCK_BYTES) finish_block();
+        }
+        
+        size_t size_bytes() const { return out.size() + block_bytes; }
+        size_t records() const { return keys.size(); }
+        
+        std::string finish() {
+            finish_block();
+            BlockedBloomFilter<K> key_filter(keys.size());
+            for (const auto& key : keys) key_filter.add(key);
+            
+            std::ostringstream meta(std::ios::binary);
+            uint64_t counts[2] = {keys.size(), directory.size()};
+            meta.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+            for (const auto& ref : directory) {
+                Serializer::save_key(meta, ref.first_key);
+                meta.write(reinterpret_cast<const char*>(&ref.offset), sizeof(ref.offset));
+                meta.write(reinterpret_cast<const char*>(&ref.size), sizeof(ref.size));
+            }
+            Serializer::save_key(meta, keys.empty() ? K{} : keys.front());
+            Serializer::save_key(meta, keys.empty() ? K{} : keys.back());
+            std::string filter_bytes = key_filter.serialize(keys.size(), 0);
+            uint64_t filter_size = filter_bytes.size();
+            meta.write(reinterpret_cast<const char*>(&filter_size), sizeof(filter_size));
+            meta.write(filter_bytes.data(), static_cast<std::streamsize>(filter_size));
+            
+            uint64_t footer[2] = {out.size(), MAGIC};
+            out += meta.str();
+            out.append(reinterpret_cast<const char*>(footer), sizeof(footer));
+            return std::move(out);
+        }
+    };
+    
+    // Reads the table's meta from `image` when given (a file still being
+    // written) or from disk; nullptr if the file is missing or malformed.
+    static std::shared_ptr<SSTable> open(const std::string& file, uint64_t file_number, BlockCache& cache,
+                                         std::shared_ptr<const std::string> image = nullptr) {
+        std::shared_ptr<SSTable> table(new SSTable(file, file_number, cache));
+        uint64_t footer[2];
+        std::string meta;
+        if (image) {
+            if (image->size() < sizeof(footer)) return nullptr;
+            std::memcpy(footer, image->data() + image->size() - sizeof(footer), sizeof(footer));
+            table->bytes = image->size();
+            if (footer[1] != MAGIC || footer[0] > table->bytes - sizeof(footer)) return nullptr;
+            meta = image->substr(static_cast<size_t>(footer[0]), table->bytes - sizeof(footer) - footer[0]);
+            table->resident = std::move(image);
+        } else {
+            std::ifstream is(file, std::ios::binary | std::ios::ate);
+            if (!is) return nullptr;
+            table->bytes = static_cast<size_t>(is.tellg());
+            if (table->bytes < sizeof(footer)) return nullptr;
+            is.seekg(static_cast<std::streamoff>(table->bytes - sizeof(footer)));
+            is.read(reinterpret_cast<char*>(footer), sizeof(footer));
+            if (!is || footer[1] != MAGIC || footer[0] > table->bytes - sizeof(footer)) return nullptr;
+            meta.resize(table->bytes - sizeof(footer) - static_cast<size_t>(footer[0]));
+            is.seekg(static_cast<std::streamoff>(footer[0]));
+            is.read(&meta[0], static_cast<std::streamsize>(meta.size()));
+            if (!is) return nullptr;
+        }
+        
+        std::istringstream is(meta, std::ios::binary);
+        if (!table->read_meta(is, footer[0])) return nullptr;
+        return table;
+    }
+    
+    ~SSTable() {
+        if (remove_on_close.load()) std::remove(path.c_str());
+    }
+    
+    SSTable(const SSTable&) = delete;
+    SSTable& operator=(const SSTable&) = delete;
+    
+    bool get(const K& key, std::string& value) const {
+        if (records == 0 || key < smallest || largest < key || !filter.may_contain(key)) return false;
+        auto it = std::upper_bound(blocks.begin(), blocks.end(), key,
+            [](const K& k, const BlockRef& ref) { return k < ref.first_key; });
+        if (it == blocks.begin()) return false;
+        
+        // Scan the block in place: keys are sorted, and values of the
+        // records before the match are skipped rather than decoded.
+        std::shared_ptr<const std::string> data = block(static_cast<size_t>(it - blocks.begin()) - 1);
+        std::istringstream is(*data, std::ios::binary);
+        uint32_t count = 0;
+        is.read(reinterpret_cast<char*>(&count), sizeof(count));
+        K current{};
+        for (uint32_t i = 0; i < count && is; i++) {
+            Serializer::load_key(is, current);
+            if (current == key) {
+                read_string(is, value);
+                return static_cast<bool>(is);
+            }
+            if (key < current) return false;
+            size_t len = 0;
+            is.read(reinterpret_cast<char*>(&len), sizeof(len));
+            is.seekg(static_cast<std::streamoff>(len), std::ios::cur);
+        }
+        if (!is) throw std::runtime_error("Damaged table file: " + path);
+        return false;
+    }
+    
+    // Once the data is on disk, reads go to the file.
+    void release_image() {
+        std::lock_guard<std::mutex> lock(resident_mutex);
+        resident.reset();
+    }
+    
+    // Deletes the file when the last reader lets go of the table.
+    void remove_when_unused() { remove_on_close.store(true); }
+    
+    uint64_t file_number() const { return number; }
+    size_t size() const { return records; }
+    size_t size_bytes() const { return bytes; }
+    const K& smallest_key() const { return smallest; }
+    const K& largest_key() const { return largest; }
+    
+    // Walks a sequence of tables (one table, or the disjoint tables of a
+    // level in key order) record by record.
+    class Cursor {
+    private:
+        std::vector<std::shared_ptr<SSTable>> tables;
+        size_t table = 0;
+        size_t block_index = 0;
+        size_t position = 0;
+        std::vector<std::pair<K, std::string>> entries;
+        
+        void fill() {
+            entries.clear();
+            position = 0;
+            while (table < tables.size()) {
+                if (block_index < tables[table]->blocks.size()) {
+                    entries = tables[table]->read_block(block_index);
+                    if (!entries.empty()) return;
+                    block_index++;
+                } else {
+                    table++;
+                    block_index = 0;
+                }
+            }
+        }
+        
+    public:
+        explicit Cursor(std::vector<std::shared_ptr<SSTable>> sequence) : tables(std::move(sequence)) {
+            fill();
+        }
+        
+        bool valid() const { return position < entries.size(); }
+        const K& key() const { return entries[position].first; }
+        std::string& value() { return entries[position].second; }
+        
+        void next() {
+            if (++position >= entries.size()) {
+                block_index++;
+                fill();
+            }
+        }
+    };
+};
+
+struct LsmOptions {
+    // L0 tables (one per checkpoint) that trigger a compaction into L1.
+    size_t l0_compaction_trigger = 4;
+    // Size limit of L1; every deeper level may hold ten times more.
+    size_t level_base_bytes = 8 * 1024 * 1024;
+    // Compactions cut their output into files of about this size.
+    size_t target_file_bytes = 2 * 1024 * 1024;
+    // Bytes of table blocks kept in memory.
+    size_t cache_bytes = 4 * 1024 * 1024;
+    // Compact on a background thread; otherwise only compact() does.
+    bool background_compaction = true;
+};
+
+// LSM table: writes land in a sorted memtable, which each snapshot turns
+// into a new level-0 table; a background thread merges tables down into
+// larger, non-overlapping levels. The memtable needs no log of its own:
+// everything in it is also in the database WAL until the next checkpoint.
+//
+// Files: "<base>.lsm" names the live tables level by level, and each table
+// is "<base>.sst.<n>". Files replaced by a compaction are deleted once a
+// manifest without them is on disk and no reader holds them. Safe for
+// concurrent readers and writers.
+template<typename K, typename V, typename Serializer = RecordSerializer<V>>
+class LsmTable : public TableEngine<K, V, Serializer> {
+private:
+    using Table = SSTable<K, Serializer>;
+    using TablePtr = std::shared_ptr<Table>;
+    using Cursor = typename Table::Cursor;
+    
+    static constexpr uint64_t MANIFEST_MAGIC = 0x324d4d534cULL; // "LSMM2"
+    static constexpr uint64_t MANIFEST_MAGIC_V1 = 0x314d4d534cULL; // key count included the memtable
+    static constexpr size_t MAX_LEVELS = 7;
+    
+    // Level 0 holds one table per snapshot, newest first; deeper levels hold
+    // disjoint tables sorted by key.
+    struct Version {
+        std::vector<std::vector<TablePtr>> levels = std::vector<std::vector<TablePtr>>(MAX_LEVELS);
+    };
+    
+    struct Pending {
+        uint64_t mark;  // manifest that must be durable first
+        TablePtr table;
+    };
+    
+    std::string base;
+    PersistenceBackend& backend;
+    LsmOptions options;
+    BlockCache cache;
+    
+    mutable std::shared_mutex mutex;  // memtable, version, table_keys, next_file, epoch
+    std::map<K, V> memtable;
+    std::shared_ptr<const Version> version = std::make_shared<Version>();
+    size_t table_keys = 0;  // distinct keys across the version's tables
+    uint64_t next_file = 1;
+    uint64_t epoch = 0;  // bumped when the contents are replaced
+    
+    // Orders manifests with the files they name. Taken before `mutex`.
+    mutable std::mutex manifest_mutex;
+    uint64_t manifests_queued = 0;
+    std::vector<Pending> images;    // tables whose bytes are still held
+    std::vector<Pending> obsolete;  // tables no longer in the version
+    std::vector<std::string> retired_files;  // imported from the other engine
+    uint64_t retired_after = 0;
+    bool snapshot_needed = false;
+    
+    std::mutex compaction_mutex;  // one compaction at a time
+    std::size_t compact_cursor[MAX_LEVELS] = {};
+    std::thread compactor;
+    std::mutex work_mutex;
+    std::condition_variable work_cv;
+    bool work_pending = false;
+    bool stopping = false;
+    
+    std::string manifest_path() const { return base + ".lsm"; }
+    std::string table_path(uint64_t number) const { return base + ".sst." + std::to_string(number); }
+    
+    static std::string encode(const V& value) {
+        std::ostringstream os(std::ios::binary);
+        Serializer::save_value(os, value);
+        return os.str();
+    }
+    
+    static V decode(const std::string& bytes) {
+        std::istringstream is(bytes, std::ios::binary);
+        V value;
+        Serializer::load_value(is, value);
+        return value;
+    }
+    
+    size_t level_limit(size_t level) const {
+        size_t limit = options.level_base_bytes;
+        for (size_t i = 1; i < level; i++) limit *= 10;
+        return limit;
+    }
+    
+    static size_t level_bytes(const std::vector<TablePtr>& level) {
+        size_t total = 0;
+        for (const auto& table : level) total += table->size_bytes();
+        return total;
+    }
+    
+    // Tables of a sorted level whose key range meets [lo, hi].
+    static std::vector<TablePtr> overlapping(const std::vector<TablePtr>& level, const K& lo, const K& hi) {
+        std::vector<TablePtr> found;
+        for (const auto& table : level) {
+            if (!(table->largest_key() < lo) && !(hi < table->smallest_key())) found.push_back(table);
+        }
+        return found;
+    }
+    
+    static bool find_encoded(const Version& v, const K& key, std::string& value) {
+        for (const auto& table : v.levels[0]) {
+            if (table->get(key, value)) return true;
+        }
+        for (size_t level = 1; level < MAX_LEVELS; level++) {
+            const auto& tables = v.levels[level];
+            auto it = std::lower_bound(tables.begin(), tables.end(), key,
+                [](const TablePtr& table, const K& k) { return table->largest_key() < k; });
+            if (it != tables.end() && (*it)->get(key, value)) return true;
+        }
+        return false;
+    }
+    
+    // Memtable keys no table holds yet. A lookup per key, so it runs when
+    // the size is asked for or the memtable is flushed, never per insert.
+    // Caller holds `mutex`.
+    size_t fresh_keys(const Version& v) const {
+        size_t fresh = 0;
+        std::string ignored;
+        for (const auto& item : memtable) {
+            if (!find_encoded(v, item.first, ignored)) fresh++;
+        }
+        return fresh;
+    }
+    
+    // Cursors over every table, newest data first.
+    static std::vector<Cursor> cursors(const Version& v) {
+        std::vector<Cursor> result;
+        for (const auto& table : v.levels[0]) result.emplace_back(std::vector<TablePtr>{table});
+        for (size_t level = 1; level < MAX_LEVELS; level++) {
+            if (!v.levels[level].empty()) result.emplace_back(v.levels[level]);
+        }
+        return result;
+    }
+    
+    // Merges cursors ordered newest first: each key once, from the newest
+    // cursor holding it. emit(key, encoded value).
+    template <typename Emit>
+    static void merge(std::vector<Cursor>& inputs, Emit&& emit) {
+        for (;;) {
+            Cursor* newest = nullptr;
+            for (auto& cursor : inputs) {
+                if (cursor.valid() && (!newest || cursor.key() < newest->key())) newest = &cursor;
+            }
+            if (!newest) return;
+            K key = newest->key();
+            emit(key, newest->value());
+            for (auto& cursor : inputs) {
+                if (cursor.valid() && !(key < cursor.key())) cursor.next();
+            }
+        }
+    }
+    
+    void write_manifest(const Version& v) {
+        std::ostringstream os(std::ios::binary);
+        uint64_t header[4] = {MANIFEST_MAGIC, next_file, table_keys, MAX_LEVELS};
+        os.write(reinterpret_cast<const char*>(header), sizeof(header));
+        for (const auto& level : v.levels) {
+            uint64_t count = level.size();
+            os.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            for (const auto& table : level) {
+                uint64_t number = table->file_number();
+                os.write(reinterpret_cast<const char*>(&number), sizeof(number));
+            }
+        }
+        backend.replace_file(manifest_path(), os.str());
+        manifests_queued++;
+    }
+    
+    // Writes a table through the backend and opens it from its bytes.
+    TablePtr write_table(uint64_t number, std::string bytes) {
+        auto image = std::make_shared<const std::string>(std::move(bytes));
+        TablePtr table = Table::open(table_path(number), number, cache, image);
+        if (!table) throw std::runtime_error("Failed to build table file: " + table_path(number));
+        backend.replace_file(table_path(number), *image);
+        return table;
+    }
+    
+    // Drops every table in favour of `items`; they reach disk at the next
+    // snapshot. Needs manifest_mutex.
+    void replace_contents(std::map<K, V> items) {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        for (const auto& level : version->levels) {
+            for (const auto& table : level) obsolete.push_back({manifests_queued + 1, table});
+        }
+        version = std::make_shared<Version>();
+        memtable = std::move(items);
+        table_keys = 0;
+        epoch++;
+    }
+    
+    // Picks and runs one compaction; false when every level is within its
+    // limits.
+    bool compact_once() {
+        std::shared_ptr<const Version> current;
+        uint64_t started_epoch;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            current = version;
+            started_epoch = epoch;
+        }
+        
+        size_t level = 0;
+        std::vector<TablePtr> upper;
+        if (current->levels[0].size() >= std::max<size_t>(1, options.l0_compaction_trigger)) {
+            upper = current->levels[0];
+        } else {
+            for (level = 1; level + 1 < MAX_LEVELS; level++) {
+                const auto& tables = current->levels[level];
+                if (!tables.empty() && level_bytes(tables) > level_limit(level)) {
+                    upper.push_back(tables[compact_cursor[level]++ % tables.size()]);
+                    break;
+                }
+            }
+            if (upper.empty()) return false;
+        }
+        
+        K lo = upper[0]->smallest_key(), hi = upper[0]->largest_key();
+        for (const auto& table : upper) {
+            lo = std::min(lo, table->smallest_key());
+            hi = std::max(hi, table->largest_key());
+        }
+        std::vector<TablePtr> lower = overlapping(current->levels[level + 1], lo, hi);
+        
+        // A table that overlaps nothing below moves down as it is.
+        std::vector<TablePtr> outputs;
+        if (level > 0 && lower.empty()) {
+            outputs = upper;
+        } else {
+            std::vector<Cursor> inputs;
+            for (const auto& table : upper) inputs.emplace_back(std::vector<TablePtr>{table});
+            if (!lower.empty()) inputs.emplace_back(lower);
+            
+            std::vector<std::pair<uint64_t, std::string>> files;
+            typename Table::Builder builder;
+            auto cut = [&]() {
+                if (builder.records() == 0) return;
+                uint64_t number;
+                {
+                    std::unique_lock<std::shared_mutex> lock(mutex);
+                    number = next_file++;
+                }
+                files.emplace_back(number, builder.finish());
+                builder = typename Table::Builder();
+            };
+            merge(inputs, [&](const K& key, const std::string& value) {
+                builder.add(key, value);
+                if (builder.size_bytes() >= options.target_file_bytes) cut();
+            });
+            cut();
+            for (auto& file : files) outputs.push_back(write_table(file.first, std::move(file.second)));
+        }
+        
+        uint64_t mark;
+        {
+            std::lock_guard<std::mutex> manifest_lock(manifest_mutex);
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            if (epoch != started_epoch) {
+                if (!(level > 0 && lower.empty())) {
+                    for (const auto& table : outputs) table->remove_when_unused();
+                }
+                return true;
+            }
+            
+            auto next = std::make_shared<Version>(*version);
+            auto drop = [](std::vector<TablePtr>& tables, const std::vector<TablePtr>& gone) {
+                tables.erase(std::remove_if(tables.begin(), tables.end(), [&](const TablePtr& table) {
+                    return std::find(gone.begin(), gone.end(), table) != gone.end();
+                }), tables.end());
+            };
+            drop(next->levels[level], upper);
+            drop(next->levels[level + 1], lower);
+            auto& target = next->levels[level + 1];
+            target.insert(target.end(), outputs.begin(), outputs.end());
+            std::sort(target.begin(), target.end(), [](const TablePtr& a, const TablePtr& b) {
+                return a->smallest_key() < b->smallest_key();
+            });
+            
+            if (!(level > 0 && lower.empty())) {
+                for (const auto& table : upper) obsolete.push_back({manifests_queued + 1, table});
+                for (const auto& table : lower) obsolete.push_back({manifests_queued + 1, table});
+                for (const auto& table : outputs) images.push_back({manifests_queued + 1, table});
+            }
+            version = next;
+            write_manifest(*next);
+            mark = manifests_queued;
+        }
+        
+        // Off the request path, so waiting for the disk is fine here.
+        backend.flush();
+        on_durable(mark);
+        return true;
+    }
+    
+    void compaction_loop() {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(work_mutex);
+                work_cv.wait(lock, [this]() { return stopping || work_pending; });
+                if (stopping) return;
+                work_pending = false;
+            }
+            try {
+                compact();
+            } catch (const std::exception& e) {
+                std::cerr << "Warning: Compaction of " << base << " failed: " << e.what() << std::endl;
+            }
+        }
+    }
+    
+public:
+    LsmTable(const std::string& base_path, PersistenceBackend& persistence, const LsmOptions& opts = LsmOptions())
+        : base(base_path), backend(persistence), options(opts), cache(opts.cache_bytes) {
+        if (options.background_compaction) {
+            compactor = std::thread(&LsmTable::compaction_loop, this);
+        }
+    }
+    
+    ~LsmTable() override {
+        {
+            std::lock_guard<std::mutex> lock(work_mutex);
+            stopping = true;
+        }
+        work_cv.notify_all();
+        if (compactor.joinable()) compactor.join();
+    }
+    
+    LsmTable(const LsmTable&) = delete;
+    LsmTable& operator=(const LsmTable&) = delete;
+    
+    const char* engine_name() const override { return "lsm"; }
+    
+    // A blind write: whether the key is new is only worked out when the
+    // memtable is flushed.
+    void insert(const K& key, const V& value) override {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        memtable.insert_or_assign(key, value);
+    }
+    
+    void insert_batch(std::vector<std::pair<K, V>> items) override {
+        for (const auto& item : items) insert(item.first, item.second);
+    }
+    
+    void bulk_load(std::vector<std::pair<K, V>> items) override {
+        std::map<K, V> contents;
+        for (auto& item : items) contents.insert_or_assign(std::move(item.first), std::move(item.second));
+        std::lock_guard<std::mutex> manifest_lock(manifest_mutex);
+        replace_contents(std::move(contents));
+    }
+    
+    bool visit(const K& key, const std::function<void(const V&)>& fn) const override {
+        std::shared_ptr<const Version> current;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            auto it = memtable.find(key);
+            if (it != memtable.end()) {
+                fn(it->second);
+                return true;
+            }
+            current = version;
+        }
+        std::string bytes;
+        if (!find_encoded(*current, key, bytes)) return false;
+        fn(decode(bytes));
+        return true;
+    }
+    
+    std::optional<V> try_get(const K& key) const override {
+        std::optional<V> found;
+        visit(key, [&](const V& value) { found = value; });
+        return found;
+    }
+    
+    bool exists(const K& key) const override {
+        std::shared_ptr<const Version> current;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            if (memtable.count(key)) return true;
+            current = version;
+        }
+        std::string ignored;
+        return find_encoded(*current, key, ignored);
+    }
+    
+    void for_each(const std::function<void(const K&, const V&)>& fn) const override {
+        std::map<K, V> recent;
+        std::shared_ptr<const Version> current;
+        {
+            std::shared_lock<std::shared_mutex> lock(mutex);
+            recent = memtable;
+            current = version;
+        }
+        
+        auto it = recent.begin();
+        std::vector<Cursor> inputs = cursors(*current);
+        merge(inputs, [&](const K& key, const std::string& value) {
+            for (; it != recent.end() && it->first < key; ++it) fn(it->first, it->second);
+            if (it != recent.end() && !(key < it->first)) {
+                fn(it->first, it->second);
+                ++it;
+            } else {
+                fn(key, decode(value));
+            }
+        });
+        for (; it != recent.end(); ++it) fn(it->first, it->second);
+    }
+    
+    size_t get_size() const override {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return table_keys + fresh_keys(*version);
+    }
+    
+    void clear() override {
+        bulk_load({});
+    }
+    
+    // Turns the memtable into a level-0 table and records the new table set.
+    void snapshot(size_t) override {
+        {
+            std::lock_guard<std::mutex> manifest_lock(manifest_mutex);
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            if (!memtable.empty()) {
+                table_keys += fresh_keys(*version);
+                typename Table::Builder builder;
+                for (const auto& item : memtable) builder.add(item.first, encode(item.second));
+                TablePtr table = write_table(next_file++, builder.finish());
+                
+                auto next = std::make_shared<Version>(*version);
+                next->levels[0].insert(next->levels[0].begin(), table);
+                version = next;
+                memtable.clear();
+                images.push_back({manifests_queued + 1, table});
+            }
+            write_manifest(*version);
+            if (!retired_files.empty() && retired_after == 0) retired_after = manifests_queued;
+            snapshot_needed = false;
+        }
+        
+        std::lock_guard<std::mutex> lock(work_mutex);
+        work_pending = true;
+        work_cv.notify_one();
+    }
+    
+    // Runs compactions until every level is within its limits.
+    void compact() {
+        std::lock_guard<std::mutex> lock(compaction_mutex);
+        while (compact_once()) {}
+    }
+    
+    void load(unsigned workers) override {
+        std::lock_guard<std::mutex> manifest_lock(manifest_mutex);
+        std::ifstream manifest(manifest_path(), std::ios::binary);
+        if (!manifest) {
+            // Switched from the B-tree engine: adopt its file.
+            std::string legacy = base + ".dat";
+            if (file_exists(legacy)) {
+                std::map<K, V> contents;
+                for (auto& item : read_table_file<K, V>(legacy, this->scoped_loader(), workers)) {
+                    contents.insert_or_assign(std::move(item.first), std::move(item.second));
+                }
+                replace_contents(std::move(contents));
+                retired_files = {legacy, table_index_path(legacy), table_filter_path(legacy)};
+                snapshot_needed = true;
+            }
+            return;
+        }
+        
+        uint64_t header[4];
+        manifest.read(reinterpret_cast<char*>(header), sizeof(header));
+        bool counted = header[0] == MANIFEST_MAGIC;
+        if (!manifest || (!counted && header[0] != MANIFEST_MAGIC_V1) || header[3] != MAX_LEVELS) {
+            std::cerr << "Warning: Ignoring damaged table manifest: " << manifest_path() << std::endl;
+            return;
+        }
+        
+        auto loaded = std::make_shared<Version>();
+        std::set<uint64_t> referenced;
+        for (auto& level : loaded->levels) {
+            uint64_t count = 0;
+            manifest.read(reinterpret_cast<char*>(&count), sizeof(count));
+            for (uint64_t i = 0; i < count && manifest; i++) {
+                uint64_t number = 0;
+                manifest.read(reinterpret_cast<char*>(&number), sizeof(number));
+                TablePtr table = Table::open(table_path(number), number, cache);
+                if (!table) {
+                    std::cerr << "Warning: Missing table file: " << table_path(number) << std::endl;
+                    continue;
+                }
+                referenced.insert(number);
+                level.push_back(table);
+            }
+        }
+        
+        // Older manifests counted memtable records no table held, which the
+        // WAL replays again; count those tables' keys once instead.
+        size_t keys = static_cast<size_t>(header[2]);
+        if (!counted) {
+            std::vector<Cursor> inputs = cursors(*loaded);
+            keys = 0;
+            merge(inputs, [&](const K&, const std::string&) { keys++; });
+        }
+        
+        {
+            std::unique_lock<std::shared_mutex> lock(mutex);
+            next_file = header[1];
+            table_keys = keys;
+            version = loaded;
+            memtable.clear();
+        }
+        
+        // Left behind by compactions that never made it into a manifest.
+        for (uint64_t number = 1; number < header[1]; number++) {
+            if (!referenced.count(number) && file_exists(table_path(number))) {
+                std::remove(table_path(number).c_str());
+            }
+        }
+        
+        // Files written under other symbol ids are rewritten in this
+        // process's ids by the next snapshot.
+        SymbolLoadScope* scope = SymbolLoadScope::current();
+        if (scope && !scope->identity()) {
+            std::map<K, V> contents;
+            for_each([&](const K& key, const V& value) { contents.emplace(key, value); });
+            replace_contents(std::move(contents));
+            snapshot_needed = true;
+        }
+    }
+    
+    bool needs_snapshot() const override {
+        std::lock_guard<std::mutex> lock(manifest_mutex);
+        return snapshot_needed;
+    }
+    
+    uint64_t durability_mark() const override {
+        std::lock_guard<std::mutex> lock(manifest_mutex);
+        return manifests_queued;
+    }
+    
+    void on_durable(uint64_t mark) override {
+        std::lock_guard<std::mutex> lock(manifest_mutex);
+        auto settle = [mark](std::vector<Pending>& pending, bool remove) {
+            pending.erase(std::remove_if(pending.begin(), pending.end(), [&](const Pending& p) {
+                if (p.mark > mark) return false;
+                if (remove) {
+                    p.table->remove_when_unused();
+                } else {
+                    p.table->release_image();
+                }
+                return true;
+            }), pending.end());
+        };
+        settle(images, false);
+        settle(obsolete, true);
+        if (retired_after != 0 && retired_after <= mark) {
+            for (const auto& file : retired_files) std::remove(file.c_str());
+            retired_files.clear();
+            retired_after = 0;
+        }
+    }
+    
+    std::vector<std::string> files() const override {
+        std::vector<std::string> paths = {manifest_path()};
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        for (uint64_t number = 1; number < next_file; number++) paths.push_back(table_path(number));
+        return paths;
+    }
+    
+    // Tables per level, for tests and benchmarks.
+    std::vector<size_t> level_sizes() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        std::vector<size_t> sizes;
+        for (const auto& level : version->levels) sizes.push_back(level.size());
+        return sizes;
+    }
+};
+
+// A B-tree table (CompleteBTree or ConcurrentBLinkTree): the whole table
+// in memory, written to "<base>.dat" (+ .idx, .bloom) at every snapshot.
+template<typename K, typename V, typename Tree, typename Serializer = RecordSerializer<V>>
+class TreeTable : public TableEngine<K, V, Serializer> {
+private:
+    Tree tree;
+    std::string base;
+    std::string path;
+    PersistenceBackend& backend;
+    
+    mutable std::mutex retire_mutex;
+    uint64_t snapshots_queued = 0;
+    std::vector<std::string> retired_files;  // imported from the LSM engine
+    uint64_t retired_after = 0;
+    bool snapshot_needed = false;
+    
+public:
+    TreeTable(const std::string& base_path, PersistenceBackend& persistence)
+        : base(base_path), path(base_path + ".dat"), backend(persistence) {}
     
-    static void save_exercise_pair(std::ofstream& os, const std::string& key, const Exercise& value) {
-        write_string(os, key);
-        value.serialize(os);
+    const char* engine_name() const override { return "btree"; }
+    
+    void insert(const K& key, const V& value) override { tree.insert(key, value); }
+    void insert_batch(std::vector<std::pair<K, V>> items) override { tree.insert_batch(std::move(items)); }
+    void bulk_load(std::vector<std::pair<K, V>> items) override { tree.bulk_load(std::move(items)); }
+    
+    bool visit(const K& key, const std::function<void(const V&)>& fn) const override {
+        return tree.visit(key, fn);
     }
     
-    static void load_exercise_pair(std::ifstream& is, std::string& key, Exercise& value) {
-        read_string(is, key);
-        value.deserialize(is);
+    std::optional<V> try_get(const K& key) const override { return tree.try_get(key); }
+    bool exists(const K& key) const override { return tree.exists(key); }
+    
+    void for_each(const std::function<void(const K&, const V&)>& fn) const override {
+        tree.for_each(fn);
     }
     
-    static void save_user_pair(std::ofstream& os, const std::string& key, const User& value) {
-        write_string(os, key);
-        value.serialize(os);
+    size_t get_size() const override { return tree.get_size(); }
+    void clear() override { tree.clear(); }
+    void maintain() override { tree.maintain_filter(); }
+    
+    void snapshot(size_t index_stride) override {
+        std::string data, index, bloom;
+        tree.serialize_to(data, index, Serializer::save, index_stride, &bloom);
+        backend.replace_file(path, std::move(data));
+        if (!index.empty()) {
+            backend.replace_file(table_index_path(path), std::move(index));
+        }
+        backend.replace_file(table_filter_path(path), std::move(bloom));
+        
+        std::lock_guard<std::mutex> lock(retire_mutex);
+        snapshots_queued++;
+        if (!retired_files.empty() && retired_after == 0) retired_after = snapshots_queued;
+        snapshot_needed = false;
     }
     
-    static void load_user_pair(std::ifstream& is, std::string& key, User& value) {
-        read_string(is, key);
-        value.deserialize(is);
+    void load(unsigned workers) override {
+        if (!file_exists(path) && file_exists(base + ".lsm")) {
+            // Switched from the LSM engine: adopt its tables.
+            LsmOptions read_only;
+            read_only.background_compaction = false;
+            LsmTable<K, V, Serializer> previous(base, backend, read_only);
+            previous.load(workers);
+            std::vector<std::pair<K, V>> items;
+            previous.for_each([&](const K& key, const V& value) { items.emplace_back(key, value); });
+            tree.bulk_load(std::move(items));
+            
+            std::lock_guard<std::mutex> lock(retire_mutex);
+            retired_files = previous.files();
+            snapshot_needed = true;
+            return;
+        }
+        tree.load_from_file(path, this->scoped_loader(), workers);
     }
     
-    static void save_workout_pair(std::ofstream& os, const std::string& key, const WorkoutSession& value) {
-        write_string(os, key);
-        value.serialize(os);
+    bool needs_snapshot() const override {
+        std::lock_guard<std::mutex> lock(retire_mutex);
+        return snapshot_needed;
     }
     
-    static void load_workout_pair(std::ifstream& is, std::string& key, WorkoutSession& value) {
-        read_string(is, key);
-        value.deserialize(is);
+    uint64_t durability_mark() const override {
+        std::lock_guard<std::mutex> lock(retire_mutex);
+        return snapshots_queued;
     }
     
-    static void save_quest_pair(std::ofstream& os, const std::string& key, const Quest& value) {
-        write_string(os, key);
-        value.serialize(os);
+    void on_durable(uint64_t mark) override {
+        std::lock_guard<std::mutex> lock(retire_mutex);
+        if (retired_after != 0 && retired_after <= mark) {
+            for (const auto& file : retired_files) std::remove(file.c_str());
+            retired_files.clear();
+            retired_after = 0;
+        }
     }
     
-    static void load_quest_pair(std::ifstream& is, std::string& key, Quest& value) {
-        read_string(is, key);
-        value.deserialize(is);
+    std::vector<std::string> files() const override {
+        return {path, table_index_path(path), table_filter_path(path)};
+    }
+};
+
+// engine: "btree" (Tree) or "lsm".
+template<typename V, typename Tree>
+std::unique_ptr<TableEngine<std::string, V>> make_table_engine(const std::string& engine, const std::string& base,
+                                                               PersistenceBackend& backend,
+                                                               const LsmOptions& lsm = LsmOptions()) {
+    if (engine == "lsm") {
+        return std::make_unique<LsmTable<std::string, V>>(base, backend, lsm);
+    }
+    if (engine != "btree") {
+        throw std::runtime_error("Unknown table engine: " + engine);
     }
+    return std::make_unique<TreeTable<std::string, V, Tree>>(base, backend);
+}
+
+// ============================================================
+// 4. PERSISTENT FITNESS DATABASE
+// ============================================================
+
+struct DatabaseOptions {
+    // Load and save the table files concurrently instead of one by one.
+    bool parallel_persistence = true;
+    // Threads used for parallel persistence; 0 = one per core.
+    unsigned io_threads = 0;
+    // Records per chunk when a large table is parsed in parallel.
+    size_t load_chunk_records = 4096;
+    // "auto" (io_uring, falling back to a pwrite thread), "io_uring" or "pwrite".
+    std::string io_backend = "auto";
+    // Commits logged to the WAL before the tables are snapshotted again.
+    size_t checkpoint_interval = 256;
+    // Workouts that started longer ago than this move from memory into
+    // immutable segment files at checkpoint; 0 keeps every workout in memory.
+    time_t workout_hot_seconds = 30 * 24 * 3600;
+    // Aged workouts gathered before a segment is written.
+    size_t segment_records = 4096;
+    // Bytes of segment blocks kept in memory.
+    size_t segment_cache_bytes = 4 * 1024 * 1024;
+    // Storage engine per table ("exercises", "users", "workouts", "quests"):
+    // "btree" or "lsm". Unlisted tables use "btree".
+    std::map<std::string, std::string> table_engines;
+    // Tuning for tables on the LSM engine.
+    LsmOptions lsm;
+};
+
+class PersistentFitnessDatabase {
+private:
+    // Created by create_tables(); each table's engine comes from the options.
+    std::unique_ptr<TableEngine<std::string, Exercise>> exercise_table;
+    std::unique_ptr<TableEngine<std::string, CompactUser>> user_table;
+    std::unique_ptr<TableEngine<std::string, WorkoutSession>> workout_table;
+    std::unique_ptr<TableEngine<std::string, Quest>> quest_table;
+    
+    // Recent workouts live in workout_table; older ones in the segments,
+    // oldest first. A copy in memory or in a newer segment shadows older ones.
+    std::vector<std::unique_ptr<WorkoutSegment>> segments;
+    BlockCache segment_cache;
+    // (user_id, workout id) for workout_table; may hold stale pairs, so
+    // readers re-check user_id.
+    std::set<std::pair<std::string, std::string>> hot_user_workouts;
     
     struct HashTableEntry {
         std::string key;
         std::string value;
         
-        void serialize(std::ofstream& os) const {
+        void serialize(std::ostream& os) const {
             write_string(os, key);
             write_string(os, value);
         }
         
-        void deserialize(std::ifstream& is) {
+        void deserialize(std::istream& is) {
             read_string(is, key);
             read_string(is, value);
         }
     };
     
     std::vector<HashTableEntry> email_index;
+    BlockedBloomFilter<std::string> email_filter;  // rebuilt from email_index on load and once outgrown
+    
+    // Index into email_index, or npos. Unknown emails skip the scan.
+    size_t find_email(const std::string& email) const {
+        if (!email_filter.may_contain(email)) return std::string::npos;
+        for (size_t i = 0; i < email_index.size(); i++) {
+            if (email_index[i].key == email) return i;
+        }
+        return std::string::npos;
+    }
+    
+    void rebuild_email_filter() {
+        email_filter.reset(email_index.size() * 2);
+        for (const auto& entry : email_index) email_filter.add(entry.key);
+    }
     
     struct GraphEdge {
         std::string from;
         std::string to;
         int weight;
         
-        void serialize(std::ofstream& os) const {
+        void serialize(std::ostream& os) const {
             write_string(os, from);
             write_string(os, to);
             os.write(reinterpret_cast<const char*>(&weight), sizeof(weight));
         }
         
-        void deserialize(std::ifstream& is) {
+        void deserialize(std::istream& is) {
             read_string(is, from);
             read_string(is, to);
             is.read(reinterpret_cast<char*>(&weight), sizeof(weight));
@@ -652,13 +3930,13 @@ private:
         int priority;
         time_t timestamp;
         
-        void serialize(std::ofstream& os) const {
+        void serialize(std::ostream& os) const {
             quest.serialize(os);
             os.write(reinterpret_cast<const char*>(&priority), sizeof(priority));
             os.write(reinterpret_cast<const char*>(&timestamp), sizeof(timestamp));
         }
         
-        void deserialize(std::ifstream& is) {
+        void deserialize(std::istream& is) {
             quest.deserialize(is);
             is.read(reinterpret_cast<char*>(&priority), sizeof(priority));
             is.read(reinterpret_cast<char*>(&timestamp), sizeof(timestamp));
@@ -666,7 +3944,187 @@ private:
     };
     
     std::vector<PriorityQueueEntry> pq_entries;
+    
+public:
+    // Mutations collected by a unit of work. commit() applies the whole
+    // batch at once and logs it as a single WAL record.
+    class WriteBatch {
+    public:
+        enum class OpType : uint8_t {
+            PUT_USER = 1, PUT_EXERCISE, PUT_WORKOUT, PUT_QUEST,
+            ADD_EMAIL_INDEX, ADD_GRAPH_EDGE, PUSH_QUEST, POP_QUEST
+        };
+        
+    private:
+        friend class PersistentFitnessDatabase;
+        
+        struct Op {
+            OpType type;
+            size_t index;
+        };
+        
+        std::vector<Op> ops;
+        std::vector<User> users;
+        std::vector<Exercise> exercises;
+        std::vector<WorkoutSession> workouts;
+        std::vector<Quest> quests;
+        std::vector<HashTableEntry> email_entries;
+        std::vector<GraphEdge> edges;
+        std::vector<PriorityQueueEntry> queued_quests;
+        
+        template <typename T>
+        void add(OpType type, std::vector<T>& values, const T& value) {
+            ops.push_back({type, values.size()});
+            values.push_back(value);
+        }
+        
+        // Latest pending value for `id`, so a transaction reads its own writes.
+        template <typename T>
+        const T* find_pending(OpType type, const std::vector<T>& values, const std::string& id) const {
+            for (auto it = ops.rbegin(); it != ops.rend(); ++it) {
+                if (it->type == type && values[it->index].id == id) {
+                    return &values[it->index];
+                }
+            }
+            return nullptr;
+        }
+        
+    public:
+        void put_user(const User& user) { add(OpType::PUT_USER, users, user); }
+        void put_exercise(const Exercise& exercise) { add(OpType::PUT_EXERCISE, exercises, exercise); }
+        void put_workout(const WorkoutSession& workout) { add(OpType::PUT_WORKOUT, workouts, workout); }
+        void put_quest(const Quest& quest) { add(OpType::PUT_QUEST, quests, quest); }
+        
+        void add_email_index(const std::string& email, const std::string& user_id) {
+            add(OpType::ADD_EMAIL_INDEX, email_entries, HashTableEntry{email, user_id});
+        }
+        
+        void add_graph_edge(const std::string& from, const std::string& to, int weight) {
+            add(OpType::ADD_GRAPH_EDGE, edges, GraphEdge{from, to, weight});
+        }
+        
+        void push_quest(const Quest& quest) {
+            add(OpType::PUSH_QUEST, queued_quests, PriorityQueueEntry{quest, quest.priority, time(nullptr)});
+        }
+        
+        void pop_quest() { ops.push_back({OpType::POP_QUEST, 0}); }
+        
+        // A finished workout plus the owner's XP/level change: one put per table.
+        // new_level <= 0 leaves the level unchanged.
+        void record_workout(User user, const WorkoutSession& session, int experience_delta, int new_level) {
+            user.experience_points += experience_delta;
+            if (new_level > 0) {
+                user.fitness_level = new_level;
+            }
+            put_workout(session);
+            put_user(user);
+        }
+        
+        const User* find_user(const std::string& id) const { return find_pending(OpType::PUT_USER, users, id); }
+        const WorkoutSession* find_workout(const std::string& id) const { return find_pending(OpType::PUT_WORKOUT, workouts, id); }
+        const Quest* find_quest(const std::string& id) const { return find_pending(OpType::PUT_QUEST, quests, id); }
+        
+        bool empty() const { return ops.empty(); }
+        size_t size() const { return ops.size(); }
+        
+        void serialize(std::ostream& os) const {
+            size_t count = ops.size();
+            os.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            for (const auto& op : ops) {
+                os.write(reinterpret_cast<const char*>(&op.type), sizeof(op.type));
+                switch (op.type) {
+                    case OpType::PUT_USER: users[op.index].serialize(os); break;
+                    case OpType::PUT_EXERCISE: exercises[op.index].serialize(os); break;
+                    case OpType::PUT_WORKOUT: workouts[op.index].serialize(os); break;
+                    case OpType::PUT_QUEST: quests[op.index].serialize(os); break;
+                    case OpType::ADD_EMAIL_INDEX: email_entries[op.index].serialize(os); break;
+                    case OpType::ADD_GRAPH_EDGE: edges[op.index].serialize(os); break;
+                    case OpType::PUSH_QUEST: queued_quests[op.index].serialize(os); break;
+                    case OpType::POP_QUEST: break;
+                }
+            }
+        }
+        
+        bool deserialize(std::istream& is) {
+            size_t count = 0;
+            is.read(reinterpret_cast<char*>(&count), sizeof(count));
+            if (!is || count > 1000000) return false; // Sanity check
+            
+            for (size_t i = 0; i < count; i++) {
+                OpType type;
+                is.read(reinterpret_cast<char*>(&type), sizeof(type));
+                switch (type) {
+                    case OpType::PUT_USER: { User v; v.deserialize(is); put_user(v); break; }
+                    case OpType::PUT_EXERCISE: { Exercise v; v.deserialize(is); put_exercise(v); break; }
+                    case OpType::PUT_WORKOUT: { WorkoutSession v; v.deserialize(is); put_workout(v); break; }
+                    case OpType::PUT_QUEST: { Quest v; v.deserialize(is); put_quest(v); break; }
+                    case OpType::ADD_EMAIL_INDEX: { HashTableEntry v; v.deserialize(is); add(type, email_entries, v); break; }
+                    case OpType::ADD_GRAPH_EDGE: { GraphEdge v; v.deserialize(is); add(type, edges, v); break; }
+                    case OpType::PUSH_QUEST: { PriorityQueueEntry v; v.deserialize(is); add(type, queued_quests, v); break; }
+                    case OpType::POP_QUEST: pop_quest(); break;
+                    default: return false;
+                }
+                if (!is) return false;
+            }
+            return true;
+        }
+    };
+    
+private:
     std::string data_dir;
+    DatabaseOptions options;
+    std::unique_ptr<PersistenceBackend> backend;
+    
+    // Guards the WAL position so concurrent user updates get distinct LSNs.
+    std::mutex wal_mutex;
+    uint64_t last_lsn = 0;        // sequence number of the newest WAL record
+    uint64_t last_wal_ticket = 0; // backend ticket of that record's append
+    uint64_t checkpoint_lsn = 0;  // newest record already covered by the snapshots
+    size_t commits_since_checkpoint = 0;
+    
+    // The append-only files (email index, graph, quest queue) are not keyed,
+    // so replaying a record they already hold would apply it twice. Each one
+    // starts with the newest LSN it contains, and replay skips its ops up to
+    // there. A crash between the checkpoint's renames can leave the files
+    // ahead of checkpoint.dat, which only the table snapshots go by.
+    static constexpr uint64_t LSN_STAMP = 0x314e534c54535146ULL;  // "FQSTLSN1"
+    static constexpr uint64_t UNSTAMPED = UINT64_MAX;
+    struct SnapshotLsns {
+        uint64_t tables = 0;
+        uint64_t email_index = UNSTAMPED;
+        uint64_t graph = UNSTAMPED;
+        uint64_t queue = UNSTAMPED;
+        
+        // Newest LSN already applied to the data an op of `type` changes.
+        uint64_t covering(WriteBatch::OpType type) const {
+            switch (type) {
+                case WriteBatch::OpType::ADD_EMAIL_INDEX: return email_index;
+                case WriteBatch::OpType::ADD_GRAPH_EDGE: return graph;
+                case WriteBatch::OpType::PUSH_QUEST:
+                case WriteBatch::OpType::POP_QUEST: return queue;
+                default: return tables;
+            }
+        }
+    };
+    SnapshotLsns loaded_lsns;   // read at startup, for replay
+    
+    // Orders concurrent updates of one user so the tree and the WAL agree.
+    static constexpr size_t USER_LOCK_STRIPES = 64;
+    std::mutex user_locks[USER_LOCK_STRIPES];
+    
+    // Users changed in memory whose new state is not yet in the WAL.
+    std::set<std::string> deferred_users;
+    
+    // Symbols whose names are already on disk, in symbols.dat or a WAL
+    // record; later WAL records carry the names of newer ones.
+    size_t logged_symbols = 0;
+    // The files were written with other symbol ids (or none) and need a
+    // checkpoint in this process's ids.
+    bool rewrite_symbols = false;
+    
+    unsigned persistence_workers() const {
+        return options.parallel_persistence ? options.io_threads : 1;
+    }
     
     void ensure_data_dir() {
         if (!directory_exists(data_dir)) {
@@ -680,66 +4138,444 @@ private:
         return data_dir + "/" + filename;
     }
     
+    static uint32_t checksum(const std::string& data) {
+        uint32_t hash = 2166136261u; // FNV-1a
+        for (unsigned char c : data) {
+            hash = (hash ^ c) * 16777619u;
+        }
+        return hash;
+    }
+    
+    // WAL record: [lsn][payload size][checksum][payload]. The payload is the
+    // dictionary block for symbols [first_symbol, ...) followed by the batch.
+    static std::string encode_wal_record(uint64_t lsn, const WriteBatch& batch, size_t first_symbol) {
+        std::ostringstream payload(std::ios::binary);
+        payload.write(reinterpret_cast<const char*>(&first_symbol), sizeof(first_symbol));
+        InternTable::global().serialize(payload, first_symbol);
+        batch.serialize(payload);
+        std::string body = payload.str();
+        
+        uint64_t size = body.size();
+        uint32_t sum = checksum(body);
+        std::string record;
+        record.reserve(sizeof(lsn) + sizeof(size) + sizeof(sum) + body.size());
+        record.append(reinterpret_cast<const char*>(&lsn), sizeof(lsn));
+        record.append(reinterpret_cast<const char*>(&size), sizeof(size));
+        record.append(reinterpret_cast<const char*>(&sum), sizeof(sum));
+        record.append(body);
+        return record;
+    }
+    
+    // During replay `covered` holds what the snapshots already contain, and
+    // ops of record `lsn` that a snapshot has are skipped.
+    void apply(const WriteBatch& batch, const SnapshotLsns* covered = nullptr, uint64_t lsn = 0) {
+        using OpType = WriteBatch::OpType;
+        for (const auto& op : batch.ops) {
+            if (covered && lsn <= covered->covering(op.type)) continue;
+            switch (op.type) {
+                case OpType::PUT_USER: {
+                    const User& user = batch.users[op.index];
+                    user_table->insert(user.id, CompactUser::pack(user));
+                    break;
+                }
+                case OpType::PUT_EXERCISE: {
+                    const Exercise& exercise = batch.exercises[op.index];
+                    exercise_table->insert(exercise.id, exercise);
+                    break;
+                }
+                case OpType::PUT_WORKOUT: {
+                    const WorkoutSession& workout = batch.workouts[op.index];
+                    workout_table->insert(workout.id, workout);
+                    hot_user_workouts.emplace(workout.user_id, workout.id);
+                    break;
+                }
+                case OpType::PUT_QUEST: {
+                    const Quest& quest = batch.quests[op.index];
+                    quest_table->insert(quest.id, quest);
+                    break;
+                }
+                case OpType::ADD_EMAIL_INDEX:
+                    email_index.push_back(batch.email_entries[op.index]);
+                    email_filter.add(email_index.back().key);
+                    break;
+                case OpType::ADD_GRAPH_EDGE:
+                    graph_edges.push_back(batch.edges[op.index]);
+                    break;
+                case OpType::PUSH_QUEST:
+                    pq_entries.push_back(batch.queued_quests[op.index]);
+                    std::sort(pq_entries.begin(), pq_entries.end(), 
+                             [](const PriorityQueueEntry& a, const PriorityQueueEntry& b) {
+                                 return a.priority > b.priority;
+                             });
+                    break;
+                case OpType::POP_QUEST:
+                    if (!pq_entries.empty()) pq_entries.pop_back();
+                    break;
+            }
+        }
+    }
+    
+    // Re-applies WAL records newer than the last checkpoint. Stops at the
+    // first torn or corrupt record, which can only be the tail of the log.
+    void replay_wal(SymbolLoadScope& symbols) {
+        std::ifstream checkpoint_file(get_file_path("checkpoint.dat"), std::ios::binary);
+        if (checkpoint_file) {
+            checkpoint_file.read(reinterpret_cast<char*>(&checkpoint_lsn), sizeof(checkpoint_lsn));
+            if (!checkpoint_file) checkpoint_lsn = 0;
+        }
+        
+        // Files written before the stamp existed go by checkpoint.dat.
+        SnapshotLsns& covered = loaded_lsns;
+        covered.tables = checkpoint_lsn;
+        uint64_t replay_from = checkpoint_lsn;
+        for (uint64_t* file_lsn : {&covered.email_index, &covered.graph, &covered.queue}) {
+            if (*file_lsn == UNSTAMPED) *file_lsn = checkpoint_lsn;
+            replay_from = std::min(replay_from, *file_lsn);
+        }
+        last_lsn = std::max({checkpoint_lsn, covered.email_index, covered.graph, covered.queue});
+        
+        std::ifstream wal(get_file_path("wal.log"), std::ios::binary);
+        if (!wal) return;
+        
+        for (;;) {
+            uint64_t lsn = 0, size = 0;
+            uint32_t sum = 0;
+            wal.read(reinterpret_cast<char*>(&lsn), sizeof(lsn));
+            wal.read(reinterpret_cast<char*>(&size), sizeof(size));
+            wal.read(reinterpret_cast<char*>(&sum), sizeof(sum));
+            if (!wal || size > (64u << 20)) break;
+            
+            std::string body(size, '\0');
+            wal.read(&body[0], static_cast<std::streamsize>(size));
+            if (!wal || checksum(body) != sum) break;
+            
+            if (lsn <= replay_from) continue;
+            
+            std::istringstream payload(body, std::ios::binary);
+            if (!symbols.is_legacy()) {
+                size_t first_symbol = 0;
+                payload.read(reinterpret_cast<char*>(&first_symbol), sizeof(first_symbol));
+                if (!payload || !symbols.read_dictionary(payload, first_symbol)) break;
+            }
+            WriteBatch batch;
+            if (!batch.deserialize(payload)) break;
+            apply(batch, &covered, lsn);
+            last_lsn = std::max(last_lsn, lsn);
+            commits_since_checkpoint++;
+        }
+    }
+    
+    // Appends the batch to the WAL. True once a checkpoint is due.
+    bool append_wal(const WriteBatch& batch) {
+        std::lock_guard<std::mutex> lock(wal_mutex);
+        size_t symbols = InternTable::global().size();
+        last_wal_ticket = backend->append(get_file_path("wal.log"), encode_wal_record(++last_lsn, batch, logged_symbols));
+        logged_symbols = symbols;
+        return ++commits_since_checkpoint >= options.checkpoint_interval;
+    }
+    
+    void create_tables() {
+        auto engine = [this](const std::string& table) {
+            auto it = options.table_engines.find(table);
+            return it == options.table_engines.end() ? std::string("btree") : it->second;
+        };
+        exercise_table = make_table_engine<Exercise, CompleteBTree<std::string, Exercise>>(
+            engine("exercises"), get_file_path("exercises"), *backend, options.lsm);
+        user_table = make_table_engine<CompactUser, ConcurrentBLinkTree<std::string, CompactUser>>(
+            engine("users"), get_file_path("users"), *backend, options.lsm);
+        workout_table = make_table_engine<WorkoutSession, CompleteBTree<std::string, WorkoutSession, SlabStorage<WorkoutSession>>>(
+            engine("workouts"), get_file_path("workouts"), *backend, options.lsm);
+        quest_table = make_table_engine<Quest, CompleteBTree<std::string, Quest>>(
+            engine("quests"), get_file_path("quests"), *backend, options.lsm);
+    }
+    
+    std::vector<TableStorage*> tables() const {
+        return {exercise_table.get(), user_table.get(), workout_table.get(), quest_table.get()};
+    }
+    
+    void collect_recent_workouts(const std::string& user_id, std::vector<WorkoutSession>& workouts,
+                                 std::set<std::string>& seen) const {
+        for (auto it = hot_user_workouts.lower_bound({user_id, std::string()});
+             it != hot_user_workouts.end() && it->first == user_id; ++it) {
+            auto session = workout_table->try_get(it->second);
+            if (session && session->user_id == user_id && seen.insert(session->id).second) {
+                workouts.push_back(std::move(*session));
+            }
+        }
+    }
+    
+    static void sort_newest_first(std::vector<WorkoutSession>& workouts) {
+        std::sort(workouts.begin(), workouts.end(), [](const WorkoutSession& a, const WorkoutSession& b) {
+            return a.start_time != b.start_time ? a.start_time > b.start_time : a.id > b.id;
+        });
+    }
+    
+    std::string segment_path(uint32_t sequence) const {
+        return get_file_path("workouts.seg." + std::to_string(sequence));
+    }
+    
+    // Segments are numbered from 1 without gaps; a file is only opened once
+    // complete, so the first missing number ends the list. One that exists
+    // but cannot be read fails the load.
+    void load_segments() {
+        segments.clear();
+        for (uint32_t sequence = 1; file_exists(segment_path(sequence)); sequence++) {
+            auto segment = WorkoutSegment::open(segment_path(sequence), sequence, segment_cache);
+            if (!segment) {
+                // Its workouts are no longer in workouts.dat, so going on
+                // without it would lose them for good.
+                throw std::runtime_error("Damaged workout segment: " + segment_path(sequence) +
+                                         " (restore it from a backup to start the database)");
+            }
+            segments.push_back(std::move(segment));
+        }
+    }
+    
+    // Moves workouts older than workout_hot_seconds into a new segment once
+    // segment_records of them have aged. The segment reaches the disk before
+    // the workouts.dat without them is queued; until then both hold them.
+    void demote_aged_workouts() {
+        if (options.workout_hot_seconds <= 0) return;
+        time_t cutoff = time(nullptr) - options.workout_hot_seconds;
+        
+        size_t aged_count = 0;
+        workout_table->for_each([&](const std::string&, const WorkoutSession& session) {
+            if (session.start_time < cutoff) aged_count++;
+        });
+        if (aged_count == 0 || aged_count < options.segment_records) return;
+        
+        std::vector<WorkoutSession> aged;
+        std::vector<std::pair<std::string, WorkoutSession>> recent;
+        aged.reserve(aged_count);
+        recent.reserve(workout_table->get_size() - aged_count);
+        workout_table->for_each([&](const std::string& id, const WorkoutSession& session) {
+            if (session.start_time < cutoff) {
+                aged.push_back(session);
+            } else {
+                recent.emplace_back(id, session);
+            }
+        });
+        
+        uint32_t sequence = segments.empty() ? 1 : segments.back()->sequence_number() + 1;
+        std::string path = segment_path(sequence);
+        backend->replace_file(path, WorkoutSegment::build(std::move(aged)));
+        backend->flush();
+        auto segment = WorkoutSegment::open(path, sequence, segment_cache);
+        if (!segment) {
+            std::cerr << "Warning: Failed to write workout segment: " << path << std::endl;
+            std::remove(path.c_str());
+            return;
+        }
+        segments.push_back(std::move(segment));
+        
+        hot_user_workouts.clear();
+        for (const auto& item : recent) {
+            hot_user_workouts.emplace(item.second.user_id, item.first);
+        }
+        workout_table->bulk_load(std::move(recent));
+    }
+    
+    // Entry count of a file from serialize_entries; sets `lsn` when the file
+    // carries one.
+    static size_t read_entries_header(std::istream& is, uint64_t& lsn) {
+        uint64_t first = 0;
+        is.read(reinterpret_cast<char*>(&first), sizeof(first));
+        if (first != LSN_STAMP) return static_cast<size_t>(first);  // unstamped: this is the count
+        size_t count = 0;
+        is.read(reinterpret_cast<char*>(&lsn), sizeof(lsn));
+        is.read(reinterpret_cast<char*>(&count), sizeof(count));
+        return is ? count : 0;
+    }
+    
+    // An append-only file holding `entries` as of WAL record `lsn`.
+    template <typename T>
+    static std::string serialize_entries(const std::vector<T>& entries, uint64_t lsn) {
+        std::ostringstream os(std::ios::binary);
+        os.write(reinterpret_cast<const char*>(&LSN_STAMP), sizeof(LSN_STAMP));
+        os.write(reinterpret_cast<const char*>(&lsn), sizeof(lsn));
+        size_t count = entries.size();
+        os.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        for (const auto& entry : entries) {
+            entry.serialize(os);
+        }
+        return os.str();
+    }
+    
 public:
-    PersistentFitnessDatabase(const std::string& directory = "./fitness_data") 
-        : data_dir(directory) {
+    PersistentFitnessDatabase(const std::string& directory = "./fitness_data",
+                              const DatabaseOptions& opts = DatabaseOptions()) 
+        : segment_cache(opts.segment_cache_bytes), data_dir(directory), options(opts),
+          backend(make_persistence_backend(opts.io_backend)) {
         
         ensure_data_dir();
+        create_tables();
         load_all_data();
         
-        if (user_btree.get_size() == 0) {
+        bool imported = false;
+        for (const TableStorage* table : tables()) imported = imported || table->needs_snapshot();
+        if (user_table->get_size() == 0) {
             initialize_sample_data();
+        } else if (file_size(get_file_path("wal.log")) > 0 || rewrite_symbols || imported) {
+            // Fold the replayed log (and any torn tail) into fresh snapshots,
+            // written with this process's symbol ids and table engines.
+            checkpoint();
         }
     }
     
     ~PersistentFitnessDatabase() {
+        try {
+            checkpoint();
+            flush();
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: Final checkpoint failed: " << e.what() << std::endl;
+        }
+        // Compaction threads use the backend, so the tables go first.
+        exercise_table.reset();
+        user_table.reset();
+        workout_table.reset();
+        quest_table.reset();
+    }
+    
+    // Applies the batch to the in-memory tables and appends it to the WAL as
+    // one record. The record is queued, not awaited: the caller passes
+    // log_ticket() to wait_durable() before acknowledging the write, ideally
+    // after dropping its own locks so concurrent commits share one fsync.
+    void commit(const WriteBatch& batch) {
+        if (batch.empty()) return;
+        
+        apply(batch);
+        if (append_wal(batch)) {
+            checkpoint();
+        }
+    }
+    
+    // Ticket of the newest WAL record, covering every commit made so far.
+    uint64_t log_ticket() {
+        std::lock_guard<std::mutex> lock(wal_mutex);
+        return last_wal_ticket;
+    }
+    
+    // Blocks until the WAL record behind `ticket` has reached the disk.
+    void wait_durable(uint64_t ticket) {
+        backend->wait(ticket);
+    }
+    
+    bool checkpoint_due() {
+        std::lock_guard<std::mutex> lock(wal_mutex);
+        return commits_since_checkpoint >= options.checkpoint_interval;
+    }
+    
+    // Snapshots every table, records which WAL records the snapshots cover
+    // and empties the log. The backend applies the three steps in order.
+    void checkpoint() {
+        deferred_users.clear();  // the snapshot carries their current state
+        for (TableStorage* table : tables()) table->maintain();
+        if (email_filter.overloaded()) rebuild_email_filter();
+        demote_aged_workouts();
         save_all_data();
+        backend->replace_file(get_file_path("checkpoint.dat"),
+                              std::string(reinterpret_cast<const char*>(&last_lsn), sizeof(last_lsn)));
+        backend->truncate(get_file_path("wal.log"));
+        checkpoint_lsn = last_lsn;
+        commits_since_checkpoint = 0;
     }
     
+    // Serializes every table in memory and queues the files on the
+    // persistence backend; the caller never waits for the disk.
     void save_all_data() {
+        size_t stride = options.load_chunk_records;
+        
+        // The dictionary goes first so no table file can reference a symbol
+        // the dictionary on disk does not name yet.
+        size_t symbols = InternTable::global().size();
+        std::ostringstream dictionary(std::ios::binary);
+        InternTable::global().serialize(dictionary);
+        backend->replace_file(get_file_path("symbols.dat"), dictionary.str());
+        uint64_t lsn;
+        {
+            std::lock_guard<std::mutex> lock(wal_mutex);
+            logged_symbols = std::max(logged_symbols, symbols);
+            lsn = last_lsn;
+        }
+        
+        // Each table queues its own files; the backend is thread-safe.
+        std::string data[3];
+        std::vector<std::function<void()>> tasks = {
+            [&] { exercise_table->snapshot(stride); },
+            [&] { user_table->snapshot(stride); },
+            [&] { workout_table->snapshot(stride); },
+            [&] { quest_table->snapshot(stride); },
+            [&] { data[0] = serialize_entries(email_index, lsn); },
+            [&] { data[1] = serialize_entries(graph_edges, lsn); },
+            [&] { data[2] = serialize_entries(pq_entries, lsn); }
+        };
+        
         try {
-            exercise_btree.save_to_file(get_file_path("exercises.dat"), save_exercise_pair);
-            user_btree.save_to_file(get_file_path("users.dat"), save_user_pair);
-            workout_btree.save_to_file(get_file_path("workouts.dat"), save_workout_pair);
-            quest_btree.save_to_file(get_file_path("quests.dat"), save_quest_pair);
-            
-            save_hash_table();
-            save_graph();
-            save_priority_queue();
-            
+            run_parallel(tasks, persistence_workers());
         } catch (const std::exception& e) {
             std::cerr << "Warning: Failed to save data: " << e.what() << std::endl;
+            return;
+        }
+        
+        const char* files[3] = {"email_index.dat", "graph.dat", "priority_queue.dat"};
+        for (int i = 0; i < 3; i++) {
+            backend->replace_file(get_file_path(files[i]), std::move(data[i]));
         }
     }
     
+    // Blocks until every queued write has reached the disk.
+    void flush() {
+        std::vector<uint64_t> marks;
+        for (const TableStorage* table : tables()) marks.push_back(table->durability_mark());
+        backend->flush();
+        for (size_t i = 0; i < marks.size(); i++) tables()[i]->on_durable(marks[i]);
+    }
+    
+    const char* persistence_backend_name() const {
+        return backend->name();
+    }
+    
     void load_all_data() {
+        // Table files from before the dictionary existed store names.
+        bool legacy = !file_exists(get_file_path("symbols.dat")) &&
+                      (file_exists(get_file_path("users.dat")) || file_size(get_file_path("wal.log")) > 0);
+        SymbolLoadScope symbols(legacy);
+        if (!legacy) {
+            std::ifstream dictionary(get_file_path("symbols.dat"), std::ios::binary);
+            if (dictionary) symbols.read_dictionary(dictionary, 0);
+        }
+        
+        // Large tables are also split into chunks; the chunk threads come on
+        // top of the per-table threads, which is fine for a startup burst.
+        unsigned workers = persistence_workers();
+        std::vector<std::function<void()>> tasks = {
+            [&] { SymbolLoadScope::Bind bind(&symbols); exercise_table->load(workers); },
+            [&] { SymbolLoadScope::Bind bind(&symbols); user_table->load(workers); },
+            [&] { SymbolLoadScope::Bind bind(&symbols); workout_table->load(workers); },
+            [&] { SymbolLoadScope::Bind bind(&symbols); quest_table->load(workers); },
+            [&] { SymbolLoadScope::Bind bind(&symbols); load_hash_table(); },
+            [&] { SymbolLoadScope::Bind bind(&symbols); load_graph(); },
+            [&] { SymbolLoadScope::Bind bind(&symbols); load_priority_queue(); }
+        };
+        
         try {
-            exercise_btree.load_from_file(get_file_path("exercises.dat"), load_exercise_pair);
-            user_btree.load_from_file(get_file_path("users.dat"), load_user_pair);
-            workout_btree.load_from_file(get_file_path("workouts.dat"), load_workout_pair);
-            quest_btree.load_from_file(get_file_path("quests.dat"), load_quest_pair);
-            
-            load_hash_table();
-            load_graph();
-            load_priority_queue();
-            
+            run_parallel(tasks, workers);
         } catch (const std::exception& e) {
             // Silent fail for first run
         }
+        
+        load_segments();
+        workout_table->for_each([&](const std::string& id, const WorkoutSession& session) {
+            hot_user_workouts.emplace(session.user_id, id);
+        });
+        
+        replay_wal(symbols);
+        rewrite_symbols = !symbols.identity();
+        logged_symbols = symbols.identity() ? symbols.size() : 0;
     }
     
     void save_hash_table() {
-        std::ofstream file(get_file_path("email_index.dat"), std::ios::binary);
-        if (!file) return;
-        
-        size_t count = email_index.size();
-        file.write(reinterpret_cast<const char*>(&count), sizeof(count));
-        
-        for (const auto& entry : email_index) {
-            entry.serialize(file);
-        }
-        
-        file.close();
+        backend->replace_file(get_file_path("email_index.dat"), serialize_entries(email_index, last_lsn));
     }
     
     void load_hash_table() {
@@ -748,31 +4584,21 @@ public:
         std::ifstream file(get_file_path("email_index.dat"), std::ios::binary);
         if (!file) return;
         
-        size_t count;
-        file.read(reinterpret_cast<char*>(&count), sizeof(count));
+        size_t count = read_entries_header(file, loaded_lsns.email_index);
         
         if (count < 100000) {
             email_index.resize(count);
             for (size_t i = 0; i < count; i++) {
                 email_index[i].deserialize(file);
             }
+            rebuild_email_filter();
         }
         
         file.close();
     }
     
     void save_graph() {
-        std::ofstream file(get_file_path("graph.dat"), std::ios::binary);
-        if (!file) return;
-        
-        size_t count = graph_edges.size();
-        file.write(reinterpret_cast<const char*>(&count), sizeof(count));
-        
-        for (const auto& edge : graph_edges) {
-            edge.serialize(file);
-        }
-        
-        file.close();
+        backend->replace_file(get_file_path("graph.dat"), serialize_entries(graph_edges, last_lsn));
     }
     
     void load_graph() {
@@ -781,8 +4607,7 @@ public:
         std::ifstream file(get_file_path("graph.dat"), std::ios::binary);
         if (!file) return;
         
-        size_t count;
-        file.read(reinterpret_cast<char*>(&count), sizeof(count));
+        size_t count = read_entries_header(file, loaded_lsns.graph);
         
         if (count < 100000) {
             graph_edges.resize(count);
@@ -795,17 +4620,7 @@ public:
     }
     
     void save_priority_queue() {
-        std::ofstream file(get_file_path("priority_queue.dat"), std::ios::binary);
-        if (!file) return;
-        
-        size_t count = pq_entries.size();
-        file.write(reinterpret_cast<const char*>(&count), sizeof(count));
-        
-        for (const auto& entry : pq_entries) {
-            entry.serialize(file);
-        }
-        
-        file.close();
+        backend->replace_file(get_file_path("priority_queue.dat"), serialize_entries(pq_entries, last_lsn));
     }
     
     void load_priority_queue() {
@@ -814,8 +4629,7 @@ public:
         std::ifstream file(get_file_path("priority_queue.dat"), std::ios::binary);
         if (!file) return;
         
-        size_t count;
-        file.read(reinterpret_cast<char*>(&count), sizeof(count));
+        size_t count = read_entries_header(file, loaded_lsns.queue);
         
         if (count < 100000) {
             pq_entries.resize(count);
@@ -836,7 +4650,7 @@ public:
         pushup.calories_per_minute = 8;
         pushup.prerequisites = {};
         pushup.next_exercises = {"EX002"};
-        exercise_btree.insert(pushup.id, pushup);
+        exercise_table->insert(pushup.id, pushup);
         
         Exercise squat;
         squat.id = "EX002";
@@ -845,7 +4659,7 @@ public:
         squat.difficulty = ExerciseDifficulty::BEGINNER;
         squat.calories_per_minute = 7;
         squat.prerequisites = {"EX001"};
-        exercise_btree.insert(squat.id, squat);
+        exercise_table->insert(squat.id, squat);
         
         User admin;
         admin.id = "ADMIN001";
@@ -853,9 +4667,10 @@ public:
         admin.email = "admin@fitnessquest.com";
         admin.password_hash = "hashed_password";
         admin.fitness_level = 10;
-        user_btree.insert(admin.id, admin);
+        user_table->insert(admin.id, CompactUser::pack(admin));
         
         email_index.push_back({admin.email, admin.id});
+        email_filter.add(admin.email);
         
         graph_edges.push_back({"EX001", "EX002", 1});
         
@@ -866,18 +4681,16 @@ public:
         daily.priority = 1;
         daily.required_exercises = {"EX001", "EX002"};
         daily.rewards = {"100 XP"};
-        quest_btree.insert(daily.id, daily);
+        quest_table->insert(daily.id, daily);
         pq_entries.push_back({daily, daily.priority, time(nullptr)});
         
-        save_all_data();
+        checkpoint();
     }
     
     std::string create_user(const std::string& username, const std::string& email, 
                            const std::string& password) {
-        for (const auto& entry : email_index) {
-            if (entry.key == email) {
-                throw std::runtime_error("Email already registered");
-            }
+        if (find_email(email) != std::string::npos) {
+            throw std::runtime_error("Email already registered");
         }
         
         User user;
@@ -886,88 +4699,201 @@ public:
         user.email = email;
         user.password_hash = std::to_string(std::hash<std::string>{}(password));
         
-        user_btree.insert(user.id, user);
-        email_index.push_back({email, user.id});
-        
-        save_all_data();
+        WriteBatch batch;
+        batch.put_user(user);
+        batch.add_email_index(email, user.id);
+        commit(batch);
         
         return user.id;
     }
     
     User get_user(const std::string& user_id) {
-        return user_btree.search(user_id);
+        return with_user(user_id, [](const CompactUser& user) { return user.unpack(); });
     }
     
-    User get_user_by_email(const std::string& email) {
-        for (const auto& entry : email_index) {
-            if (entry.key == email) {
-                return user_btree.search(entry.value);
+    // Runs `fn` on the stored user without copying it and returns its result.
+    // The reference must not outlive the call.
+    template <typename Fn>
+    auto with_user(const std::string& user_id, Fn&& fn) const -> decltype(fn(std::declval<const CompactUser&>())) {
+        using Result = decltype(fn(std::declval<const CompactUser&>()));
+        if constexpr (std::is_void_v<Result>) {
+            if (!user_table->visit(user_id, fn)) {
+                throw std::runtime_error("Key not found in B-Tree");
             }
+        } else {
+            std::optional<Result> result;
+            if (!user_table->visit(user_id, [&](const CompactUser& user) { result.emplace(fn(user)); })) {
+                throw std::runtime_error("Key not found in B-Tree");
+            }
+            return std::move(*result);
+        }
+    }
+    
+    // Non-throwing lookup for paths where a miss is routine (unknown IDs,
+    // tokens of deleted users); misses usually stop at the table's filter.
+    std::optional<User> try_get_user(const std::string& user_id) const {
+        std::optional<User> user;
+        user_table->visit(user_id, [&](const CompactUser& packed) { user = packed.unpack(); });
+        return user;
+    }
+    
+    User get_user_by_email(const std::string& email) {
+        size_t i = find_email(email);
+        if (i == std::string::npos) {
+            throw std::runtime_error("User not found with email: " + email);
         }
-        throw std::runtime_error("User not found with email: " + email);
+        return get_user(email_index[i].value);
+    }
+    
+    std::optional<User> try_get_user_by_email(const std::string& email) const {
+        size_t i = find_email(email);
+        if (i == std::string::npos) return std::nullopt;
+        return try_get_user(email_index[i].value);
     }
     
     void update_user(const User& user) {
-        user_btree.insert(user.id, user);
-        save_all_data();
+        WriteBatch batch;
+        batch.put_user(user);
+        commit(batch);
+    }
+    
+    // update_user for callers holding only shared access: safe alongside
+    // readers and other update_user_concurrent calls, but not alongside any
+    // other mutator. Does not checkpoint; returns true once one is due and
+    // the caller should run checkpoint() with exclusive access.
+    bool update_user_concurrent(const User& user) {
+        WriteBatch batch;
+        batch.put_user(user);
+        
+        CompactUser packed = CompactUser::pack(user);
+        std::lock_guard<std::mutex> lock(user_locks[std::hash<std::string>{}(user.id) % USER_LOCK_STRIPES]);
+        user_table->insert(user.id, packed);
+        return append_wal(batch);
+    }
+    
+    // Write-behind for low-value changes (last_login, counters): visible
+    // immediately, logged by the next flush_deferred() or checkpoint. Repeated
+    // updates of one user coalesce into a single record.
+    void update_user_deferred(const User& user) {
+        user_table->insert(user.id, CompactUser::pack(user));
+        deferred_users.insert(user.id);
+    }
+    
+    size_t deferred_count() const {
+        return deferred_users.size();
+    }
+    
+    // Logs the current state of every deferred user as one commit.
+    void flush_deferred() {
+        if (deferred_users.empty()) return;
+        
+        WriteBatch batch;
+        for (const auto& user_id : deferred_users) {
+            batch.put_user(get_user(user_id));
+        }
+        deferred_users.clear();
+        commit(batch);
     }
     
     void add_exercise(const Exercise& exercise) {
-        exercise_btree.insert(exercise.id, exercise);
+        WriteBatch batch;
+        batch.put_exercise(exercise);
         
         for (const auto& prereq : exercise.prerequisites) {
-            graph_edges.push_back({prereq, exercise.id, 1});
+            batch.add_graph_edge(prereq, exercise.id, 1);
         }
         
-        save_all_data();
+        commit(batch);
     }
     
     Exercise get_exercise(const std::string& exercise_id) {
-        return exercise_btree.search(exercise_id);
+        return exercise_table->search(exercise_id);
     }
     
+    // One pass over the table, one copy per record.
     std::vector<Exercise> get_all_exercises() {
         std::vector<Exercise> exercises;
-        auto keys = exercise_btree.get_all_keys();
-        for (const auto& key : keys) {
-            try {
-                exercises.push_back(exercise_btree.search(key));
-            } catch (...) {}
-        }
+        exercises.reserve(exercise_table->get_size());
+        exercise_table->for_each([&](const std::string&, const Exercise& exercise) {
+            exercises.push_back(exercise);
+        });
         return exercises;
     }
     
     std::string start_workout(const std::string& user_id) {
         WorkoutSession session;
         session.user_id = user_id;
-        workout_btree.insert(session.id, session);
         
-        save_all_data();
+        WriteBatch batch;
+        batch.put_workout(session);
+        commit(batch);
         return session.id;
     }
     
     void complete_workout(const std::string& workout_id) {
-        WorkoutSession session = workout_btree.search(workout_id);
+        WorkoutSession session = get_workout(workout_id);
         session.end_time = time(nullptr);
-        workout_btree.insert(workout_id, session);
         
-        save_all_data();
+        WriteBatch batch;
+        batch.put_workout(session);
+        commit(batch);
+    }
+    
+    // Fused path for logging a finished workout: the session and the user's
+    // XP/level delta are stored with one insert per table and one commit.
+    std::string record_workout(const WorkoutSession& session, int experience_delta, int new_level = 0) {
+        WriteBatch batch;
+        batch.record_workout(get_user(session.user_id), session, experience_delta, new_level);
+        commit(batch);
+        return session.id;
     }
     
     WorkoutSession get_workout(const std::string& workout_id) {
-        return workout_btree.search(workout_id);
+        if (auto session = try_get_workout(workout_id)) {
+            return std::move(*session);
+        }
+        throw std::runtime_error("Key not found in B-Tree");
+    }
+    
+    std::optional<WorkoutSession> try_get_workout(const std::string& workout_id) const {
+        if (auto session = workout_table->try_get(workout_id)) return session;
+        for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
+            if (auto session = (*it)->find(workout_id)) return session;
+        }
+        return std::nullopt;
+    }
+    
+    // The user's workouts, newest first: recent ones from memory, the rest
+    // from the segments that hold any of the user's sessions.
+    std::vector<WorkoutSession> get_user_workouts(const std::string& user_id) const {
+        std::vector<WorkoutSession> workouts;
+        std::set<std::string> seen;
+        collect_recent_workouts(user_id, workouts, seen);
+        for (auto it = segments.rbegin(); it != segments.rend(); ++it) {
+            (*it)->for_user(user_id, [&](WorkoutSession&& session) {
+                if (seen.insert(session.id).second) workouts.push_back(std::move(session));
+            });
+        }
+        sort_newest_first(workouts);
+        return workouts;
+    }
+    
+    // Only the workouts still in memory (roughly the last
+    // workout_hot_seconds), newest first. Never reads a segment, so its cost
+    // does not grow with the user's history.
+    std::vector<WorkoutSession> get_recent_user_workouts(const std::string& user_id) const {
+        std::vector<WorkoutSession> workouts;
+        std::set<std::string> seen;
+        collect_recent_workouts(user_id, workouts, seen);
+        sort_newest_first(workouts);
+        return workouts;
     }
     
     void add_quest(const Quest& quest) {
-        quest_btree.insert(quest.id, quest);
-        pq_entries.push_back({quest, quest.priority, time(nullptr)});
-        
-        std::sort(pq_entries.begin(), pq_entries.end(), 
-                 [](const PriorityQueueEntry& a, const PriorityQueueEntry& b) {
-                     return a.priority > b.priority;
-                 });
-        
-        save_all_data();
+        WriteBatch batch;
+        batch.put_quest(quest);
+        batch.push_quest(quest);
+        commit(batch);
     }
     
     Quest get_next_quest() {
@@ -976,24 +4902,27 @@ public:
         }
         
         Quest quest = pq_entries.back().quest;
-        pq_entries.pop_back();
         
-        save_all_data();
+        WriteBatch batch;
+        batch.pop_quest();
+        commit(batch);
         return quest;
     }
     
     Quest get_quest(const std::string& quest_id) {
-        return quest_btree.search(quest_id);
+        return quest_table->search(quest_id);
+    }
+    
+    std::optional<Quest> try_get_quest(const std::string& quest_id) const {
+        return quest_table->try_get(quest_id);
     }
     
     std::vector<Quest> get_all_quests() {
         std::vector<Quest> quests;
-        auto keys = quest_btree.get_all_keys();
-        for (const auto& key : keys) {
-            try {
-                quests.push_back(quest_btree.search(key));
-            } catch (...) {}
-        }
+        quests.reserve(quest_table->get_size());
+        quest_table->for_each([&](const std::string&, const Quest& quest) {
+            quests.push_back(quest);
+        });
         return quests;
     }
     
@@ -1005,12 +4934,14 @@ public:
         struct BTreeStats {
             size_t exercise_count;
             size_t user_count;
-            size_t workout_count;
+            size_t workout_count;       // in memory and in segments
+            size_t cold_workout_count;  // in segments
             size_t quest_count;
         } btree;
         
         struct OtherStats {
             size_t email_index_size;
+            size_t email_filter_capacity;
             size_t graph_edges;
             size_t priority_queue_size;
         } other;
@@ -1019,12 +4950,17 @@ public:
     DatabaseStats get_stats() const {
         DatabaseStats stats;
         
-        stats.btree.exercise_count = exercise_btree.get_size();
-        stats.btree.user_count = user_btree.get_size();
-        stats.btree.workout_count = workout_btree.get_size();
-        stats.btree.quest_count = quest_btree.get_size();
+        stats.btree.exercise_count = exercise_table->get_size();
+        stats.btree.user_count = user_table->get_size();
+        stats.btree.cold_workout_count = 0;
+        for (const auto& segment : segments) {
+            stats.btree.cold_workout_count += segment->size();
+        }
+        stats.btree.workout_count = workout_table->get_size() + stats.btree.cold_workout_count;
+        stats.btree.quest_count = quest_table->get_size();
         
         stats.other.email_index_size = email_index.size();
+        stats.other.email_filter_capacity = email_filter.capacity();
         stats.other.graph_edges = graph_edges.size();
         stats.other.priority_queue_size = pq_entries.size();
         
@@ -1034,8 +4970,9 @@ public:
     bool test_persistence() {
         try {
             std::string user_id = create_user("TestUser", "test@test.com", "password");
+            flush();
             
-            PersistentFitnessDatabase new_db(data_dir);
+            PersistentFitnessDatabase new_db(data_dir, options);
             
             User loaded_user = new_db.get_user_by_email("test@test.com");
             
@@ -1049,25 +4986,45 @@ public:
     
     void clear_all_data() {
         email_index.clear();
+        email_filter.reset(0);
         graph_edges.clear();
         pq_entries.clear();
         
-        exercise_btree.clear();
-        user_btree.clear();
-        workout_btree.clear();
-        quest_btree.clear();
+        exercise_table->clear();
+        user_table->clear();
+        workout_table->clear();
+        quest_table->clear();
+        hot_user_workouts.clear();
+        
+        // Pending snapshots must not land after the files are removed. The
+        // log stays open in the backend, so it is truncated rather than removed.
+        backend->truncate(get_file_path("wal.log"));
+        flush();
         
         std::vector<std::string> files = {
             "exercises.dat", "users.dat", "workouts.dat", "quests.dat",
-            "email_index.dat", "graph.dat", "priority_queue.dat"
+            "email_index.dat", "graph.dat", "priority_queue.dat",
+            "exercises.dat.idx", "users.dat.idx", "workouts.dat.idx", "quests.dat.idx",
+            "exercises.dat.bloom", "users.dat.bloom", "workouts.dat.bloom", "quests.dat.bloom",
+            "symbols.dat", "checkpoint.dat"
         };
+        for (auto& file : files) {
+            file = get_file_path(file);
+        }
+        for (const TableStorage* table : tables()) {
+            for (const auto& path : table->files()) files.push_back(path);
+        }
         
-        for (const auto& file : files) {
-            std::string path = get_file_path(file);
+        for (const auto& path : files) {
             if (file_exists(path)) {
                 std::remove(path.c_str());
             }
         }
+        segments.clear();
+        for (uint32_t sequence = 1; file_exists(segment_path(sequence)); sequence++) {
+            std::remove(segment_path(sequence).c_str());
+        }
+        segment_cache.clear();
         
         initialize_sample_data();
     }
@@ -8,7 +8,16 @@
 #include <string>
 #include <map>
 #include <memory>
+#include <array>
+#include <vector>
+#include <atomic>
 #include <mutex>
+#include <shared_mutex>
+#include <optional>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
 #include <fstream>
 #include <sstream>
 #include <cstdlib>
@@ -28,6 +37,12 @@ private:
     static std::map<std::string, std::string> variables;
     static bool loaded;
     
+    static std::string upper(std::string value) {
+        std::transform(value.begin(), value.end(), value.begin(),
+            [](unsigned char c){ return std::toupper(c); });
+        return value;
+    }
+    
 public:
     static void load(const std::string& filepath = ".env") {
         if (loaded) return;
@@ -112,6 +127,73 @@ public:
         return get("DATA_DIR", "./fitness_data"); 
     }
     
+    static bool getDatabaseParallelIO() { 
+        return getBool("DB_PARALLEL_IO", true); 
+    }
+    
+    static int getDatabaseIOThreads() { 
+        return getInt("DB_IO_THREADS", 0); 
+    }
+    
+    static std::string getDatabaseIOBackend() { 
+        return get("DB_IO_BACKEND", "auto"); 
+    }
+    
+    static int getDatabaseCheckpointInterval() { 
+        return getInt("DB_CHECKPOINT_INTERVAL", 256); 
+    }
+    
+    // "table=engine" pairs, e.g. "workouts=lsm,users=btree".
+    static std::map<std::string, std::string> getTableEngines() { 
+        std::map<std::string, std::string> engines;
+        std::stringstream list(get("DB_TABLE_ENGINES", ""));
+        std::string entry;
+        while (std::getline(list, entry, ',')) {
+            size_t eq = entry.find('=');
+            if (eq != std::string::npos) {
+                engines[entry.substr(0, eq)] = entry.substr(eq + 1);
+            }
+        }
+        return engines;
+    }
+    
+    static int getWorkoutHotDays() { 
+        return getInt("DB_WORKOUT_HOT_DAYS", 30); 
+    }
+    
+    static int getSegmentCacheKB() { 
+        return getInt("DB_SEGMENT_CACHE_KB", 4096); 
+    }
+    
+    static int getWriteBehindIntervalMs() { 
+        return getInt("DB_WRITE_BEHIND_INTERVAL_MS", 1000); 
+    }
+    
+    static int getWriteBehindMaxPending() { 
+        return getInt("DB_WRITE_BEHIND_MAX_PENDING", 256); 
+    }
+    
+    // Executor pools ("io", "db", "cpu"): EXECUTOR_<POOL>_THREADS and
+    // EXECUTOR_<POOL>_QUEUE.
+    static int getExecutorThreads(const std::string& pool, int defaultValue) { 
+        return getInt("EXECUTOR_" + upper(pool) + "_THREADS", defaultValue); 
+    }
+    
+    static int getExecutorQueueLimit(const std::string& pool, int defaultValue) { 
+        return getInt("EXECUTOR_" + upper(pool) + "_QUEUE", defaultValue); 
+    }
+    
+    // Rendered per-user responses (game state, stats) kept in memory.
+    static int getStateCacheEntries() { 
+        return getInt("STATE_CACHE_ENTRIES", 10000); 
+    }
+    
+    // Longest a GET /api/game/events request is held open before it is
+    // answered with no changes.
+    static int getEventsTimeoutSeconds() { 
+        return getInt("EVENTS_TIMEOUT_SECONDS", 25); 
+    }
+    
     static int getServerPort() { 
         return getInt("PORT", 8080); 
     }
@@ -160,12 +242,171 @@ bool Environment::loaded = false;
 // ============================================================================
 class Database {
 private:
-    std::unique_ptr<FitnessDB::PersistentFitnessDatabase> db;
-    std::mutex dbMutex;
+    // Shared so a request waiting for its log record keeps the database
+    // alive past a disconnect.
+    std::shared_ptr<FitnessDB::PersistentFitnessDatabase> db;
+    // Readers and updateUser share the lock (the users table is a
+    // concurrent tree); every other mutation takes it exclusively.
+    std::shared_mutex dbMutex;
     bool connected;
     std::string dataDir;
     
+    // Bumped by every write to the quest or exercise tables. Response
+    // caches compare it to know when a rendered catalog is stale.
+    std::atomic<uint64_t> catalogVersionCounter{1};
+    
+    // Per-user versions for the same purpose, striped by user id so they
+    // take fixed memory. Users sharing a stripe only cost each other a
+    // re-render. Bumped after the write, under the lock that covers it.
+    static constexpr size_t userVersionStripeCount = 4096;
+    std::array<std::atomic<uint64_t>, userVersionStripeCount> userVersionStripes{};
+    std::atomic<uint64_t> connectGeneration{0};
+    
+    static size_t userVersionStripe(const std::string& userId) {
+        return std::hash<std::string>{}(userId) % userVersionStripeCount;
+    }
+    
+    void bumpUserVersion(const std::string& userId) {
+        userVersionStripes[userVersionStripe(userId)]++;
+    }
+    
+    // Write-behind flusher for deferred user updates
+    std::thread flusher;
+    std::condition_variable_any flushCv;
+    bool stopFlusher = false;
+    std::chrono::milliseconds flushInterval{1000};
+    size_t flushThreshold = 256;
+    
+    void flushLoop() {
+        std::unique_lock<std::shared_mutex> lock(dbMutex);
+        while (!stopFlusher) {
+            flushCv.wait_for(lock, flushInterval, [this]() {
+                return stopFlusher || (isConnected() && db->deferred_count() >= flushThreshold);
+            });
+            if (isConnected()) {
+                db->flush_deferred();
+            }
+        }
+    }
+    
+    // The log record of a write made under the lock. wait() blocks until it
+    // is on disk; callers drop the lock first, so writers committing in the
+    // meantime ride in the same fsync.
+    struct Durability {
+        std::shared_ptr<FitnessDB::PersistentFitnessDatabase> db;
+        uint64_t ticket = 0;
+        
+        void wait() const {
+            if (db) db->wait_durable(ticket);
+        }
+    };
+    
+    // Caller holds the lock.
+    Durability logged() const {
+        return Durability{db, db->log_ticket()};
+    }
+    
+    void stopFlushThread() {
+        {
+            std::lock_guard<std::shared_mutex> lock(dbMutex);
+            stopFlusher = true;
+        }
+        flushCv.notify_all();
+        if (flusher.joinable()) flusher.join();
+    }
+    
 public:
+    // Unit of work: holds the database lock until commit(), reads through
+    // its own pending writes, and commit() applies every write as a single
+    // log record. Dropping it uncommitted discards the writes.
+    class Transaction {
+    private:
+        std::unique_lock<std::shared_mutex> lock;
+        FitnessDB::PersistentFitnessDatabase* db;
+        FitnessDB::PersistentFitnessDatabase::WriteBatch batch;
+        Database& database;
+        bool catalogChanged = false;
+        std::vector<std::string> changedUsers;
+        
+    public:
+        explicit Transaction(Database& database) 
+            : lock(database.dbMutex), db(database.db.get()), database(database) {
+            if (!database.isConnected()) throw std::runtime_error("Database not connected");
+        }
+        
+        Transaction(const Transaction&) = delete;
+        Transaction& operator=(const Transaction&) = delete;
+        
+        FitnessDB::User getUser(const std::string& userId) {
+            if (const FitnessDB::User* pending = batch.find_user(userId)) return *pending;
+            return db->get_user(userId);
+        }
+        
+        FitnessDB::User getUserByEmail(const std::string& email) {
+            FitnessDB::User user = db->get_user_by_email(email);
+            if (const FitnessDB::User* pending = batch.find_user(user.id)) return *pending;
+            return user;
+        }
+        
+        void updateUser(const FitnessDB::User& user) {
+            batch.put_user(user);
+            changedUsers.push_back(user.id);
+        }
+        
+        FitnessDB::WorkoutSession getWorkout(const std::string& workoutId) {
+            if (const FitnessDB::WorkoutSession* pending = batch.find_workout(workoutId)) return *pending;
+            return db->get_workout(workoutId);
+        }
+        
+        std::string startWorkout(const std::string& userId) {
+            FitnessDB::WorkoutSession session;
+            session.user_id = userId;
+            batch.put_workout(session);
+            changedUsers.push_back(userId);
+            return session.id;
+        }
+        
+        void completeWorkout(const std::string& workoutId) {
+            FitnessDB::WorkoutSession session = getWorkout(workoutId);
+            session.end_time = time(nullptr);
+            batch.put_workout(session);
+            changedUsers.push_back(session.user_id);
+        }
+        
+        std::string logWorkout(const FitnessDB::WorkoutSession& session, int experienceDelta, int newLevel = 0) {
+            batch.record_workout(getUser(session.user_id), session, experienceDelta, newLevel);
+            changedUsers.push_back(session.user_id);
+            return session.id;
+        }
+        
+        FitnessDB::Quest getQuest(const std::string& questId) {
+            if (const FitnessDB::Quest* pending = batch.find_quest(questId)) return *pending;
+            return db->get_quest(questId);
+        }
+        
+        // Stores the quest without queueing it again (unlike addQuest).
+        void updateQuest(const FitnessDB::Quest& quest) {
+            batch.put_quest(quest);
+            catalogChanged = true;
+        }
+        
+        // Ends the unit of work: releases the lock and returns once the
+        // record is on disk, so the caller may acknowledge it.
+        void commit() {
+            if (!lock.owns_lock()) throw std::runtime_error("Transaction already committed");
+            db->commit(batch);
+            batch = FitnessDB::PersistentFitnessDatabase::WriteBatch();
+            if (catalogChanged) database.catalogVersionCounter++;
+            for (const auto& userId : changedUsers) database.bumpUserVersion(userId);
+            catalogChanged = false;
+            changedUsers.clear();
+            
+            Durability durability = database.logged();
+            lock.unlock();
+            durability.wait();
+        }
+    };
+    
     Database(const std::string& directory = "./fitness_data") 
         : connected(false), dataDir(directory) {}
     
@@ -174,12 +415,31 @@ public:
     }
     
     bool connect() {
-        std::lock_guard<std::mutex> lock(dbMutex);
+        std::lock_guard<std::shared_mutex> lock(dbMutex);
         
         try {
-            db = std::make_unique<FitnessDB::PersistentFitnessDatabase>(dataDir);
+            FitnessDB::DatabaseOptions options;
+            options.parallel_persistence = Environment::getDatabaseParallelIO();
+            options.io_threads = static_cast<unsigned>(std::max(0, Environment::getDatabaseIOThreads()));
+            options.io_backend = Environment::getDatabaseIOBackend();
+            options.checkpoint_interval = static_cast<size_t>(std::max(1, Environment::getDatabaseCheckpointInterval()));
+            options.workout_hot_seconds = static_cast<time_t>(std::max(0, Environment::getWorkoutHotDays())) * 24 * 3600;
+            options.segment_cache_bytes = static_cast<size_t>(std::max(0, Environment::getSegmentCacheKB())) * 1024;
+            options.table_engines = Environment::getTableEngines();
+            
+            db = std::make_shared<FitnessDB::PersistentFitnessDatabase>(dataDir, options);
             connected = true;
+            catalogVersionCounter++;
+            connectGeneration++;
+            
+            flushInterval = std::chrono::milliseconds(std::max(1, Environment::getWriteBehindIntervalMs()));
+            flushThreshold = static_cast<size_t>(std::max(1, Environment::getWriteBehindMaxPending()));
+            if (!flusher.joinable()) {
+                stopFlusher = false;
+                flusher = std::thread(&Database::flushLoop, this);
+            }
             
+            std::cout << "  Persistence backend: " << db->persistence_backend_name() << std::endl;
             auto stats = db->get_stats();
             std::cout << "  Database statistics:" << std::endl;
             std::cout << "    Users: " << stats.btree.user_count << std::endl;
@@ -195,8 +455,11 @@ public:
         }
     }
     
+    // Pending write-behind updates are flushed here: the database checkpoints
+    // on destruction.
     void disconnect() {
-        std::lock_guard<std::mutex> lock(dbMutex);
+        stopFlushThread();
+        std::lock_guard<std::shared_mutex> lock(dbMutex);
         if (db && connected) {
             db.reset();
             connected = false;
@@ -207,6 +470,11 @@ public:
         return connected && db != nullptr;
     }
     
+    // Usage: auto txn = database->begin(); ...; txn.commit();
+    Transaction begin() {
+        return Transaction(*this);
+    }
+    
     FitnessDB::PersistentFitnessDatabase& getDB() {
         if (!isConnected()) {
             throw std::runtime_error("Database not connected");
@@ -215,7 +483,7 @@ public:
     }
     
     bool healthCheck() {
-        std::lock_guard<std::mutex> lock(dbMutex);
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
         
         try {
             if (!isConnected()) return false;
@@ -227,114 +495,247 @@ public:
         }
     }
     std::vector<FitnessDB::WorkoutSession> getUserWorkouts(const std::string& userId) {
-        std::lock_guard<std::mutex> lock(dbMutex);
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
         if (!isConnected()) throw std::runtime_error("Database not connected");
-        
-        // Workaround: Get all workouts and filter by user
-        std::vector<FitnessDB::WorkoutSession> allWorkouts;
-        std::vector<FitnessDB::WorkoutSession> userWorkouts;
-        
-        // This assumes there's a method to get all workouts
-        // You might need to adjust based on actual database API
-        try {
-            // Try different possible method names
-            // allWorkouts = db->get_all_workouts();
-            // OR create a simple implementation
-            
-            // For now, return empty
-            return userWorkouts;
-        } catch (...) {
-            throw std::runtime_error("Failed to get user workouts");
-        }
+        return db->get_user_workouts(userId);
+    }
+    
+    // Workouts from the hot window only; for paths that run on every poll.
+    std::vector<FitnessDB::WorkoutSession> getRecentUserWorkouts(const std::string& userId) {
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
+        if (!isConnected()) throw std::runtime_error("Database not connected");
+        return db->get_recent_user_workouts(userId);
     }
     
     std::string createUser(const std::string& username, const std::string& email, 
                           const std::string& password) {
-        std::lock_guard<std::mutex> lock(dbMutex);
-        if (!isConnected()) throw std::runtime_error("Database not connected");
-        return db->create_user(username, email, password);
+        std::string userId;
+        Durability durability;
+        {
+            std::lock_guard<std::shared_mutex> lock(dbMutex);
+            if (!isConnected()) throw std::runtime_error("Database not connected");
+            userId = db->create_user(username, email, password);
+            bumpUserVersion(userId);
+            durability = logged();
+        }
+        durability.wait();
+        return userId;
     }
     
     FitnessDB::User getUser(const std::string& userId) {
-        std::lock_guard<std::mutex> lock(dbMutex);
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
         if (!isConnected()) throw std::runtime_error("Database not connected");
         return db->get_user(userId);
     }
     
+    // try* lookups return std::nullopt for unknown keys instead of throwing;
+    // use them wherever a miss is an expected outcome (404s, bad logins).
+    std::optional<FitnessDB::User> tryGetUser(const std::string& userId) {
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
+        if (!isConnected()) throw std::runtime_error("Database not connected");
+        return db->try_get_user(userId);
+    }
+    
+    std::optional<FitnessDB::User> tryGetUserByEmail(const std::string& email) {
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
+        if (!isConnected()) throw std::runtime_error("Database not connected");
+        return db->try_get_user_by_email(email);
+    }
+    
+    // Zero-copy read: `fn` sees the stored record while it is pinned, so it
+    // should copy out only the fields it needs and do no I/O.
+    template <typename Fn>
+    auto withUser(const std::string& userId, Fn&& fn) -> decltype(fn(std::declval<const FitnessDB::CompactUser&>())) {
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
+        if (!isConnected()) throw std::runtime_error("Database not connected");
+        return db->with_user(userId, std::forward<Fn>(fn));
+    }
+    
     FitnessDB::User getUserByEmail(const std::string& email) {
-        std::lock_guard<std::mutex> lock(dbMutex);
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
         if (!isConnected()) throw std::runtime_error("Database not connected");
         return db->get_user_by_email(email);
     }
     
+    // Runs under the shared lock, concurrently with reads and other
+    // updateUser calls; only the periodic checkpoint takes it exclusively.
     void updateUser(const FitnessDB::User& user) {
-        std::lock_guard<std::mutex> lock(dbMutex);
+        bool checkpointDue;
+        Durability durability;
+        {
+            std::shared_lock<std::shared_mutex> lock(dbMutex);
+            if (!isConnected()) throw std::runtime_error("Database not connected");
+            checkpointDue = db->update_user_concurrent(user);
+            bumpUserVersion(user.id);
+            durability = logged();
+        }
+        if (checkpointDue) {
+            std::lock_guard<std::shared_mutex> lock(dbMutex);
+            if (isConnected() && db->checkpoint_due()) db->checkpoint();
+        }
+        durability.wait();
+    }
+    
+    // Write-behind update for low-value fields: `mutate` runs on the current
+    // record under the lock and is visible at once; it is persisted by the
+    // background flusher, coalesced with other updates to the same user.
+    void updateUserDeferred(const std::string& userId, const std::function<void(FitnessDB::User&)>& mutate) {
+        std::lock_guard<std::shared_mutex> lock(dbMutex);
         if (!isConnected()) throw std::runtime_error("Database not connected");
-        db->update_user(user);
+        FitnessDB::User user = db->get_user(userId);
+        mutate(user);
+        db->update_user_deferred(user);
+        bumpUserVersion(userId);
+        if (db->deferred_count() >= flushThreshold) {
+            flushCv.notify_one();
+        }
+    }
+    
+    // Logs all pending write-behind updates now and waits for the disk.
+    void flushPending() {
+        Durability durability;
+        {
+            std::lock_guard<std::shared_mutex> lock(dbMutex);
+            if (!isConnected()) throw std::runtime_error("Database not connected");
+            db->flush_deferred();
+            durability = logged();
+        }
+        durability.wait();
     }
     
     void addExercise(const FitnessDB::Exercise& exercise) {
-        std::lock_guard<std::mutex> lock(dbMutex);
-        if (!isConnected()) throw std::runtime_error("Database not connected");
-        db->add_exercise(exercise);
+        Durability durability;
+        {
+            std::lock_guard<std::shared_mutex> lock(dbMutex);
+            if (!isConnected()) throw std::runtime_error("Database not connected");
+            db->add_exercise(exercise);
+            catalogVersionCounter++;
+            durability = logged();
+        }
+        durability.wait();
     }
     
     FitnessDB::Exercise getExercise(const std::string& exerciseId) {
-        std::lock_guard<std::mutex> lock(dbMutex);
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
         if (!isConnected()) throw std::runtime_error("Database not connected");
         return db->get_exercise(exerciseId);
     }
     
     std::vector<FitnessDB::Exercise> getAllExercises() {
-        std::lock_guard<std::mutex> lock(dbMutex);
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
         if (!isConnected()) throw std::runtime_error("Database not connected");
         return db->get_all_exercises();
     }
     
     std::string startWorkout(const std::string& userId) {
-        std::lock_guard<std::mutex> lock(dbMutex);
-        if (!isConnected()) throw std::runtime_error("Database not connected");
-        return db->start_workout(userId);
+        std::string workoutId;
+        Durability durability;
+        {
+            std::lock_guard<std::shared_mutex> lock(dbMutex);
+            if (!isConnected()) throw std::runtime_error("Database not connected");
+            workoutId = db->start_workout(userId);
+            bumpUserVersion(userId);
+            durability = logged();
+        }
+        durability.wait();
+        return workoutId;
     }
     
     void completeWorkout(const std::string& workoutId) {
-        std::lock_guard<std::mutex> lock(dbMutex);
-        if (!isConnected()) throw std::runtime_error("Database not connected");
-        db->complete_workout(workoutId);
+        Durability durability;
+        {
+            std::lock_guard<std::shared_mutex> lock(dbMutex);
+            if (!isConnected()) throw std::runtime_error("Database not connected");
+            db->complete_workout(workoutId);
+            if (auto session = db->try_get_workout(workoutId)) bumpUserVersion(session->user_id);
+            durability = logged();
+        }
+        durability.wait();
+    }
+    
+    std::string logWorkout(const FitnessDB::WorkoutSession& session, int experienceDelta, int newLevel = 0) {
+        std::string workoutId;
+        Durability durability;
+        {
+            std::lock_guard<std::shared_mutex> lock(dbMutex);
+            if (!isConnected()) throw std::runtime_error("Database not connected");
+            workoutId = db->record_workout(session, experienceDelta, newLevel);
+            bumpUserVersion(session.user_id);
+            durability = logged();
+        }
+        durability.wait();
+        return workoutId;
     }
     
     FitnessDB::WorkoutSession getWorkout(const std::string& workoutId) {
-        std::lock_guard<std::mutex> lock(dbMutex);
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
         if (!isConnected()) throw std::runtime_error("Database not connected");
         return db->get_workout(workoutId);
     }
     
-    void addQuest(const FitnessDB::Quest& quest) {
-        std::lock_guard<std::mutex> lock(dbMutex);
+    std::optional<FitnessDB::WorkoutSession> tryGetWorkout(const std::string& workoutId) {
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
         if (!isConnected()) throw std::runtime_error("Database not connected");
-        db->add_quest(quest);
+        return db->try_get_workout(workoutId);
+    }
+    
+    void addQuest(const FitnessDB::Quest& quest) {
+        Durability durability;
+        {
+            std::lock_guard<std::shared_mutex> lock(dbMutex);
+            if (!isConnected()) throw std::runtime_error("Database not connected");
+            db->add_quest(quest);
+            catalogVersionCounter++;
+            durability = logged();
+        }
+        durability.wait();
     }
     
     FitnessDB::Quest getQuest(const std::string& questId) {
-        std::lock_guard<std::mutex> lock(dbMutex);
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
         if (!isConnected()) throw std::runtime_error("Database not connected");
         return db->get_quest(questId);
     }
     
+    std::optional<FitnessDB::Quest> tryGetQuest(const std::string& questId) {
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
+        if (!isConnected()) throw std::runtime_error("Database not connected");
+        return db->try_get_quest(questId);
+    }
+    
     std::vector<FitnessDB::Quest> getAllQuests() {
-        std::lock_guard<std::mutex> lock(dbMutex);
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
         if (!isConnected()) throw std::runtime_error("Database not connected");
         return db->get_all_quests();
     }
     
+    // Changes whenever the quest or exercise catalog may have; reading it
+    // does not touch the database.
+    uint64_t catalogVersion() const {
+        return catalogVersionCounter.load();
+    }
+    
+    // Changes whenever the user's record or workouts may have; reading it
+    // does not touch the database.
+    uint64_t userVersion(const std::string& userId) const {
+        return connectGeneration.load() + userVersionStripes[userVersionStripe(userId)].load();
+    }
+    
     FitnessDB::Quest getNextQuest() {
-        std::lock_guard<std::mutex> lock(dbMutex);
-        if (!isConnected()) throw std::runtime_error("Database not connected");
-        return db->get_next_quest();
+        FitnessDB::Quest quest;
+        Durability durability;
+        {
+            std::lock_guard<std::shared_mutex> lock(dbMutex);
+            if (!isConnected()) throw std::runtime_error("Database not connected");
+            quest = db->get_next_quest();
+            durability = logged();
+        }
+        durability.wait();
+        return quest;
     }
     
     FitnessDB::PersistentFitnessDatabase::DatabaseStats getStats() {
-        std::lock_guard<std::mutex> lock(dbMutex);
+        std::shared_lock<std::shared_mutex> lock(dbMutex);
         if (!isConnected()) throw std::runtime_error("Database not connected");
         return db->get_stats();
     }
@@ -11,12 +11,17 @@
 #include <optional>
 #include <sstream>
 #include <ctime>
+#include <charconv>
 
 #include "config.hpp"
 #include "shared-models/shared-models.hpp"
 #include "services.hpp"
 #include "utils.hpp"
 #include "GameSyncEngine.hpp"
+#include "executor.hpp"
+#include "coroutines.hpp"
+#include "response_cache.hpp"
+#include "notification_hub.hpp"
 
 using namespace web;
 using namespace web::http;
@@ -25,552 +30,711 @@ namespace FitnessQuest {
 namespace Controllers {
 
 // ============================================================================
-// HEALTH CONTROLLER
+// REQUEST BODIES
 // ============================================================================
-class HealthController {
-private:
+struct Credentials {
+    std::string email;
+    std::string password;
+};
+
+} // namespace Controllers
+
+// Hot POST bodies decode straight into these (see Utils::JsonReader).
+namespace Utils {
+
+template <>
+struct JsonSchema<Controllers::Credentials> {
+    static constexpr auto fields = std::make_tuple(
+        jsonRequired("email", &Controllers::Credentials::email),
+        jsonRequired("password", &Controllers::Credentials::password));
+};
+
+template <>
+struct JsonSchema<Models::Workout> {
+    static constexpr auto fields = std::make_tuple(
+        jsonRequired("type", &Models::Workout::type, Models::stringToWorkoutType),
+        jsonRequired("duration", &Models::Workout::duration),
+        jsonRequired("intensity", &Models::Workout::intensity),
+        jsonOptional("formScore", &Models::Workout::formScore),
+        jsonOptional("exerciseId", &Models::Workout::exerciseId),
+        jsonOptional("caloriesBurned", &Models::Workout::caloriesBurned),
+        jsonOptional("notes", &Models::Workout::notes));
+};
+
+} // namespace Utils
+
+namespace Controllers {
+
+// ============================================================================
+// COROUTINE CONTROLLER BASE
+// ============================================================================
+// Handlers are coroutines returning Async::Response and read top to bottom:
+// co_await the body, co_await a pool to move onto it, co_return the reply.
+// Anything thrown along the way becomes the reply (see Async::Response), so
+// handlers only catch what they want to answer differently.
+//
+// Pools: cpprestsdk threads parse; io serves cheap handlers; db runs
+// anything touching the database; cpu hashes, signs and renders lists.
+class CoroutineController {
+protected:
     std::shared_ptr<Config::Database> database;
 
-public:
-    explicit HealthController(std::shared_ptr<Config::Database> db) : database(std::move(db)) {}
+    explicit CoroutineController(std::shared_ptr<Config::Database> db) : database(std::move(db)) {}
 
-    void getHealth(http_request request) {
-        json::value response = json::value::object();
-        try {
-            bool dbHealthy = database->healthCheck();
+    // The user id from the request's bearer token.
+    static std::string authenticate(http_request& request) {
+        return Utils::JWT::verifyToken(Utils::Request::extractToken(request));
+    }
 
-            response[U("success")] = json::value::boolean(true);
-            response[U("status")] = json::value::string(U("healthy"));
-            response[U("timestamp")] = json::value::number(static_cast<int64_t>(time(nullptr)));
+    static Async::Reply reply(status_code code, json::value body) {
+        return {code, std::move(body), {}, {}};
+    }
 
-            json::value services = json::value::object();
-            services[U("database")] = json::value::boolean(dbHealthy);
-            services[U("api")] = json::value::boolean(true);
-            response[U("services")] = services;
+    // Hot paths serialize with a JsonWriter and skip the json::value DOM.
+    static Async::Reply reply(status_code code, Utils::JsonWriter& json) {
+        return {code, json::value(), json.take(), {}};
+    }
+
+    static Async::Reply reply(status_code code, const Caching::CachedResponse& cached) {
+        return {code, json::value(), cached.body, cached.etag};
+    }
+
+    static Async::Reply notModified(std::string etag) {
+        return {status_codes::NotModified, json::value(), {}, std::move(etag)};
+    }
+
+    // A 304 when the client already holds `key` at `version`, the cached
+    // body when there is one, otherwise nothing and the handler renders.
+    static std::optional<Async::Reply> fromCache(http_request& request, const Caching::ResponseCache& cache,
+                                                 const std::string& key, uint64_t version) {
+        std::string etag = Caching::ResponseCache::etag(key, version);
+        if (Utils::Request::matchesETag(request, etag)) return notModified(std::move(etag));
+        if (auto cached = cache.find(key, version)) return reply(status_codes::OK, *cached);
+        return std::nullopt;
+    }
+};
+
+// ============================================================================
+// HEALTH CONTROLLER
+// ============================================================================
+class HealthController : public CoroutineController {
+public:
+    explicit HealthController(std::shared_ptr<Config::Database> db) : CoroutineController(std::move(db)) {}
 
-            Utils::Response::sendJsonResponse(request, status_codes::OK, response);
-        } catch (const std::exception& e) {
-            Utils::Response::sendError(request, status_codes::InternalError, e.what());
+    Async::Response getHealth(http_request request) {
+        // On the io pool so a backlog of database work cannot delay it.
+        co_await Async::Executors::io();
+        bool dbHealthy = database->healthCheck();
+
+        json::value response = json::value::object();
+        response[U("success")] = json::value::boolean(true);
+        response[U("status")] = json::value::string(U("healthy"));
+        response[U("timestamp")] = json::value::number(static_cast<int64_t>(time(nullptr)));
+
+        json::value services = json::value::object();
+        services[U("database")] = json::value::boolean(dbHealthy);
+        services[U("api")] = json::value::boolean(true);
+        response[U("services")] = services;
+
+        json::value executors = json::value::object();
+        for (const auto& pool : Async::Executors::metrics()) {
+            json::value m = json::value::object();
+            m[U("threads")] = json::value::number(static_cast<int64_t>(pool.threads));
+            m[U("queued")] = json::value::number(static_cast<int64_t>(pool.queued));
+            m[U("peakQueued")] = json::value::number(static_cast<int64_t>(pool.peakQueued));
+            m[U("queueLimit")] = json::value::number(static_cast<int64_t>(pool.queueLimit));
+            m[U("active")] = json::value::number(static_cast<int64_t>(pool.active));
+            m[U("completed")] = json::value::number(static_cast<int64_t>(pool.completed));
+            m[U("rejected")] = json::value::number(static_cast<int64_t>(pool.rejected));
+            m[U("stolen")] = json::value::number(static_cast<int64_t>(pool.stolen));
+            executors[utility::conversions::to_string_t(pool.name)] = m;
         }
+        response[U("executors")] = executors;
+        co_return reply(status_codes::OK, response);
     }
 };
 
 // ============================================================================
 // AUTH CONTROLLER
 // ============================================================================
-class AuthController {
+class AuthController : public CoroutineController {
 private:
-    std::shared_ptr<Config::Database> database;
-
     static bool verifyPassword(const std::string& password, const std::string& storedHash) {
         return std::to_string(std::hash<std::string>{}(password)) == storedHash;
     }
 
 public:
-    explicit AuthController(std::shared_ptr<Config::Database> db) : database(std::move(db)) {}
-
-    void login(http_request request) {
-        // capture request by value to keep it valid inside the continuation
-        request.extract_json().then([this, request](pplx::task<json::value> task) mutable {
-            try {
-                json::value body = task.get();
-
-                if (!Utils::Request::hasField(body, "email") || !Utils::Request::hasField(body, "password")) {
-                    Utils::Response::sendError(request, status_codes::BadRequest, "Missing email or password");
-                    return;
-                }
-
-                std::string email = Utils::Request::getStringField(body, "email");
-                std::string password = Utils::Request::getStringField(body, "password");
-
-                FitnessDB::User user;
-                try {
-                    user = database->getUserByEmail(email);
-                } catch (...) {
-                    Utils::Response::sendError(request, status_codes::Unauthorized, "Invalid credentials");
-                    return;
-                }
-
-                if (!verifyPassword(password, user.password_hash)) {
-                    Utils::Response::sendError(request, status_codes::Unauthorized, "Invalid credentials");
-                    return;
-                }
-
-                user.last_login = time(nullptr);
-                database->updateUser(user);
-
-                std::string token = Utils::JWT::generateToken(user.id);
-
-                json::value response = json::value::object();
-                response[U("success")] = json::value::boolean(true);
-                response[U("token")] = json::value::string(utility::conversions::to_string_t(token));
-                response[U("userId")] = json::value::string(utility::conversions::to_string_t(user.id));
-
-                json::value userData = json::value::object();
-                userData[U("id")] = json::value::string(utility::conversions::to_string_t(user.id));
-                userData[U("username")] = json::value::string(utility::conversions::to_string_t(user.username));
-                userData[U("email")] = json::value::string(utility::conversions::to_string_t(user.email));
-                userData[U("fitnessLevel")] = json::value::number(user.fitness_level);
-                userData[U("experiencePoints")] = json::value::number(user.experience_points);
-
-                response[U("user")] = userData;
-                Utils::Response::sendJsonResponse(request, status_codes::OK, response);
-
-            } catch (const std::exception& e) {
-                Utils::Response::sendError(request, status_codes::InternalError, e.what());
-            }
-        }).wait(); // wait ensures the request lifetime is managed here (safe for typical REST handlers)
+    explicit AuthController(std::shared_ptr<Config::Database> db) : CoroutineController(std::move(db)) {}
+
+    Async::Response login(http_request request) {
+        std::string body = co_await request.extract_utf8string(true);
+        Credentials credentials = Utils::JsonReader::decode<Credentials>(body);
+
+        co_await Async::Executors::db();
+        std::optional<FitnessDB::User> found = database->tryGetUserByEmail(credentials.email);
+
+        // Hashing and token signing are CPU work, not database work.
+        co_await Async::Executors::cpu();
+        if (!found || !verifyPassword(credentials.password, found->password_hash)) {
+            throw Utils::HttpError(status_codes::Unauthorized, "Invalid credentials");
+        }
+        FitnessDB::User& user = *found;
+
+        // last_login is low value: write-behind, no commit on the login path
+        user.last_login = time(nullptr);
+        time_t lastLogin = user.last_login;
+        database->updateUserDeferred(user.id, [lastLogin](FitnessDB::User& u) { u.last_login = lastLogin; });
+
+        std::string token = Utils::JWT::generateToken(user.id);
+
+        json::value response = json::value::object();
+        response[U("success")] = json::value::boolean(true);
+        response[U("token")] = json::value::string(utility::conversions::to_string_t(token));
+        response[U("userId")] = json::value::string(utility::conversions::to_string_t(user.id));
+
+        json::value userData = json::value::object();
+        userData[U("id")] = json::value::string(utility::conversions::to_string_t(user.id));
+        userData[U("username")] = json::value::string(utility::conversions::to_string_t(user.username));
+        userData[U("email")] = json::value::string(utility::conversions::to_string_t(user.email));
+        userData[U("fitnessLevel")] = json::value::number(user.fitness_level);
+        userData[U("experiencePoints")] = json::value::number(user.experience_points);
+
+        response[U("user")] = userData;
+        co_return reply(status_codes::OK, response);
     }
 };
 
 // ============================================================================
 // USER CONTROLLER
 // ============================================================================
-class UserController {
-private:
-    std::shared_ptr<Config::Database> database;
-
+class UserController : public CoroutineController {
 public:
-    explicit UserController(std::shared_ptr<Config::Database> db) : database(std::move(db)) {}
-
-    void createUser(http_request request) {
-        request.extract_json().then([this, request](pplx::task<json::value> task) mutable {
-            try {
-                json::value body = task.get();
+    explicit UserController(std::shared_ptr<Config::Database> db) : CoroutineController(std::move(db)) {}
 
-                std::string username = Utils::Request::getStringField(body, "username");
-                std::string email = Utils::Request::getStringField(body, "email");
-                std::string password = Utils::Request::getStringField(body, "password");
+    Async::Response createUser(http_request request) {
+        json::value body = co_await request.extract_json();
 
-                if (!Utils::Validation::validateEmail(email)) {
-                    Utils::Response::sendError(request, status_codes::BadRequest, "Invalid email");
-                    return;
-                }
+        std::string username = Utils::Request::getStringField(body, "username");
+        std::string email = Utils::Request::getStringField(body, "email");
+        std::string password = Utils::Request::getStringField(body, "password");
 
-                if (!Utils::Validation::validateUsername(username)) {
-                    Utils::Response::sendError(request, status_codes::BadRequest, "Invalid username");
-                    return;
-                }
-
-                if (!Utils::Validation::validatePassword(password)) {
-                    Utils::Response::sendError(request, status_codes::BadRequest, "Password too short");
-                    return;
-                }
+        if (!Utils::Validation::validateEmail(email)) {
+            throw Utils::HttpError(status_codes::BadRequest, "Invalid email");
+        }
 
-                std::string userId = database->createUser(username, email, password);
-                std::string token = Utils::JWT::generateToken(userId);
+        if (!Utils::Validation::validateUsername(username)) {
+            throw Utils::HttpError(status_codes::BadRequest, "Invalid username");
+        }
 
-                json::value response = json::value::object();
-                response[U("success")] = json::value::boolean(true);
-                response[U("userId")] = json::value::string(utility::conversions::to_string_t(userId));
-                response[U("token")] = json::value::string(utility::conversions::to_string_t(token));
+        if (!Utils::Validation::validatePassword(password)) {
+            throw Utils::HttpError(status_codes::BadRequest, "Password too short");
+        }
 
-                Utils::Response::sendJsonResponse(request, status_codes::Created, response);
+        co_await Async::Executors::db();
+        std::string userId = database->createUser(username, email, password);
+        std::string token = Utils::JWT::generateToken(userId);
 
-            } catch (const std::exception& e) {
-                Utils::Response::sendError(request, status_codes::InternalError, e.what());
-            }
-        }).wait();
+        json::value response = json::value::object();
+        response[U("success")] = json::value::boolean(true);
+        response[U("userId")] = json::value::string(utility::conversions::to_string_t(userId));
+        response[U("token")] = json::value::string(utility::conversions::to_string_t(token));
+        co_return reply(status_codes::Created, response);
     }
 
-    void getUser(http_request request, const std::string& userId) {
-        try {
-            std::string token = Utils::Request::extractToken(request);
-            std::string tokenUserId = Utils::JWT::verifyToken(token);
-
-            if (tokenUserId != userId) {
-                Utils::Response::sendError(request, status_codes::Forbidden, "Access denied");
-                return;
-            }
-
-            FitnessDB::User user = database->getUser(userId);
+    // Parameters are taken by value: the frame outlives the caller's strings.
+    Async::Response getUser(http_request request, std::string userId) {
+        std::string tokenUserId = authenticate(request);
+        if (tokenUserId != userId) {
+            throw Utils::HttpError(status_codes::Forbidden, "Access denied");
+        }
 
-            json::value response = json::value::object();
-            response[U("success")] = json::value::boolean(true);
+        co_await Async::Executors::db();
+        std::optional<FitnessDB::User> found = database->tryGetUser(userId);
+        if (!found) {
+            // Valid token for a user that no longer exists
+            throw Utils::HttpError(status_codes::NotFound, "User not found");
+        }
+        const FitnessDB::User& user = *found;
 
-            json::value userData = json::value::object();
-            userData[U("id")] = json::value::string(utility::conversions::to_string_t(user.id));
-            userData[U("username")] = json::value::string(utility::conversions::to_string_t(user.username));
-            userData[U("email")] = json::value::string(utility::conversions::to_string_t(user.email));
-            userData[U("fitnessLevel")] = json::value::number(user.fitness_level);
-            userData[U("experiencePoints")] = json::value::number(user.experience_points);
+        json::value response = json::value::object();
+        response[U("success")] = json::value::boolean(true);
 
-            response[U("user")] = userData;
-            Utils::Response::sendJsonResponse(request, status_codes::OK, response);
+        json::value userData = json::value::object();
+        userData[U("id")] = json::value::string(utility::conversions::to_string_t(user.id));
+        userData[U("username")] = json::value::string(utility::conversions::to_string_t(user.username));
+        userData[U("email")] = json::value::string(utility::conversions::to_string_t(user.email));
+        userData[U("fitnessLevel")] = json::value::number(user.fitness_level);
+        userData[U("experiencePoints")] = json::value::number(user.experience_points);
 
-        } catch (const std::exception& e) {
-            Utils::Response::sendError(request, status_codes::InternalError, e.what());
-        }
+        response[U("user")] = userData;
+        co_return reply(status_codes::OK, response);
     }
 };
 
 // ============================================================================
 // WORKOUT CONTROLLER
 // ============================================================================
-class WorkoutController {
+class WorkoutController : public CoroutineController {
 private:
-    std::shared_ptr<Config::Database> database;
     std::shared_ptr<Services::RewardService> rewardService;
-
-    static Models::WorkoutType stringToWorkoutType(const std::string& typeStr) {
-        if (typeStr == "strength") return Models::WorkoutType::STRENGTH;
-        if (typeStr == "cardio") return Models::WorkoutType::CARDIO;
-        if (typeStr == "flexibility") return Models::WorkoutType::FLEXIBILITY;
-        if (typeStr == "meditation") return Models::WorkoutType::MEDITATION;
-        if (typeStr == "balance") return Models::WorkoutType::BALANCE;
-        if (typeStr == "core") return Models::WorkoutType::CORE;
-        return Models::WorkoutType::STRENGTH;
+    std::shared_ptr<Events::NotificationHub> notifications;
+
+    static void writeWorkout(Utils::JsonWriter& json, const FitnessDB::WorkoutSession& workout) {
+        json.beginObject();
+        json.field("id", workout.id);
+        json.field("userId", workout.user_id);
+        json.field("startTime", static_cast<int64_t>(workout.start_time));
+        json.field("endTime", static_cast<int64_t>(workout.end_time));
+        json.field("totalCalories", workout.total_calories);
+        json.endObject();
     }
 
 public:
-    explicit WorkoutController(std::shared_ptr<Config::Database> db)
-        : database(std::move(db)) {
+    WorkoutController(std::shared_ptr<Config::Database> db, std::shared_ptr<Events::NotificationHub> hub)
+        : CoroutineController(std::move(db)), notifications(std::move(hub)) {
         rewardService = std::make_shared<Services::RewardService>(database);
     }
 
-    void logWorkout(http_request request) {
-        request.extract_json().then([this, request](pplx::task<json::value> task) mutable {
-            try {
-                std::string token = Utils::Request::extractToken(request);
-                std::string userId = Utils::JWT::verifyToken(token);
-
-                json::value body = task.get();
-                std::string typeStr = Utils::Request::getStringField(body, "type");
-                double duration = Utils::Request::getDoubleField(body, "duration");
-                double intensity = Utils::Request::getDoubleField(body, "intensity");
-
-                std::optional<double> formScore;
-                if (Utils::Request::hasField(body, "formScore")) {
-                    formScore = Utils::Request::getDoubleField(body, "formScore");
-                }
-
-                Models::WorkoutType type = Models::stringToWorkoutType(typeStr);
-
-                // Validate
-                Models::Validation::validateWorkoutDuration(duration);
-                Models::Validation::validateIntensity(intensity);
-                if (formScore.has_value()) {
-                    Models::Validation::validateFormScore(formScore.value());
-                }
-
-                // Calculate rewards using RewardService
-                auto rewardBundle = rewardService->calculateWorkoutRewards(userId, type, duration, intensity, formScore);
-
-                // Update user
-                FitnessDB::User user = database->getUser(userId);
-                user.experience_points += rewardBundle.experience;
-                if (rewardBundle.levelUp) {
-                    user.fitness_level = rewardBundle.newLevel;
-                }
-                database->updateUser(user);
-
-                // Persist workout
-                std::string workoutId = database->startWorkout(userId);
-                database->completeWorkout(workoutId);
-
-                // Respond
-                json::value response = json::value::object();
-                response[U("success")] = json::value::boolean(true);
-                response[U("workoutId")] = json::value::string(utility::conversions::to_string_t(workoutId));
-
-                json::value rewards = json::value::object();
-                rewards[U("experience")] = json::value::number(rewardBundle.experience);
-                rewards[U("gold")] = json::value::number(rewardBundle.gold);
-                response[U("gameRewards")] = rewards;
-
-                if (rewardBundle.levelUp) {
-                    response[U("levelUp")] = json::value::boolean(true);
-                    response[U("newLevel")] = json::value::number(rewardBundle.newLevel);
-                }
-
-                response[U("message")] = json::value::string(utility::conversions::to_string_t(rewardBundle.message));
-                Utils::Response::sendJsonResponse(request, status_codes::Created, response);
-
-            } catch (const std::exception& e) {
-                Utils::Response::sendError(request, status_codes::InternalError, e.what());
-            }
-        }).wait();
-    }
+    Async::Response logWorkout(http_request request) {
+        std::string body = co_await request.extract_utf8string(true);
+        std::string userId = authenticate(request);
+        Models::Workout workout = Utils::JsonReader::decode<Models::Workout>(body);
 
-    void getWorkoutHistory(http_request request) {
+        // Validate
         try {
-            std::string token = Utils::Request::extractToken(request);
-            std::string userId = Utils::JWT::verifyToken(token);
-
-            // Database currently does not provide a paginated history API;
-            // We'll return all workouts for this user by scanning workout btree keys.
-            // Use the DB wrapper method getUserWorkouts if present.
-            std::vector<FitnessDB::WorkoutSession> workouts;
-            try {
-                // If Config::Database exposes getUserWorkouts wrapper, use it
-                workouts = database->getUserWorkouts(userId);
-            } catch (...) {
-                // Fall back to returning empty array if not available
-                workouts.clear();
-            }
-
-            json::value arr = json::value::array(static_cast<unsigned int>(workouts.size()));
-            for (size_t i = 0; i < workouts.size(); ++i) {
-                json::value w = json::value::object();
-                w[U("id")] = json::value::string(utility::conversions::to_string_t(workouts[i].id));
-                w[U("userId")] = json::value::string(utility::conversions::to_string_t(workouts[i].user_id));
-                w[U("startTime")] = json::value::number(static_cast<int64_t>(workouts[i].start_time));
-                w[U("endTime")] = json::value::number(static_cast<int64_t>(workouts[i].end_time));
-                w[U("totalCalories")] = json::value::number(workouts[i].total_calories);
-                arr[static_cast<unsigned int>(i)] = w;
-            }
+            Models::Validation::validateWorkout(workout);
+        } catch (const Models::ValidationException& e) {
+            throw Utils::HttpError(status_codes::BadRequest, "Field '" + e.getField() + "' " + e.what());
+        }
 
-            json::value response = json::value::object();
-            response[U("success")] = json::value::boolean(true);
-            response[U("workouts")] = arr;
-            Utils::Response::sendJsonResponse(request, status_codes::OK, response);
-        } catch (const std::exception& e) {
-            Utils::Response::sendError(request, status_codes::InternalError, e.what());
+        // Build the finished session up front
+        FitnessDB::WorkoutSession session;
+        session.user_id = userId;
+        session.end_time = time(nullptr);
+        session.start_time = session.end_time - static_cast<time_t>(workout.duration * 60);
+        if (!workout.exerciseId.empty()) {
+            session.exercises.push_back(workout.exerciseId);
+        }
+        session.total_calories = static_cast<int>(workout.caloriesBurned);
+        if (workout.formScore.has_value()) {
+            session.form_score = static_cast<float>(workout.formScore.value());
         }
-    }
 
-    void getWorkout(http_request request, const std::string& workoutId) {
-        try {
-            std::string token = Utils::Request::extractToken(request);
-            (void) Utils::JWT::verifyToken(token); // ensure token is valid
+        // Read, reward and record the workout as one commit
+        co_await Async::Executors::db();
+        Services::RewardBundle rewardBundle;
+        std::string workoutId;
+        {
+            auto txn = database->begin();
+            FitnessDB::User user = txn.getUser(userId);
+            rewardBundle = rewardService->calculateWorkoutRewards(user, workout.type, workout.duration,
+                                                                 workout.intensity, workout.formScore);
+            workoutId = txn.logWorkout(session, static_cast<int>(rewardBundle.experience),
+                                       rewardBundle.levelUp ? rewardBundle.newLevel : 0);
+            txn.commit();
+        }
+        notifications->publish(userId, {"workoutLogged", workoutId});
+        if (rewardBundle.levelUp) {
+            notifications->publish(userId, {"levelUp", std::to_string(rewardBundle.newLevel)});
+        }
 
-            FitnessDB::WorkoutSession workout = database->getWorkout(workoutId);
+        // Respond
+        Utils::JsonWriter json;
+        json.beginObject();
+        json.field("success", true);
+        json.field("workoutId", workoutId);
+
+        json.key("gameRewards");
+        json.beginObject();
+        json.field("experience", rewardBundle.experience);
+        json.field("gold", rewardBundle.gold);
+        json.endObject();
+
+        if (rewardBundle.levelUp) {
+            json.field("levelUp", true);
+            json.field("newLevel", rewardBundle.newLevel);
+        }
 
-            json::value workoutData = json::value::object();
-            workoutData[U("id")] = json::value::string(utility::conversions::to_string_t(workout.id));
-            workoutData[U("userId")] = json::value::string(utility::conversions::to_string_t(workout.user_id));
-            workoutData[U("startTime")] = json::value::number(static_cast<int64_t>(workout.start_time));
-            workoutData[U("endTime")] = json::value::number(static_cast<int64_t>(workout.end_time));
-            workoutData[U("totalCalories")] = json::value::number(workout.total_calories);
+        json.field("message", rewardBundle.message);
+        json.endObject();
+        co_return reply(status_codes::Created, json);
+    }
 
-            json::value response = json::value::object();
-            response[U("success")] = json::value::boolean(true);
-            response[U("workout")] = workoutData;
+    Async::Response getWorkoutHistory(http_request request) {
+        std::string userId = authenticate(request);
+
+        co_await Async::Executors::db();
+        std::vector<FitnessDB::WorkoutSession> workouts = database->getUserWorkouts(userId);
+
+        // A long history is rendered on the cpu pool, off the db threads.
+        co_await Async::Executors::cpu();
+        Utils::JsonWriter json(64 + workouts.size() * 128);
+        json.beginObject();
+        json.field("success", true);
+        json.key("workouts");
+        json.beginArray();
+        for (const auto& workout : workouts) {
+            writeWorkout(json, workout);
+        }
+        json.endArray();
+        json.endObject();
+        co_return reply(status_codes::OK, json);
+    }
 
-            Utils::Response::sendJsonResponse(request, status_codes::OK, response);
-        } catch (const std::exception& e) {
-            Utils::Response::sendError(request, status_codes::NotFound, "Workout not found");
+    Async::Response getWorkout(http_request request, std::string workoutId) {
+        (void) authenticate(request); // ensure token is valid
+        co_await Async::Executors::db();
+        std::optional<FitnessDB::WorkoutSession> found = database->tryGetWorkout(workoutId);
+        if (!found) {
+            throw Utils::HttpError(status_codes::NotFound, "Workout not found");
         }
+
+        Utils::JsonWriter json;
+        json.beginObject();
+        json.field("success", true);
+        json.key("workout");
+        writeWorkout(json, *found);
+        json.endObject();
+        co_return reply(status_codes::OK, json);
     }
 };
 
 // ============================================================================
 // QUEST CONTROLLER
 // ============================================================================
-class QuestController {
+class QuestController : public CoroutineController {
 private:
-    std::shared_ptr<Config::Database> database;
+    Caching::ResponseCache catalogCache;
+    std::shared_ptr<Events::NotificationHub> notifications;
 
 public:
-    explicit QuestController(std::shared_ptr<Config::Database> db) : database(std::move(db)) {}
-
-    void getQuests(http_request request) {
-        try {
-            std::string token = Utils::Request::extractToken(request);
-            (void) Utils::JWT::verifyToken(token);
-
-            auto quests = database->getAllQuests();
-            json::value questsArray = json::value::array(static_cast<unsigned int>(quests.size()));
-
-            for (size_t i = 0; i < quests.size(); ++i) {
-                json::value q = json::value::object();
-                q[U("id")] = json::value::string(utility::conversions::to_string_t(quests[i].id));
-                q[U("title")] = json::value::string(utility::conversions::to_string_t(quests[i].title));
-                q[U("description")] = json::value::string(utility::conversions::to_string_t(quests[i].description));
-                q[U("difficulty")] = json::value::number(quests[i].difficulty);
-                q[U("completed")] = json::value::boolean(quests[i].completed);
-                questsArray[static_cast<unsigned int>(i)] = q;
-            }
-
-            json::value response = json::value::object();
-            response[U("success")] = json::value::boolean(true);
-            response[U("quests")] = questsArray;
+    QuestController(std::shared_ptr<Config::Database> db, std::shared_ptr<Events::NotificationHub> hub)
+        : CoroutineController(std::move(db)), notifications(std::move(hub)) {}
+
+    // The catalog rarely changes: a client holding the current version gets
+    // a 304, anyone else the body rendered for that version, and only the
+    // first request after a change reaches the database.
+    Async::Response getQuests(http_request request) {
+        (void) authenticate(request);
+
+        const std::string route = "/api/quests";
+        uint64_t version = database->catalogVersion();
+        if (auto cached = fromCache(request, catalogCache, route, version)) {
+            co_return std::move(*cached);
+        }
 
-            Utils::Response::sendJsonResponse(request, status_codes::OK, response);
-        } catch (const std::exception& e) {
-            Utils::Response::sendError(request, status_codes::InternalError, e.what());
+        co_await Async::Executors::db();
+        auto quests = database->getAllQuests();
+
+        co_await Async::Executors::cpu();
+        Utils::JsonWriter json(64 + quests.size() * 192);
+        json.beginObject();
+        json.field("success", true);
+        json.key("quests");
+        json.beginArray();
+        for (const auto& quest : quests) {
+            json.beginObject();
+            json.field("id", quest.id);
+            json.field("title", quest.title);
+            json.field("description", quest.description);
+            json.field("difficulty", quest.difficulty);
+            json.field("completed", quest.completed);
+            json.endObject();
         }
+        json.endArray();
+        json.endObject();
+        co_return reply(status_codes::OK, *catalogCache.store(route, version, json.take()));
     }
 
-    void getQuest(http_request request, const std::string& questId) {
-        try {
-            std::string token = Utils::Request::extractToken(request);
-            (void) Utils::JWT::verifyToken(token);
-
-            FitnessDB::Quest quest = database->getQuest(questId);
+    Async::Response getQuest(http_request request, std::string questId) {
+        (void) authenticate(request);
+        co_await Async::Executors::db();
+        std::optional<FitnessDB::Quest> found = database->tryGetQuest(questId);
+        if (!found) {
+            throw Utils::HttpError(status_codes::NotFound, "Quest not found");
+        }
+        const FitnessDB::Quest& quest = *found;
 
-            json::value questData = json::value::object();
-            questData[U("id")] = json::value::string(utility::conversions::to_string_t(quest.id));
-            questData[U("title")] = json::value::string(utility::conversions::to_string_t(quest.title));
-            questData[U("description")] = json::value::string(utility::conversions::to_string_t(quest.description));
-            questData[U("completed")] = json::value::boolean(quest.completed);
+        json::value questData = json::value::object();
+        questData[U("id")] = json::value::string(utility::conversions::to_string_t(quest.id));
+        questData[U("title")] = json::value::string(utility::conversions::to_string_t(quest.title));
+        questData[U("description")] = json::value::string(utility::conversions::to_string_t(quest.description));
+        questData[U("completed")] = json::value::boolean(quest.completed);
 
-            json::value response = json::value::object();
-            response[U("success")] = json::value::boolean(true);
-            response[U("quest")] = questData;
+        json::value response = json::value::object();
+        response[U("success")] = json::value::boolean(true);
+        response[U("quest")] = questData;
+        co_return reply(status_codes::OK, response);
+    }
 
-            Utils::Response::sendJsonResponse(request, status_codes::OK, response);
-        } catch (const std::exception& e) {
-            Utils::Response::sendError(request, status_codes::NotFound, "Quest not found");
+    Async::Response completeQuest(http_request request) {
+        json::value body = co_await request.extract_json();
+        std::string userId = authenticate(request);
+        std::string questId = Utils::Request::getStringField(body, "questId");
+
+        co_await Async::Executors::db();
+        {
+            auto txn = database->begin();
+            FitnessDB::Quest quest = txn.getQuest(questId);
+            quest.completed = true;
+            txn.updateQuest(quest);
+
+            int64_t xp = static_cast<int64_t>(quest.difficulty) * 50;
+            FitnessDB::User user = txn.getUser(userId);
+            user.experience_points += xp;
+            txn.updateUser(user);
+            txn.commit();
         }
-    }
+        notifications->publish(userId, {"questCompleted", questId});
 
-    void completeQuest(http_request request) {
-        request.extract_json().then([this, request](pplx::task<json::value> task) mutable {
-            try {
-                std::string userId = Utils::JWT::verifyToken(Utils::Request::extractToken(request));
-                json::value body = task.get();
-                std::string questId = Utils::Request::getStringField(body, "questId");
-
-                FitnessDB::Quest quest = database->getQuest(questId);
-                quest.completed = true;
-                // addQuest behaves as insert/update (CompleteBTree::insert replaces existing key).
-                database->addQuest(quest);
-
-                int64_t xp = static_cast<int64_t>(quest.difficulty) * 50;
-                FitnessDB::User user = database->getUser(userId);
-                user.experience_points += xp;
-                database->updateUser(user);
-
-                json::value response = json::value::object();
-                response[U("success")] = json::value::boolean(true);
-                response[U("message")] = json::value::string(U("Quest completed!"));
-
-                Utils::Response::sendJsonResponse(request, status_codes::OK, response);
-            } catch (const std::exception& e) {
-                Utils::Response::sendError(request, status_codes::InternalError, e.what());
-            }
-        }).wait();
+        json::value response = json::value::object();
+        response[U("success")] = json::value::boolean(true);
+        response[U("message")] = json::value::string(U("Quest completed!"));
+        co_return reply(status_codes::OK, response);
     }
 };
 
 // ============================================================================
 // GAME CONTROLLER
 // ============================================================================
-class GameController {
+class GameController : public CoroutineController {
 private:
-    std::shared_ptr<Config::Database> database;
     std::shared_ptr<GameSync::GameSyncEngine> syncEngine;
+    Caching::ResponseCache catalogCache;
+    Caching::ResponseCache stateCache;   // per user: "<route>:<userId>"
+    std::shared_ptr<Events::NotificationHub> notifications;
+    std::chrono::seconds eventsTimeout;
+
+    static uint64_t parseVersion(const std::string& text) {
+        uint64_t version = 0;
+        auto result = std::from_chars(text.data(), text.data() + text.size(), version);
+        if (text.empty() || result.ec != std::errc() || result.ptr != text.data() + text.size()) {
+            throw Utils::HttpError(status_codes::BadRequest, "Invalid since version: " + text);
+        }
+        return version;
+    }
 
-public:
-    GameController(std::shared_ptr<Config::Database> db, std::shared_ptr<GameSync::GameSyncEngine> engine)
-        : database(std::move(db)), syncEngine(std::move(engine)) {}
-
-    void syncGameState(http_request request) {
-        try {
-            std::string userId = Utils::JWT::verifyToken(Utils::Request::extractToken(request));
-            auto gameState = syncEngine->getPlayerGameState(userId);
+    static void writeLists(Utils::JsonWriter& json, std::string_view name,
+                           const std::map<std::string, std::vector<std::string>>& lists) {
+        if (lists.empty()) return;
+        json.key(name);
+        json.beginObject();
+        for (const auto& [list, entries] : lists) {
+            json.key(list);
+            json.beginArray();
+            for (const auto& entry : entries) json.value(entry);
+            json.endArray();
+        }
+        json.endObject();
+    }
 
-            json::value state = json::value::object();
-            for (const auto& kv : gameState) {
-                state[utility::conversions::to_string_t(kv.first)] = json::value::number(kv.second);
+    // Sections that did not change are left out; a full state lists every
+    // field in "gameState" and every entry under "added".
+    static void writeDelta(Utils::JsonWriter& json, const GameSync::StateDelta& delta,
+                           const std::vector<Events::Event>& events = {}) {
+        json.beginObject();
+        json.field("success", true);
+        json.field("version", delta.version);
+        json.field("full", delta.full);
+        if (delta.full || !delta.fields.empty()) {
+            json.key("gameState");
+            json.beginObject();
+            for (const auto& [name, value] : delta.fields) json.field(name, value);
+            json.endObject();
+        }
+        writeLists(json, "added", delta.added);
+        writeLists(json, "removed", delta.removed);
+        if (!events.empty()) {
+            json.key("events");
+            json.beginArray();
+            for (const auto& event : events) {
+                json.beginObject();
+                json.field("type", event.type);
+                json.field("detail", event.detail);
+                json.endObject();
             }
+            json.endArray();
+        }
+        json.endObject();
+    }
 
-            json::value response = json::value::object();
-            response[U("success")] = json::value::boolean(true);
-            response[U("gameState")] = state;
+    // The ?since=<version> a client passed, if any.
+    static std::optional<uint64_t> sinceVersion(http_request& request) {
+        auto query = uri::split_query(request.request_uri().query());
+        auto since = query.find(U("since"));
+        if (since == query.end()) return std::nullopt;
+        return parseVersion(utility::conversions::to_utf8string(since->second));
+    }
 
-            Utils::Response::sendJsonResponse(request, status_codes::OK, response);
-        } catch (const std::exception& e) {
-            Utils::Response::sendError(request, status_codes::InternalError, e.what());
+public:
+    GameController(std::shared_ptr<Config::Database> db, std::shared_ptr<GameSync::GameSyncEngine> engine)
+        : CoroutineController(std::move(db)), syncEngine(std::move(engine)),
+          stateCache(static_cast<size_t>(std::max(1, Config::Environment::getStateCacheEntries()))),
+          notifications(syncEngine->notifications()),
+          eventsTimeout(std::max(0, Config::Environment::getEventsTimeoutSeconds())) {}
+
+    // Clients poll state and stats; a poll between two writes to the user is
+    // answered from memory (or with a 304) at the user's current version.
+    //
+    // With ?since=<version> (the "version" of an earlier reply) only what
+    // changed after it is sent; an unchanged player costs a few bytes.
+    Async::Response syncGameState(http_request request) {
+        std::string userId = authenticate(request);
+
+        if (auto since = sinceVersion(request)) {
+            co_await Async::Executors::db();
+            GameSync::StateDelta delta = syncEngine->getGameStateSince(userId, *since);
+
+            Utils::JsonWriter json(delta.full ? 512 : 96);
+            writeDelta(json, delta);
+            co_return reply(status_codes::OK, json);
+        }
+
+        std::string key = "/api/game/state:" + userId;
+        uint64_t version = database->userVersion(userId);
+        if (auto cached = fromCache(request, stateCache, key, version)) {
+            co_return std::move(*cached);
         }
+
+        co_await Async::Executors::db();
+        GameSync::StateDelta state = syncEngine->getGameStateSince(userId, 0);
+
+        Utils::JsonWriter json(512);
+        writeDelta(json, state);
+        co_return reply(status_codes::OK, *stateCache.store(key, version, json.take()));
     }
 
-    void getPlayerStats(http_request request) {
-        try {
-            std::string userId = Utils::JWT::verifyToken(Utils::Request::extractToken(request));
-            FitnessDB::User user = database->getUser(userId);
+    // Long poll for the same deltas: answers at once if the player changed
+    // after `since`, otherwise when a change is published (with "events"
+    // saying what happened) or, empty, after EVENTS_TIMEOUT_SECONDS.
+    // Clients send the returned version back and ask again. A held request
+    // is a parked coroutine and occupies no thread.
+    Async::Response waitForEvents(http_request request) {
+        std::string userId = authenticate(request);
+        uint64_t since = sinceVersion(request).value_or(0);
+
+        // Subscribed before reading, so a change between the read and the
+        // wait still wakes it.
+        Events::NotificationHub::Subscription subscription(*notifications, userId);
+        co_await Async::Executors::db();
+        GameSync::StateDelta delta = syncEngine->getGameStateSince(userId, since);
+
+        std::vector<Events::Event> events;
+        if (!delta.full && delta.empty()) {
+            events = co_await subscription.next(eventsTimeout);
+            if (!events.empty()) {
+                co_await Async::Executors::db();
+                delta = syncEngine->getGameStateSince(userId, since);
+            }
+        }
 
-            json::value stats = json::value::object();
-            stats[U("level")] = json::value::number(user.fitness_level);
-            stats[U("xp")] = json::value::number(user.experience_points);
+        Utils::JsonWriter json(delta.full ? 512 : 128);
+        writeDelta(json, delta, events);
+        co_return reply(status_codes::OK, json);
+    }
 
-            json::value response = json::value::object();
-            response[U("success")] = json::value::boolean(true);
-            response[U("stats")] = stats;
+    Async::Response getPlayerStats(http_request request) {
+        std::string userId = authenticate(request);
 
-            Utils::Response::sendJsonResponse(request, status_codes::OK, response);
-        } catch (const std::exception& e) {
-            Utils::Response::sendError(request, status_codes::InternalError, e.what());
+        std::string key = "/api/game/stats:" + userId;
+        uint64_t version = database->userVersion(userId);
+        if (auto cached = fromCache(request, stateCache, key, version)) {
+            co_return std::move(*cached);
         }
+
+        co_await Async::Executors::db();
+        Utils::JsonWriter json(96);
+        json.beginObject();
+        json.field("success", true);
+        json.key("stats");
+        json.beginObject();
+        database->withUser(userId, [&json](const FitnessDB::CompactUser& user) {
+            json.field("level", user.fitness_level);
+            json.field("xp", user.experience_points);
+        });
+        json.endObject();
+        json.endObject();
+        co_return reply(status_codes::OK, *stateCache.store(key, version, json.take()));
     }
 
-    void getAvailableQuests(http_request request) {
-        try {
-            std::string userId = Utils::JWT::verifyToken(Utils::Request::extractToken(request));
-            auto quests = syncEngine->getAvailableQuests(userId); // vector<map<string,string>>
-
-            json::value arr = json::value::array(static_cast<unsigned int>(quests.size()));
-            for (size_t i = 0; i < quests.size(); ++i) {
-                json::value q = json::value::object();
-                const auto& qm = quests[i];
-                if (qm.find("id") != qm.end()) q[U("id")] = json::value::string(utility::conversions::to_string_t(qm.at("id")));
-                if (qm.find("title") != qm.end()) q[U("title")] = json::value::string(utility::conversions::to_string_t(qm.at("title")));
-                if (qm.find("description") != qm.end()) q[U("description")] = json::value::string(utility::conversions::to_string_t(qm.at("description")));
-                if (qm.find("difficulty") != qm.end()) q[U("difficulty")] = json::value::number(std::stoi(qm.at("difficulty")));
-                if (qm.find("priority") != qm.end()) q[U("priority")] = json::value::number(std::stoi(qm.at("priority")));
-                arr[static_cast<unsigned int>(i)] = q;
-            }
+    // Available quests depend only on the catalog; cached like getQuests.
+    // The default quest sent when the catalog can't be read is not cached,
+    // so the next request tries the catalog again.
+    Async::Response getAvailableQuests(http_request request) {
+        std::string userId = authenticate(request);
 
-            json::value response = json::value::object();
-            response[U("success")] = json::value::boolean(true);
-            response[U("quests")] = arr;
+        const std::string route = "/api/game/quests";
+        uint64_t version = database->catalogVersion();
+        if (auto cached = fromCache(request, catalogCache, route, version)) {
+            co_return std::move(*cached);
+        }
 
-            Utils::Response::sendJsonResponse(request, status_codes::OK, response);
-        } catch (const std::exception& e) {
-            Utils::Response::sendError(request, status_codes::InternalError, e.what());
+        co_await Async::Executors::db();
+        bool fallback = false;
+        auto quests = syncEngine->getAvailableQuests(userId, &fallback); // vector<map<string,string>>
+
+        co_await Async::Executors::cpu();
+        Utils::JsonWriter json(64 + quests.size() * 192);
+        json.beginObject();
+        json.field("success", true);
+        json.key("quests");
+        json.beginArray();
+        for (const auto& qm : quests) {
+            json.beginObject();
+            if (qm.find("id") != qm.end()) json.field("id", qm.at("id"));
+            if (qm.find("title") != qm.end()) json.field("title", qm.at("title"));
+            if (qm.find("description") != qm.end()) json.field("description", qm.at("description"));
+            if (qm.find("difficulty") != qm.end()) json.field("difficulty", std::stoi(qm.at("difficulty")));
+            if (qm.find("priority") != qm.end()) json.field("priority", std::stoi(qm.at("priority")));
+            json.endObject();
         }
+        json.endArray();
+        json.endObject();
+        if (fallback) {
+            co_return reply(status_codes::OK, json);
+        }
+        co_return reply(status_codes::OK, *catalogCache.store(route, version, json.take()));
     }
 
-    void getLeaderboard(http_request request) {
-        try {
-            (void) Utils::JWT::verifyToken(Utils::Request::extractToken(request));
-
-            // Build a simple leaderboard by scanning users (not ideal for large DBs)
-            auto stats = database->getStats();
-            std::vector<std::pair<std::string, int>> entries; // (userId, xp)
-
-            // If Config::Database provided a get_all_users or similar, use it. Otherwise we return empty.
-            try {
-                // Attempt to collect users if wrapper exists
-                // This block intentionally left minimal — implement getAllUsers in DB for proper leaderboard.
-            } catch (...) {}
-
-            json::value arr = json::value::array(static_cast<unsigned int>(entries.size()));
-            for (size_t i = 0; i < entries.size(); ++i) {
-                json::value e = json::value::object();
-                e[U("userId")] = json::value::string(utility::conversions::to_string_t(entries[i].first));
-                e[U("xp")] = json::value::number(entries[i].second);
-                arr[static_cast<unsigned int>(i)] = e;
-            }
+    Async::Response getLeaderboard(http_request request) {
+        (void) authenticate(request);
+
+        // Build a simple leaderboard by scanning users (not ideal for large DBs)
+        co_await Async::Executors::db();
+        auto stats = database->getStats();
+        std::vector<std::pair<std::string, int>> entries; // (userId, xp)
 
-            json::value response = json::value::object();
-            response[U("success")] = json::value::boolean(true);
-            response[U("leaderboard")] = arr;
-            Utils::Response::sendJsonResponse(request, status_codes::OK, response);
-        } catch (const std::exception& e) {
-            Utils::Response::sendError(request, status_codes::InternalError, e.what());
+        // If Config::Database provided a get_all_users or similar, use it. Otherwise we return empty.
+        try {
+            // Attempt to collect users if wrapper exists
+            // This block intentionally left minimal — implement getAllUsers in DB for proper leaderboard.
+        } catch (...) {}
+
+        json::value arr = json::value::array(static_cast<unsigned int>(entries.size()));
+        for (size_t i = 0; i < entries.size(); ++i) {
+            json::value e = json::value::object();
+            e[U("userId")] = json::value::string(utility::conversions::to_string_t(entries[i].first));
+            e[U("xp")] = json::value::number(entries[i].second);
+            arr[static_cast<unsigned int>(i)] = e;
         }
+
+        json::value response = json::value::object();
+        response[U("success")] = json::value::boolean(true);
+        response[U("leaderboard")] = arr;
+        co_return reply(status_codes::OK, response);
     }
 
-    void claimReward(http_request request) {
-        request.extract_json().then([this, request](pplx::task<json::value> task) mutable {
-            try {
-                std::string userId = Utils::JWT::verifyToken(Utils::Request::extractToken(request));
-                json::value body = task.get();
-                std::string rewardId = Utils::Request::getStringField(body, "rewardId");
-
-                // Reward claiming logic is application-specific.
-                // Hook into RewardService (not exposed here) or implement custom logic.
-                json::value response = json::value::object();
-                response[U("success")] = json::value::boolean(true);
-                response[U("message")] = json::value::string(U("Reward claimed"));
-
-                Utils::Response::sendJsonResponse(request, status_codes::OK, response);
-            } catch (const std::exception& e) {
-                Utils::Response::sendError(request, status_codes::InternalError, e.what());
-            }
-        }).wait();
+    Async::Response claimReward(http_request request) {
+        json::value body = co_await request.extract_json();
+        std::string userId = authenticate(request);
+        std::string rewardId = Utils::Request::getStringField(body, "rewardId");
+
+        // Reward claiming logic is application-specific.
+        // Hook into RewardService (not exposed here) or implement custom logic.
+        json::value response = json::value::object();
+        response[U("success")] = json::value::boolean(true);
+        response[U("message")] = json::value::string(U("Reward claimed"));
+        co_return reply(status_codes::OK, response);
     }
 };
 
@@ -0,0 +1,131 @@
+// ============================================================================
+// COROUTINES.HPP - co_await adapters for pplx tasks and executor pools
+// ============================================================================
+
+#ifndef FITNESS_QUEST_COROUTINES_HPP
+#define FITNESS_QUEST_COROUTINES_HPP
+
+#include <cpprest/http_listener.h>
+#include <cpprest/json.h>
+#include <coroutine>
+#include <exception>
+#include <string>
+#include <utility>
+
+#include "executor.hpp"
+#include "utils.hpp"
+
+// co_await on a pplx task suspends until it completes and resumes on the
+// thread that completed it. Found by ADL, so it lives next to the task.
+namespace pplx {
+
+template <typename T>
+auto operator co_await(task<T> pending) {
+    struct Awaiter {
+        task<T> pending;
+
+        bool await_ready() const { return pending.is_done(); }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            pending.then([handle](task<T>) { handle.resume(); });
+        }
+
+        decltype(auto) await_resume() { return pending.get(); }
+    };
+    return Awaiter{std::move(pending)};
+}
+
+} // namespace pplx
+
+namespace FitnessQuest {
+namespace Async {
+
+// ============================================================================
+// EXECUTOR HOPS
+// ============================================================================
+
+// `co_await Executors::db();` continues the coroutine on a db worker. The
+// handle fits std::function's inline storage; the only allocation left is
+// the pool's deque growing a block, about once every 16 hops (see
+// benchmarkExecutorHops). A full pool throws HttpError(503) out of the
+// co_await.
+inline auto operator co_await(Executor& executor) {
+    struct Awaiter {
+        Executor& executor;
+
+        bool await_ready() const { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            executor.post([handle]() { handle.resume(); });
+        }
+
+        void await_resume() const {}
+    };
+    return Awaiter{executor};
+}
+
+// ============================================================================
+// RESPONSE COROUTINES
+// ============================================================================
+
+struct Reply {
+    status_code code;
+    web::json::value body;
+    std::string text;   // body already serialized by a JsonWriter; wins over `body`
+    std::string etag;   // sent with `text`; a NotModified reply sends only this
+};
+
+// Return type for request handlers. The promise keeps the http_request it
+// was called with and answers it when the handler finishes: co_return
+// sends the Reply, and an exception sends an HttpError's status or 500.
+// The handler's frame is freed as soon as the reply is out.
+class Response {
+public:
+    class promise_type {
+    private:
+        http_request request;
+
+        void bind(http_request& r) { request = r; }
+        template <typename Arg>
+        void bind(Arg&) {}
+
+    public:
+        template <typename... Args>
+        explicit promise_type(Args&... args) {
+            (bind(args), ...);
+        }
+
+        Response get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+
+        void return_value(Reply reply) {
+            if (reply.code == status_codes::NotModified) {
+                Utils::Response::sendNotModified(request, reply.etag);
+            } else if (!reply.text.empty()) {
+                Utils::Response::sendJsonText(request, reply.code, std::move(reply.text), reply.etag);
+            } else {
+                Utils::Response::sendJsonResponse(request, reply.code, reply.body);
+            }
+        }
+
+        void unhandled_exception() noexcept {
+            try {
+                try {
+                    throw;
+                } catch (const Utils::HttpError& e) {
+                    Utils::Response::sendError(request, e.status(), e.what());
+                } catch (const std::exception& e) {
+                    Utils::Response::sendError(request, status_codes::InternalError, e.what());
+                }
+            } catch (...) {
+                // The reply itself failed; nothing is left to tell the client.
+            }
+        }
+    };
+};
+
+} // namespace Async
+} // namespace FitnessQuest
+
+#endif // FITNESS_QUEST_COROUTINES_HPP
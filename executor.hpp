@@ -0,0 +1,269 @@
+// ============================================================================
+// EXECUTOR.HPP - Named worker pools for request work (io, db, cpu)
+// ============================================================================
+
+#ifndef FITNESS_QUEST_EXECUTOR_HPP
+#define FITNESS_QUEST_EXECUTOR_HPP
+
+#include <cpprest/http_listener.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "config.hpp"
+#include "utils.hpp"
+
+namespace FitnessQuest {
+namespace Async {
+
+// ============================================================================
+// EXECUTOR
+// ============================================================================
+
+struct ExecutorOptions {
+    size_t threads = 0;        // 0 = one per core
+    size_t queueLimit = 1024;  // tasks waiting to start before post() refuses
+};
+
+struct ExecutorMetrics {
+    std::string name;
+    size_t threads = 0;
+    size_t queueLimit = 0;
+    size_t queued = 0;
+    size_t peakQueued = 0;
+    size_t active = 0;
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    uint64_t rejected = 0;
+    uint64_t stolen = 0;
+};
+
+// Work-stealing pool. Every worker owns a deque: tasks posted from one of
+// the pool's own threads go to that thread's deque, outside posts are
+// spread round-robin. A worker runs its own deque oldest first and, when
+// it is empty, steals the newest task from a sibling, so one slow request
+// does not hold up the tasks queued behind it. The queue is bounded; a
+// full pool refuses new work with a 503 instead of letting latency grow.
+class Executor {
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+        std::thread thread;
+    };
+
+    std::string poolName;
+    size_t limit;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    std::atomic<size_t> pending{0};     // posted, not yet started (bounded)
+    std::atomic<size_t> available{0};   // sitting in a deque
+    std::atomic<size_t> peak{0};
+    std::atomic<size_t> running{0};
+    std::atomic<size_t> nextWorker{0};
+    std::atomic<uint64_t> submitted{0};
+    std::atomic<uint64_t> completed{0};
+    std::atomic<uint64_t> rejected{0};
+    std::atomic<uint64_t> stolen{0};
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    inline static thread_local const Executor* currentPool = nullptr;
+    inline static thread_local size_t currentWorker = 0;
+
+    bool take(Worker& worker, std::function<void()>& task, bool steal) {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty()) return false;
+        if (steal) {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+        } else {
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+        }
+        available--;
+        pending--;
+        return true;
+    }
+
+    bool next(size_t self, std::function<void()>& task) {
+        if (take(*workers[self], task, false)) return true;
+        for (size_t i = 1; i < workers.size(); i++) {
+            if (take(*workers[(self + i) % workers.size()], task, true)) {
+                stolen++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(size_t self) {
+        currentPool = this;
+        currentWorker = self;
+        for (;;) {
+            std::function<void()> task;
+            if (!next(self, task)) {
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                wake.wait(lock, [this]() { return stopping || available.load() > 0; });
+                if (stopping && available.load() == 0) return;
+                continue;
+            }
+
+            running++;
+            try {
+                task();
+            } catch (...) {
+                // submit() captures its own exceptions; bare post()s may not.
+            }
+            running--;
+            completed++;
+        }
+    }
+
+public:
+    Executor(std::string name, ExecutorOptions options)
+        : poolName(std::move(name)), limit(std::max<size_t>(1, options.queueLimit)) {
+        size_t threads = options.threads;
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t i = 0; i < threads; i++) {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < threads; i++) {
+            workers[i]->thread = std::thread(&Executor::workerLoop, this, i);
+        }
+    }
+
+    // Runs what is already queued, then joins.
+    ~Executor() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker->thread.join();
+    }
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    // Throws HttpError(503) when the queue is full.
+    void post(std::function<void()> task) {
+        size_t depth = pending.fetch_add(1) + 1;
+        if (depth > limit) {
+            pending--;
+            rejected++;
+            throw Utils::HttpError(status_codes::ServiceUnavailable, "Server busy: " + poolName + " queue is full");
+        }
+        size_t high = peak.load();
+        while (depth > high && !peak.compare_exchange_weak(high, depth)) {}
+
+        Worker& target = currentPool == this ? *workers[currentWorker]
+                                             : *workers[nextWorker++ % workers.size()];
+        {
+            // Under sleepMutex so a worker cannot miss the task on its way
+            // to sleep, or exit past it during shutdown.
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            if (stopping && currentPool != this) {
+                pending--;
+                throw std::runtime_error("Executor " + poolName + " is shutting down");
+            }
+            std::lock_guard<std::mutex> workerLock(target.mutex);
+            target.tasks.push_back(std::move(task));
+            available++;
+        }
+        submitted++;
+        wake.notify_one();
+    }
+
+    // Runs `fn` on a worker; the task completes with its result or exception.
+    template <typename F>
+    auto submit(F fn) -> pplx::task<std::invoke_result_t<F&>> {
+        using Result = std::invoke_result_t<F&>;
+        static_assert(!std::is_void<Result>::value, "submit() needs a result; use post() for void work");
+
+        pplx::task_completion_event<Result> done;
+        post([done, fn = std::move(fn)]() mutable {
+            try {
+                done.set(fn());
+            } catch (...) {
+                done.set_exception(std::current_exception());
+            }
+        });
+        return pplx::create_task(done);
+    }
+
+    const std::string& name() const { return poolName; }
+    size_t threadCount() const { return workers.size(); }
+
+    ExecutorMetrics metrics() const {
+        ExecutorMetrics m;
+        m.name = poolName;
+        m.threads = workers.size();
+        m.queueLimit = limit;
+        m.queued = pending.load();
+        m.peakQueued = peak.load();
+        m.active = running.load();
+        m.submitted = submitted.load();
+        m.completed = completed.load();
+        m.rejected = rejected.load();
+        m.stolen = stolen.load();
+        return m;
+    }
+};
+
+// ============================================================================
+// NAMED POOLS
+// ============================================================================
+
+// io: cheap handlers that must stay responsive (health), never queued
+//     behind database work.
+// db: anything that reads or writes the database.
+// cpu: password hashing, token signing and rendering of large bodies.
+// Sized by EXECUTOR_<POOL>_THREADS and EXECUTOR_<POOL>_QUEUE.
+class Executors {
+private:
+    static ExecutorOptions options(const std::string& pool, size_t threads, size_t queueLimit) {
+        ExecutorOptions opts;
+        opts.threads = static_cast<size_t>(std::max(0, Config::Environment::getExecutorThreads(pool, static_cast<int>(threads))));
+        opts.queueLimit = static_cast<size_t>(std::max(1, Config::Environment::getExecutorQueueLimit(pool, static_cast<int>(queueLimit))));
+        return opts;
+    }
+
+public:
+    static Executor& io() {
+        static Executor pool("io", options("io", 2, 256));
+        return pool;
+    }
+
+    static Executor& db() {
+        static Executor pool("db", options("db", 0, 1024));
+        return pool;
+    }
+
+    static Executor& cpu() {
+        static Executor pool("cpu", options("cpu", 0, 1024));
+        return pool;
+    }
+
+    static std::vector<ExecutorMetrics> metrics() {
+        return {io().metrics(), db().metrics(), cpu().metrics()};
+    }
+};
+
+} // namespace Async
+} // namespace FitnessQuest
+
+#endif // FITNESS_QUEST_EXECUTOR_HPP
@@ -1,6 +1,6 @@
 // ============================================================================
 // CORRECTED MAIN.CPP - FITNESS QUEST BACKEND (RENDER-READY)
-// Compile: g++ -std=c++17 -o fitness_quest main.cpp -lcpprest -lssl -lcrypto -pthread
+// Compile: g++ -std=c++20 -o fitness_quest main.cpp -lcpprest -lssl -lcrypto -pthread
 // ============================================================================
 
 #include <iostream>
@@ -26,12 +26,17 @@ using namespace web::http::experimental::listener;
 // Global variables
 std::unique_ptr<FitnessQuest::Routes::Router> router;
 std::unique_ptr<http_listener> listener;
+std::shared_ptr<FitnessQuest::Config::Database> database;
 
 void signalHandler(int signal) {
     std::cout << "\n⚠  Received signal " << signal << ", shutting down gracefully...\n";
     if (listener) {
         listener->close().wait();
     }
+    if (database) {
+        // exit() skips local destructors; drain queued writes explicitly.
+        database->disconnect();
+    }
     exit(0);
 }
 
@@ -51,7 +56,7 @@ int main(int argc, char* argv[]) {
         
         // Initialize database
         std::cout << "🗄️  Initializing database...\n";
-        auto database = std::make_shared<FitnessQuest::Config::Database>();
+        database = std::make_shared<FitnessQuest::Config::Database>();
         
         if (!database->connect()) {
             std::cerr << "❌ Failed to connect to database\n";
@@ -127,6 +132,7 @@ int main(int argc, char* argv[]) {
         std::cout << "  GET  /api/quests/{id}        - Get specific quest\n";
         std::cout << "  POST /api/quests/complete    - Complete a quest\n";
         std::cout << "  GET  /api/game/state         - Get game state\n";
+        std::cout << "  GET  /api/game/events        - Wait for game state changes\n";
         std::cout << "  GET  /api/game/stats         - Get player stats\n";
         std::cout << "  GET  /api/game/quests        - Get available quests\n";
         std::cout << "  GET  /api/game/leaderboard   - Get leaderboard\n";
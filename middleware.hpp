@@ -111,7 +111,8 @@ public:
     }
     
     static void sendJsonError(http_request request, status_code code, 
-                            const std::string& message) {
+                            const std::string& message,
+                            const std::map<std::string, std::string>& headers = {}) {
         Logger::logError("HTTP " + std::to_string(code) + ": " + message);
         
         json::value response = json::value::object();
@@ -120,11 +121,12 @@ public:
             utility::conversions::to_string_t(message)
         );
         
-        sendResponse(request, code, response);
+        sendResponse(request, code, response, headers);
     }
     
     static void sendResponse(http_request request, status_code code, 
-                            const json::value& body) {
+                            const json::value& body,
+                            const std::map<std::string, std::string>& headers = {}) {
         http_response http_resp(code);
         http_resp.headers().add(U("Content-Type"), U("application/json"));
         http_resp.headers().add(U("Access-Control-Allow-Origin"), U("*"));
@@ -132,6 +134,10 @@ public:
             U("GET, POST, PUT, DELETE, PATCH, OPTIONS"));
         http_resp.headers().add(U("Access-Control-Allow-Headers"), 
             U("Content-Type, Authorization"));
+        for (const auto& header : headers) {
+            http_resp.headers().add(utility::conversions::to_string_t(header.first),
+                                    utility::conversions::to_string_t(header.second));
+        }
         http_resp.set_body(body);
         
         Logger::logResponse(request, code);
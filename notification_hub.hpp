@@ -0,0 +1,196 @@
+// ============================================================================
+// NOTIFICATION_HUB.HPP - Per-user change notifications for long-poll clients
+// ============================================================================
+
+#ifndef FITNESS_QUEST_NOTIFICATION_HUB_HPP
+#define FITNESS_QUEST_NOTIFICATION_HUB_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace FitnessQuest {
+namespace Events {
+
+// Something that happened to a player ("levelUp", "questCompleted", ...).
+// Events only say that the state moved; clients read the state itself as
+// a delta, so an event missed between two waits loses nothing.
+struct Event {
+    std::string type;
+    std::string detail;   // new level, quest id, workout id
+};
+
+// Wakes coroutines waiting on a user when something is published for them.
+//
+// A waiter is parked as a bare coroutine handle, so an idle client holds
+// no thread and costs no CPU. One timer thread sleeps until the nearest
+// deadline and answers waits that time out. Waiters resume on the thread
+// that woke them (a publisher, after it drops the lock, or the timer), so
+// they should hop to a pool before doing real work.
+class NotificationHub {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Collects events for one user from construction on, so nothing
+    // published between subscribing and waiting is missed. Lives in the
+    // waiting coroutine's frame; the hub must outlive it.
+    class Subscription {
+    private:
+        friend class NotificationHub;
+
+        NotificationHub& hub;
+        std::string userId;
+        std::vector<Event> pending;
+        std::coroutine_handle<> parked;
+        std::multimap<Clock::time_point, Subscription*>::iterator deadline;
+
+    public:
+        Subscription(NotificationHub& owner, std::string user)
+            : hub(owner), userId(std::move(user)) {
+            hub.attach(*this);
+        }
+
+        ~Subscription() { hub.detach(*this); }
+
+        Subscription(const Subscription&) = delete;
+        Subscription& operator=(const Subscription&) = delete;
+
+        // `co_await subscription.next(timeout)` yields the events published
+        // since the last call, or an empty list once `timeout` passes.
+        auto next(Clock::duration timeout) {
+            struct Awaiter {
+                Subscription& subscription;
+                Clock::time_point until;
+
+                bool await_ready() const { return false; }
+
+                bool await_suspend(std::coroutine_handle<> handle) {
+                    return subscription.hub.park(subscription, handle, until);
+                }
+
+                std::vector<Event> await_resume() {
+                    std::lock_guard<std::mutex> lock(subscription.hub.mutex);
+                    return std::exchange(subscription.pending, {});
+                }
+            };
+            return Awaiter{*this, Clock::now() + timeout};
+        }
+    };
+
+private:
+    std::mutex mutex;
+    std::condition_variable timerWake;
+    std::unordered_map<std::string, std::vector<Subscription*>> subscribers;
+    std::multimap<Clock::time_point, Subscription*> deadlines;
+    size_t parkedCount = 0;
+    bool stopping = false;
+    std::thread timer;
+
+    void attach(Subscription& subscription) {
+        std::lock_guard<std::mutex> lock(mutex);
+        subscription.deadline = deadlines.end();
+        subscribers[subscription.userId].push_back(&subscription);
+    }
+
+    void detach(Subscription& subscription) {
+        std::lock_guard<std::mutex> lock(mutex);
+        unpark(subscription);
+        auto it = subscribers.find(subscription.userId);
+        if (it == subscribers.end()) return;
+        auto& list = it->second;
+        list.erase(std::remove(list.begin(), list.end(), &subscription), list.end());
+        if (list.empty()) subscribers.erase(it);
+    }
+
+    // Returns false (and does not suspend) when events are already waiting.
+    bool park(Subscription& subscription, std::coroutine_handle<> handle, Clock::time_point until) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!subscription.pending.empty()) return false;
+        subscription.parked = handle;
+        subscription.deadline = deadlines.emplace(until, &subscription);
+        parkedCount++;
+        if (subscription.deadline == deadlines.begin()) timerWake.notify_one();
+        return true;
+    }
+
+    // Caller holds the lock. The handle it returns is the caller's to resume.
+    std::coroutine_handle<> unpark(Subscription& subscription) {
+        if (!subscription.parked) return nullptr;
+        deadlines.erase(subscription.deadline);
+        subscription.deadline = deadlines.end();
+        parkedCount--;
+        return std::exchange(subscription.parked, nullptr);
+    }
+
+    void timerLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            if (deadlines.empty()) {
+                timerWake.wait(lock);
+                continue;
+            }
+            // By value: the entry may be gone by the time the wait returns.
+            Clock::time_point next = deadlines.begin()->first;
+            if (timerWake.wait_until(lock, next) == std::cv_status::no_timeout) continue;
+
+            std::vector<std::coroutine_handle<>> expired;
+            auto now = Clock::now();
+            while (!deadlines.empty() && deadlines.begin()->first <= now) {
+                expired.push_back(unpark(*deadlines.begin()->second));
+            }
+            lock.unlock();
+            for (auto handle : expired) handle.resume();
+            lock.lock();
+        }
+    }
+
+public:
+    NotificationHub() : timer(&NotificationHub::timerLoop, this) {}
+
+    ~NotificationHub() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        timerWake.notify_one();
+        timer.join();
+    }
+
+    NotificationHub(const NotificationHub&) = delete;
+    NotificationHub& operator=(const NotificationHub&) = delete;
+
+    // Hands `event` to every subscription of `userId` and resumes those
+    // waiting. Call after the change is committed, so a woken reader sees it.
+    void publish(const std::string& userId, Event event) {
+        std::vector<std::coroutine_handle<>> woken;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = subscribers.find(userId);
+            if (it == subscribers.end()) return;
+            for (Subscription* subscription : it->second) {
+                subscription->pending.push_back(event);
+                if (auto handle = unpark(*subscription)) woken.push_back(handle);
+            }
+        }
+        for (auto handle : woken) handle.resume();
+    }
+
+    // Coroutines currently parked in next().
+    size_t waiting() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return parkedCount;
+    }
+};
+
+} // namespace Events
+} // namespace FitnessQuest
+
+#endif // FITNESS_QUEST_NOTIFICATION_HUB_HPP
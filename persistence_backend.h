@@ -0,0 +1,781 @@
+#ifndef FITNESS_PERSISTENCE_BACKEND_H
+#define FITNESS_PERSISTENCE_BACKEND_H
+
+// ============================================================
+// ASYNCHRONOUS PERSISTENCE BACKENDS
+// Writes are queued and performed by a background thread, so
+// callers never block in the kernel on disk I/O. Linux uses
+// io_uring when available and falls back to a pwrite thread.
+// ============================================================
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <exception>
+#include <deque>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <cstdio>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+namespace FitnessDB {
+
+// ============================================================
+// FILE PRIMITIVES
+// The only OS calls the portable backend makes. Windows maps
+// them onto the CRT; there is no pwrite, so it seeks first
+// (only the backend's worker thread touches these fds).
+// ============================================================
+
+namespace file_io {
+
+#ifdef _WIN32
+
+inline int open_write(const std::string& path, bool truncate) {
+    return ::_open(path.c_str(), _O_WRONLY | _O_CREAT | _O_BINARY | (truncate ? _O_TRUNC : 0),
+                   _S_IREAD | _S_IWRITE);
+}
+
+inline int close(int fd) { return ::_close(fd); }
+
+inline long long end_offset(int fd) { return ::_lseeki64(fd, 0, SEEK_END); }
+
+inline long long pwrite(int fd, const char* data, size_t len, uint64_t offset) {
+    if (::_lseeki64(fd, static_cast<long long>(offset), SEEK_SET) < 0) return -1;
+    return ::_write(fd, data, static_cast<unsigned>(std::min<size_t>(len, 1u << 30)));
+}
+
+inline int sync(int fd) { return ::_commit(fd); }
+
+inline int truncate(int fd) { return ::_chsize_s(fd, 0) == 0 ? 0 : -1; }
+
+inline bool replace(const std::string& from, const std::string& to) {
+    return ::MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+
+// MOVEFILE_WRITE_THROUGH already made the rename durable; NTFS has no
+// directory handle to fsync.
+inline bool sync_directory(const std::string&) { return true; }
+
+#else
+
+inline int open_write(const std::string& path, bool truncate) {
+    return ::open(path.c_str(), O_WRONLY | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+}
+
+inline int close(int fd) { return ::close(fd); }
+
+inline long long end_offset(int fd) { return ::lseek(fd, 0, SEEK_END); }
+
+inline long long pwrite(int fd, const char* data, size_t len, uint64_t offset) {
+    return ::pwrite(fd, data, len, static_cast<off_t>(offset));
+}
+
+inline int sync(int fd) { return ::fsync(fd); }
+
+inline int truncate(int fd) { return ::ftruncate(fd, 0); }
+
+inline bool replace(const std::string& from, const std::string& to) {
+    return std::rename(from.c_str(), to.c_str()) == 0;
+}
+
+inline bool sync_directory(const std::string& dir) {
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return false;
+    bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+#endif
+
+} // namespace file_io
+
+struct WriteOp {
+    enum class Kind { APPEND, REPLACE, TRUNCATE };
+
+    Kind kind;
+    std::string path;
+    std::string data;
+};
+
+class PersistenceBackend {
+public:
+    virtual ~PersistenceBackend() = default;
+
+    // Appends `data` to `path` and makes it durable (write + fsync).
+    // Returns a ticket for wait().
+    virtual uint64_t append(const std::string& path, std::string data) = 0;
+
+    // Atomically replaces `path` with `data` (temp file, fsync, rename).
+    virtual void replace_file(const std::string& path, std::string data) = 0;
+
+    // Empties `path`, ordered after every write queued before it.
+    virtual void truncate(const std::string& path) = 0;
+
+    // Blocks until the append that returned `ticket`, and everything queued
+    // before it, has reached the disk. Throws like flush().
+    virtual void wait(uint64_t ticket) = 0;
+
+    // Blocks until everything queued so far has reached the disk. Throws
+    // if any write failed; once one has, every later flush throws too.
+    virtual void flush() = 0;
+
+    virtual const char* name() const = 0;
+};
+
+// ============================================================
+// QUEUED BACKEND BASE
+// ============================================================
+
+class QueuedPersistenceBackend : public PersistenceBackend {
+private:
+    std::deque<WriteOp> queue;
+    std::mutex mtx;
+    std::condition_variable work_cv;
+    std::condition_variable done_cv;
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    std::exception_ptr failure;   // first failed batch; sticky
+    bool stopping = false;
+    std::thread worker;
+
+    uint64_t enqueue(WriteOp op) {
+        uint64_t ticket;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            queue.push_back(std::move(op));
+            ticket = ++submitted;
+        }
+        work_cv.notify_one();
+        return ticket;
+    }
+
+    // A later REPLACE of the same file makes earlier ones in the batch moot,
+    // but only up to the nearest append or truncate of any file: a checkpoint
+    // truncates the log, and that must not reach the disk before the
+    // snapshots it relies on.
+    static void coalesce(std::vector<WriteOp>& batch) {
+        std::vector<bool> superseded(batch.size(), false);
+        std::set<std::string> replaced_later;
+        for (size_t i = batch.size(); i-- > 0;) {
+            if (batch[i].kind != WriteOp::Kind::REPLACE) {
+                replaced_later.clear();
+            } else if (!replaced_later.insert(batch[i].path).second) {
+                superseded[i] = true;
+            }
+        }
+        std::vector<WriteOp> kept;
+        kept.reserve(batch.size());
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (!superseded[i]) kept.push_back(std::move(batch[i]));
+        }
+        batch.swap(kept);
+    }
+
+    void worker_loop() {
+        for (;;) {
+            std::vector<WriteOp> batch;
+            uint64_t batch_end;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                work_cv.wait(lock, [this]() { return stopping || !queue.empty(); });
+                if (queue.empty() && stopping) return;
+                batch.assign(std::make_move_iterator(queue.begin()),
+                             std::make_move_iterator(queue.end()));
+                queue.clear();
+                batch_end = submitted;
+                // Writes after a lost one cannot be made durable in order.
+                if (failure) continue;
+            }
+
+            coalesce(batch);
+            std::exception_ptr error;
+            try {
+                process_batch(batch);
+            } catch (const std::exception& e) {
+                std::cerr << "Warning: " << name() << " persistence failed: " << e.what() << std::endl;
+                error = std::current_exception();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (error) {
+                    failure = error;
+                } else {
+                    completed = batch_end;
+                }
+            }
+            done_cv.notify_all();
+        }
+    }
+
+protected:
+    struct OpenFile {
+        int fd;
+        uint64_t offset;
+    };
+    std::map<std::string, OpenFile> append_files;
+    std::vector<std::string> renamed_dirs;   // since the last sync_renames()
+
+    // Called on the worker thread with every op queued since the last batch.
+    virtual void process_batch(std::vector<WriteOp>& batch) = 0;
+
+    void start() {
+        worker = std::thread(&QueuedPersistenceBackend::worker_loop, this);
+    }
+
+    // Subclasses call this from their destructor, before their own state goes.
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (stopping) return;
+            stopping = true;
+        }
+        work_cv.notify_all();
+        if (worker.joinable()) worker.join();
+        for (auto& entry : append_files) {
+            file_io::close(entry.second.fd);
+        }
+        append_files.clear();
+    }
+
+    OpenFile& append_target(const std::string& path) {
+        auto it = append_files.find(path);
+        if (it != append_files.end()) return it->second;
+
+        int fd = file_io::open_write(path, false);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open file for appending: " + path);
+        }
+        long long end = file_io::end_offset(fd);
+        return append_files[path] = OpenFile{fd, static_cast<uint64_t>(end < 0 ? 0 : end)};
+    }
+
+    void truncate_now(const std::string& path) {
+        OpenFile& file = append_target(path);
+        if (file_io::truncate(file.fd) != 0 || file_io::sync(file.fd) != 0) {
+            throw std::runtime_error("Cannot truncate file: " + path);
+        }
+        file.offset = 0;
+    }
+
+    static std::string temp_path(const std::string& path) {
+        return path + ".tmp";
+    }
+
+    static int open_temp(const std::string& path) {
+        int fd = file_io::open_write(temp_path(path), true);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open file for writing: " + temp_path(path));
+        }
+        return fd;
+    }
+
+    void commit_temp(int fd, const std::string& path) {
+        file_io::close(fd);
+        if (!file_io::replace(temp_path(path), path)) {
+            throw std::runtime_error("Cannot rename snapshot into place: " + path);
+        }
+        size_t slash = path.rfind('/');
+        std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+        if (std::find(renamed_dirs.begin(), renamed_dirs.end(), dir) == renamed_dirs.end()) {
+            renamed_dirs.push_back(dir);
+        }
+    }
+
+    // A rename is durable only once its directory is synced. Must run before
+    // a TRUNCATE: the log it empties is what recovers snapshots whose
+    // renames were lost.
+    void sync_renames() {
+        for (const auto& dir : renamed_dirs) {
+            if (!file_io::sync_directory(dir)) {
+                renamed_dirs.clear();
+                throw std::runtime_error("Cannot sync directory: " + dir);
+            }
+        }
+        renamed_dirs.clear();
+    }
+
+    static void sync_fd(int fd) {
+        if (file_io::sync(fd) != 0) {
+            throw std::runtime_error(std::string("fsync failed: ") + std::strerror(errno));
+        }
+    }
+
+    static void pwrite_all(int fd, const char* data, size_t len, uint64_t offset) {
+        while (len > 0) {
+            long long n = file_io::pwrite(fd, data, len, offset);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("pwrite failed: ") + std::strerror(errno));
+            }
+            data += n;
+            len -= static_cast<size_t>(n);
+            offset += static_cast<uint64_t>(n);
+        }
+    }
+
+public:
+    ~QueuedPersistenceBackend() override {
+        stop();
+    }
+
+    uint64_t append(const std::string& path, std::string data) override {
+        return enqueue({WriteOp::Kind::APPEND, path, std::move(data)});
+    }
+
+    void replace_file(const std::string& path, std::string data) override {
+        enqueue({WriteOp::Kind::REPLACE, path, std::move(data)});
+    }
+
+    void truncate(const std::string& path) override {
+        enqueue({WriteOp::Kind::TRUNCATE, path, std::string()});
+    }
+
+    // Tickets are queue positions, and a batch completes as a whole, so
+    // every waiter whose op rode in one batch shares its fsyncs.
+    void wait(uint64_t ticket) override {
+        std::unique_lock<std::mutex> lock(mtx);
+        done_cv.wait(lock, [this, ticket]() { return completed >= ticket || failure; });
+        if (failure) std::rethrow_exception(failure);
+    }
+
+    void flush() override {
+        uint64_t target;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            target = submitted;
+        }
+        wait(target);
+    }
+};
+
+// ============================================================
+// PWRITE THREAD BACKEND (portable fallback)
+// ============================================================
+
+class ThreadedWriteBackend : public QueuedPersistenceBackend {
+protected:
+    void process_batch(std::vector<WriteOp>& batch) override {
+        // Group commit: one fsync per appended file per batch.
+        std::vector<int> dirty;
+        auto sync_dirty = [&]() {
+            for (int fd : dirty) sync_fd(fd);
+            dirty.clear();
+        };
+
+        for (auto& op : batch) {
+            switch (op.kind) {
+                case WriteOp::Kind::APPEND: {
+                    OpenFile& file = append_target(op.path);
+                    pwrite_all(file.fd, op.data.data(), op.data.size(), file.offset);
+                    file.offset += op.data.size();
+                    if (std::find(dirty.begin(), dirty.end(), file.fd) == dirty.end()) {
+                        dirty.push_back(file.fd);
+                    }
+                    break;
+                }
+                case WriteOp::Kind::REPLACE: {
+                    int fd = open_temp(op.path);
+                    try {
+                        pwrite_all(fd, op.data.data(), op.data.size(), 0);
+                        sync_fd(fd);
+                    } catch (...) {
+                        file_io::close(fd);
+                        throw;
+                    }
+                    commit_temp(fd, op.path);
+                    break;
+                }
+                case WriteOp::Kind::TRUNCATE:
+                    sync_dirty();
+                    sync_renames();
+                    truncate_now(op.path);
+                    break;
+            }
+        }
+        sync_dirty();
+        sync_renames();
+    }
+
+public:
+    ThreadedWriteBackend() {
+        start();
+    }
+
+    ~ThreadedWriteBackend() override {
+        stop();
+    }
+
+    const char* name() const override { return "pwrite"; }
+};
+
+#ifdef __linux__
+
+// ============================================================
+// IO_URING BACKEND (raw syscalls, no liburing dependency)
+// ============================================================
+
+class IoUringBackend : public QueuedPersistenceBackend {
+private:
+    static constexpr unsigned RING_ENTRIES = 64;
+    static constexpr unsigned BUFFER_COUNT = 16;
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+    static constexpr uint64_t SYNC_TAG = uint64_t(1) << 63;   // user_data of an fsync: tag | fd
+
+    int ring_fd = -1;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    unsigned sq_entries = 0;
+
+    void* sq_ring = MAP_FAILED;
+    void* cq_ring = MAP_FAILED;
+    size_t sq_ring_size = 0;
+    size_t cq_ring_size = 0;
+    size_t sqes_size = 0;
+
+    std::vector<char> buffer_pool;
+    bool buffers_registered = false;
+
+    // One queued write, tracked until its completion arrives.
+    struct Piece {
+        int fd;
+        const char* data;
+        size_t len;
+        uint64_t offset;
+    };
+
+    static int sys_setup(unsigned entries, io_uring_params* params) {
+        return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                                          flags, nullptr, 0));
+    }
+
+    static int sys_register(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+        return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+    }
+
+    bool setup_ring() {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring_fd = sys_setup(RING_ENTRIES, &params);
+        if (ring_fd < 0) return false;
+
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+        }
+
+        sq_ring = ::mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED) return false;
+        cq_ring = single_mmap ? sq_ring
+                              : ::mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) return false;
+
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqe_map = ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if (sqe_map == MAP_FAILED) return false;
+        sqes = static_cast<io_uring_sqe*>(sqe_map);
+
+        char* sq = static_cast<char*>(sq_ring);
+        char* cq = static_cast<char*>(cq_ring);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        sq_entries = params.sq_entries;
+
+        // Registered buffers are an optimisation; RLIMIT_MEMLOCK may refuse them.
+        buffer_pool.resize(BUFFER_COUNT * BUFFER_SIZE);
+        std::vector<iovec> iovecs(BUFFER_COUNT);
+        for (unsigned i = 0; i < BUFFER_COUNT; i++) {
+            iovecs[i].iov_base = buffer_pool.data() + i * BUFFER_SIZE;
+            iovecs[i].iov_len = BUFFER_SIZE;
+        }
+        buffers_registered =
+            sys_register(ring_fd, IORING_REGISTER_BUFFERS, iovecs.data(), BUFFER_COUNT) == 0;
+        return true;
+    }
+
+    void teardown_ring() {
+        if (sqes) ::munmap(sqes, sqes_size);
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring) ::munmap(cq_ring, cq_ring_size);
+        if (sq_ring != MAP_FAILED) ::munmap(sq_ring, sq_ring_size);
+        if (ring_fd >= 0) ::close(ring_fd);
+        sqes = nullptr;
+        sq_ring = cq_ring = MAP_FAILED;
+        ring_fd = -1;
+    }
+
+    io_uring_sqe* next_sqe() {
+        unsigned tail = *sq_tail;
+        unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        if (tail - head >= sq_entries) return nullptr;
+        unsigned index = tail & *sq_mask;
+        sq_array[index] = index;
+        io_uring_sqe* sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        return sqe;
+    }
+
+    // Submits one round: per file, a chain of writes with an fsync linked
+    // behind them, all handed to the kernel in a single io_uring_enter.
+    void submit_round(std::vector<Piece>& pieces, std::vector<int>& sync_fds) {
+        if (pieces.empty() && sync_fds.empty()) return;
+
+        std::map<int, std::vector<size_t>> by_fd;
+        for (size_t i = 0; i < pieces.size(); i++) {
+            by_fd[pieces[i].fd].push_back(i);
+        }
+        for (int fd : sync_fds) by_fd[fd];
+
+        unsigned buffer_slot = 0;
+        unsigned queued = 0;
+        for (auto& entry : by_fd) {
+            for (size_t index : entry.second) {
+                Piece& piece = pieces[index];
+                io_uring_sqe* sqe = next_sqe();
+                if (!sqe) throw std::runtime_error("io_uring submission queue full");
+
+                sqe->fd = piece.fd;
+                sqe->off = piece.offset;
+                sqe->len = static_cast<unsigned>(piece.len);
+                sqe->flags = IOSQE_IO_LINK;
+                sqe->user_data = index;
+
+                if (buffers_registered && piece.len <= BUFFER_SIZE && buffer_slot < BUFFER_COUNT) {
+                    char* slot = buffer_pool.data() + buffer_slot * BUFFER_SIZE;
+                    std::memcpy(slot, piece.data, piece.len);
+                    sqe->opcode = IORING_OP_WRITE_FIXED;
+                    sqe->addr = reinterpret_cast<uint64_t>(slot);
+                    sqe->buf_index = static_cast<uint16_t>(buffer_slot++);
+                } else {
+                    sqe->opcode = IORING_OP_WRITE;
+                    sqe->addr = reinterpret_cast<uint64_t>(piece.data);
+                }
+                queued++;
+            }
+
+            io_uring_sqe* sync = next_sqe();
+            if (!sync) throw std::runtime_error("io_uring submission queue full");
+            sync->opcode = IORING_OP_FSYNC;
+            sync->fd = entry.first;
+            sync->user_data = SYNC_TAG | static_cast<uint64_t>(entry.first);
+            queued++;
+        }
+
+        int submitted = sys_enter(ring_fd, queued, queued, IORING_ENTER_GETEVENTS);
+        if (submitted < 0) {
+            throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+        }
+
+        // Every completion is reaped before anything is retried or thrown, so
+        // none is left in the ring for the next round to misread.
+        unsigned reaped = 0;
+        std::vector<size_t> retry;
+        std::vector<int> resync;
+        std::string error;
+        while (reaped < queued) {
+            unsigned head = *cq_head;
+            unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+            if (head == tail) {
+                if (sys_enter(ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                    throw std::runtime_error(std::string("io_uring wait failed: ") + std::strerror(errno));
+                }
+                continue;
+            }
+            for (; head != tail; head++, reaped++) {
+                const io_uring_cqe& cqe = cqes[head & *cq_mask];
+                if (cqe.user_data & SYNC_TAG) {
+                    int fd = static_cast<int>(cqe.user_data & ~SYNC_TAG);
+                    if (cqe.res == -ECANCELED) {
+                        // A write ahead of it in the chain fell short.
+                        resync.push_back(fd);
+                    } else if (cqe.res < 0 && error.empty()) {
+                        error = std::string("fsync failed: ") + std::strerror(-cqe.res);
+                    }
+                    continue;
+                }
+
+                const Piece& piece = pieces[cqe.user_data];
+                size_t written = cqe.res > 0 ? static_cast<size_t>(cqe.res) : 0;
+                if (written < piece.len) {
+                    // Short or cancelled write: finish it the slow way below.
+                    pieces[cqe.user_data].data += written;
+                    pieces[cqe.user_data].len -= written;
+                    pieces[cqe.user_data].offset += written;
+                    retry.push_back(cqe.user_data);
+                }
+            }
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        }
+        if (!error.empty()) throw std::runtime_error(error);
+
+        for (size_t index : retry) {
+            const Piece& piece = pieces[index];
+            pwrite_all(piece.fd, piece.data, piece.len, piece.offset);
+            resync.push_back(piece.fd);
+        }
+        std::sort(resync.begin(), resync.end());
+        resync.erase(std::unique(resync.begin(), resync.end()), resync.end());
+        for (int fd : resync) sync_fd(fd);
+        pieces.clear();
+        sync_fds.clear();
+    }
+
+protected:
+    void process_batch(std::vector<WriteOp>& batch) override {
+        std::vector<Piece> pieces;
+        std::vector<int> sync_fds;
+        std::vector<std::pair<int, std::string>> pending_renames;
+
+        auto finish_round = [&]() {
+            submit_round(pieces, sync_fds);
+            // Each temp fd leaves the list as commit_temp closes it, so the
+            // list only ever holds fds that are still open.
+            while (!pending_renames.empty()) {
+                auto rename = pending_renames.front();
+                pending_renames.erase(pending_renames.begin());
+                commit_temp(rename.first, rename.second);
+            }
+            sync_renames();
+        };
+
+        try {
+            for (auto& op : batch) {
+                // Two SQEs per piece at most (write + fsync); keep headroom.
+                if (pieces.size() + sync_fds.size() + 2 > sq_entries / 2) {
+                    finish_round();
+                }
+
+                switch (op.kind) {
+                    case WriteOp::Kind::APPEND: {
+                        OpenFile& file = append_target(op.path);
+                        if (!op.data.empty()) {
+                            pieces.push_back({file.fd, op.data.data(), op.data.size(), file.offset});
+                            file.offset += op.data.size();
+                        }
+                        break;
+                    }
+                    case WriteOp::Kind::REPLACE: {
+                        // Both replacements would share one temp file.
+                        for (const auto& rename : pending_renames) {
+                            if (rename.second == op.path) {
+                                finish_round();
+                                break;
+                            }
+                        }
+                        int fd = open_temp(op.path);
+                        if (op.data.empty()) {
+                            sync_fds.push_back(fd);
+                        } else {
+                            pieces.push_back({fd, op.data.data(), op.data.size(), 0});
+                        }
+                        pending_renames.push_back({fd, op.path});
+                        break;
+                    }
+                    case WriteOp::Kind::TRUNCATE:
+                        finish_round();
+                        truncate_now(op.path);
+                        break;
+                }
+            }
+            finish_round();
+        } catch (...) {
+            // Temp files whose round never finished.
+            for (auto& rename : pending_renames) ::close(rename.first);
+            throw;
+        }
+    }
+
+public:
+    IoUringBackend() {
+        if (!setup_ring()) {
+            teardown_ring();
+            throw std::runtime_error("io_uring is not available");
+        }
+        start();
+    }
+
+    ~IoUringBackend() override {
+        stop();
+        teardown_ring();
+    }
+
+    bool uses_registered_buffers() const { return buffers_registered; }
+
+    const char* name() const override { return "io_uring"; }
+};
+
+#endif // __linux__
+
+// "auto" and "io_uring" try io_uring first and fall back to the pwrite
+// thread when the kernel (or a container seccomp profile) refuses it.
+inline std::unique_ptr<PersistenceBackend> make_persistence_backend(const std::string& kind = "auto") {
+#ifdef __linux__
+    if (kind == "auto" || kind == "io_uring") {
+        try {
+            return std::make_unique<IoUringBackend>();
+        } catch (const std::exception&) {
+            // fall through to the portable backend
+        }
+    }
+#endif
+    return std::make_unique<ThreadedWriteBackend>();
+}
+
+} // namespace FitnessDB
+
+#endif // FITNESS_PERSISTENCE_BACKEND_H
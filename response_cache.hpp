@@ -0,0 +1,119 @@
+// ============================================================================
+// RESPONSE_CACHE.HPP - Pre-rendered response bodies validated by ETag
+// ============================================================================
+
+#ifndef FITNESS_QUEST_RESPONSE_CACHE_HPP
+#define FITNESS_QUEST_RESPONSE_CACHE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+namespace FitnessQuest {
+namespace Caching {
+
+struct CachedResponse {
+    uint64_t version;
+    std::string etag;
+    std::string body;   // serialized JSON, sent as is
+};
+
+// Rendered bodies keyed by route (and user, for per-user responses), each
+// tagged with the data version it was rendered from. A lookup at a newer
+// version misses, so writers invalidate by bumping their version counter.
+//
+// The ETag is a function of key and version alone, so a handler can answer
+// If-None-Match with 304 before it has the body, or touches the database.
+//
+// Holds at most `capacity` keys. When full, a CLOCK sweep evicts one that
+// has not been read since the hand last passed it; reads only set a flag,
+// so they stay under the shared lock.
+class ResponseCache {
+private:
+    struct Slot {
+        std::string key;
+        std::shared_ptr<const CachedResponse> response;
+        mutable std::atomic<bool> referenced{false};
+    };
+
+    mutable std::shared_mutex mutex;
+    size_t capacity;
+    std::unique_ptr<Slot[]> slots;
+    size_t used = 0;
+    size_t hand = 0;
+    std::unordered_map<std::string, size_t> index;   // key -> slot
+
+    size_t evict() {
+        for (;;) {
+            Slot& slot = slots[hand];
+            size_t victim = hand;
+            hand = (hand + 1) % capacity;
+            if (!slot.referenced.exchange(false, std::memory_order_relaxed)) {
+                index.erase(slot.key);
+                return victim;
+            }
+        }
+    }
+
+    // Versions restart with the process; the epoch keeps an ETag handed out
+    // by an earlier run from matching this one's.
+    static const std::string& epoch() {
+        static const std::string value = std::to_string(
+            std::chrono::system_clock::now().time_since_epoch().count());
+        return value;
+    }
+
+public:
+    explicit ResponseCache(size_t capacity = 64)
+        : capacity(std::max<size_t>(1, capacity)), slots(new Slot[this->capacity]) {}
+
+    static std::string etag(const std::string& key, uint64_t version) {
+        return "\"" + key + "." + epoch() + "." + std::to_string(version) + "\"";
+    }
+
+    // The entry for `key` if it was rendered at `version`.
+    std::shared_ptr<const CachedResponse> find(const std::string& key, uint64_t version) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it == index.end()) return nullptr;
+        const Slot& slot = slots[it->second];
+        if (slot.response->version != version) return nullptr;
+        slot.referenced.store(true, std::memory_order_relaxed);
+        return slot.response;
+    }
+
+    // Keeps `body` as the rendering of `key` at `version`, unless a newer
+    // one is already there. Returns the entry to reply with.
+    std::shared_ptr<const CachedResponse> store(const std::string& key, uint64_t version, std::string body) {
+        auto entry = std::make_shared<const CachedResponse>(CachedResponse{version, etag(key, version), std::move(body)});
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            Slot& slot = slots[it->second];
+            if (slot.response->version <= version) slot.response = entry;
+            return entry;
+        }
+
+        size_t free = used < capacity ? used++ : evict();
+        slots[free].key = key;
+        slots[free].response = entry;
+        slots[free].referenced.store(false, std::memory_order_relaxed);
+        index.emplace(key, free);
+        return entry;
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return index.size();
+    }
+};
+
+} // namespace Caching
+} // namespace FitnessQuest
+
+#endif // FITNESS_QUEST_RESPONSE_CACHE_HPP
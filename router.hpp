@@ -7,8 +7,11 @@
 
 #include <cpprest/http_listener.h>
 #include <cpprest/json.h>
+#include <algorithm>
+#include <array>
 #include <memory>
-#include <regex>
+#include <stdexcept>
+#include <string_view>
 #include <vector>
 #include <functional>
 
@@ -36,10 +39,175 @@ namespace Controllers {
 
 namespace Routes {
 
+// ============================================================================
+// ROUTE TRIE
+// ============================================================================
+
+// Path parameters captured by a match, as views into the request path.
+class RouteParams {
+public:
+    static constexpr size_t MAX_PARAMS = 4;
+
+    std::string_view operator[](size_t i) const { return values[i]; }
+    size_t size() const { return count; }
+
+    void clear() { count = 0; }
+    bool push(std::string_view value) {
+        if (count == MAX_PARAMS) return false;
+        values[count++] = value;
+        return true;
+    }
+    void pop() { count--; }
+
+private:
+    std::array<std::string_view, MAX_PARAMS> values{};
+    size_t count = 0;
+};
+
+// Radix tree over path segments. Patterns look like "/api/users/{id}":
+// each static segment is an edge, each {param} matches one non-empty
+// segment, and every node holds its own method -> handler table. Static
+// edges win over params, falling back to the param when the static branch
+// has no route for the method. Matching walks the path once, binary-searching
+// static edges, so its cost depends on path depth rather than route count.
+template <typename Handler>
+class RouteTrie {
+private:
+    struct Node {
+        std::vector<std::pair<std::string, std::unique_ptr<Node>>> children; // sorted by segment
+        std::unique_ptr<Node> param;
+        std::string paramName;
+        std::vector<std::pair<std::string, Handler>> handlers; // by method
+    };
+
+    Node root;
+
+    // Splits off the next segment of `path`, which starts just past a '/';
+    // `last` is set when no '/' follows it.
+    static std::string_view nextSegment(std::string_view& path, bool& last) {
+        size_t slash = path.find('/');
+        std::string_view segment = path.substr(0, slash);
+        last = slash == std::string_view::npos;
+        path = last ? std::string_view() : path.substr(slash + 1);
+        return segment;
+    }
+
+    static bool isParam(std::string_view segment) {
+        return segment.size() > 2 && segment.front() == '{' && segment.back() == '}';
+    }
+
+    static const Node* staticChild(const Node& node, std::string_view segment) {
+        auto it = std::lower_bound(node.children.begin(), node.children.end(), segment,
+            [](const auto& child, std::string_view key) { return std::string_view(child.first) < key; });
+        return it != node.children.end() && it->first == segment ? it->second.get() : nullptr;
+    }
+
+    static const Handler* handlerFor(const Node& node, std::string_view method) {
+        for (const auto& entry : node.handlers) {
+            if (entry.first == method) return &entry.second;
+        }
+        return nullptr;
+    }
+
+    // `rest` is the path after the segment that led to `node`; `done` is
+    // true once the whole path has been consumed.
+    static const Handler* find(const Node& node, std::string_view method, std::string_view rest, bool done,
+                               RouteParams& params) {
+        if (done) return handlerFor(node, method);
+
+        std::string_view remaining = rest;
+        bool last = false;
+        std::string_view segment = nextSegment(remaining, last);
+
+        if (const Node* child = staticChild(node, segment)) {
+            if (const Handler* handler = find(*child, method, remaining, last, params)) return handler;
+        }
+        if (node.param && !segment.empty() && params.push(segment)) {
+            if (const Handler* handler = find(*node.param, method, remaining, last, params)) return handler;
+            params.pop();
+        }
+        return nullptr;
+    }
+
+    static void collectMethods(const Node& node, std::string_view rest, bool done,
+                               std::vector<std::string>& methods) {
+        if (done) {
+            for (const auto& entry : node.handlers) {
+                if (std::find(methods.begin(), methods.end(), entry.first) == methods.end()) {
+                    methods.push_back(entry.first);
+                }
+            }
+            return;
+        }
+
+        std::string_view remaining = rest;
+        bool last = false;
+        std::string_view segment = nextSegment(remaining, last);
+
+        if (const Node* child = staticChild(node, segment)) collectMethods(*child, remaining, last, methods);
+        if (node.param && !segment.empty()) collectMethods(*node.param, remaining, last, methods);
+    }
+
+    static bool splitPath(std::string_view& path) {
+        if (path.empty() || path.front() != '/') return false;
+        path.remove_prefix(1);
+        return true;
+    }
+
+public:
+    void add(const std::string& method, const std::string& pattern, Handler handler) {
+        std::string_view rest = pattern;
+        if (!splitPath(rest)) throw std::runtime_error("Route pattern must start with '/': " + pattern);
+
+        Node* node = &root;
+        for (bool last = false; !last;) {
+            std::string_view segment = nextSegment(rest, last);
+            if (isParam(segment)) {
+                std::string name(segment.substr(1, segment.size() - 2));
+                if (!node->param) {
+                    node->param = std::make_unique<Node>();
+                    node->paramName = name;
+                } else if (node->paramName != name) {
+                    throw std::runtime_error("Conflicting parameter names in route: " + pattern);
+                }
+                node = node->param.get();
+                continue;
+            }
+
+            auto it = std::lower_bound(node->children.begin(), node->children.end(), segment,
+                [](const auto& child, std::string_view key) { return std::string_view(child.first) < key; });
+            if (it == node->children.end() || it->first != segment) {
+                it = node->children.emplace(it, std::string(segment), std::make_unique<Node>());
+            }
+            node = it->second.get();
+        }
+
+        if (handlerFor(*node, method)) throw std::runtime_error("Duplicate route: " + method + " " + pattern);
+        node->handlers.emplace_back(method, std::move(handler));
+    }
+
+    // The handler for `method` on `path`, with its params; nullptr if none.
+    const Handler* find(std::string_view method, std::string_view path, RouteParams& params) const {
+        params.clear();
+        if (!splitPath(path)) return nullptr;
+        return find(root, method, path, false, params);
+    }
+
+    // Methods routed for `path`: empty means 404, otherwise a miss is a 405.
+    std::vector<std::string> allowedMethods(std::string_view path) const {
+        std::vector<std::string> methods;
+        if (splitPath(path)) collectMethods(root, path, false, methods);
+        return methods;
+    }
+};
+
 // ============================================================================
 // ROUTER CLASS
 // ============================================================================
 class Router {
+public:
+    using Handler = std::function<void(http_request, const RouteParams&)>;
+
 private:
     std::shared_ptr<Config::Database> database;
     std::shared_ptr<GameSync::GameSyncEngine> syncEngine;
@@ -51,13 +219,7 @@ private:
     std::unique_ptr<Controllers::QuestController> questController;
     std::unique_ptr<Controllers::GameController> gameController;
 
-    struct Route {
-        std::string method;
-        std::regex pathPattern;
-        std::function<void(http_request, std::smatch)> handler;
-    };
-
-    std::vector<Route> routes;
+    RouteTrie<Handler> routes;
 
 public:
     Router(std::shared_ptr<Config::Database> db,
@@ -65,34 +227,47 @@ public:
 
     void registerRoutes();
 
-    void addRoute(const std::string& method, const std::string& pattern,
-                  std::function<void(http_request, std::smatch)> handler) {
-        routes.push_back({method, std::regex(pattern), handler});
+    void addRoute(const std::string& method, const std::string& pattern, Handler handler) {
+        routes.add(method, pattern, std::move(handler));
+    }
+
+    // Params are matched on the raw path and decoded only when escaped.
+    static std::string param(const RouteParams& params, size_t i) {
+        std::string value(params[i]);
+        return value.find('%') == std::string::npos ? value : uri::decode(value);
     }
 
     void route(http_request request) {
         Middleware::Logger::logRequest(request);
 
         std::string method = request.method();
-        std::string path = uri::decode(request.relative_uri().path());
-
-        for (const auto& route : routes) {
-            if (route.method == method) {
-                std::smatch match;
-                if (std::regex_match(path, match, route.pathPattern)) {
-                    try {
-                        route.handler(request, match);
-                        return;
-                    } catch (const std::exception& e) {
-                        sendError(request, status_codes::InternalError, e.what());
-                        return;
-                    }
-                }
+        std::string path = request.relative_uri().path();
+        if (path.empty()) path = "/";
+
+        RouteParams params;
+        if (const Handler* handler = routes.find(method, path, params)) {
+            try {
+                (*handler)(request, params);
+            } catch (const Utils::HttpError& e) {
+                sendError(request, e.status(), e.what());
+            } catch (const std::exception& e) {
+                sendError(request, status_codes::InternalError, e.what());
             }
+            return;
         }
 
-        sendError(request, status_codes::NotFound,
-                  "Endpoint not found: " + method + " " + path);
+        std::vector<std::string> allowed = routes.allowedMethods(path);
+        if (allowed.empty()) {
+            sendError(request, status_codes::NotFound,
+                      "Endpoint not found: " + method + " " + uri::decode(path));
+            return;
+        }
+
+        std::string allow;
+        for (const auto& m : allowed) allow += (allow.empty() ? "" : ", ") + m;
+        Middleware::ErrorHandler::sendJsonError(request, status_codes::MethodNotAllowed,
+                                                "Method not allowed: " + method + " " + uri::decode(path),
+                                                {{"Allow", allow}});
     }
 
     static void sendError(http_request request, status_code code,
@@ -120,8 +295,8 @@ inline Router::Router(std::shared_ptr<Config::Database> db,
     healthController = std::make_unique<Controllers::HealthController>(database);
     userController = std::make_unique<Controllers::UserController>(database);
     authController = std::make_unique<Controllers::AuthController>(database);
-    workoutController = std::make_unique<Controllers::WorkoutController>(database);
-    questController = std::make_unique<Controllers::QuestController>(database);
+    workoutController = std::make_unique<Controllers::WorkoutController>(database, syncEngine->notifications());
+    questController = std::make_unique<Controllers::QuestController>(database, syncEngine->notifications());
     gameController = std::make_unique<Controllers::GameController>(database, syncEngine);
 
     registerRoutes();
@@ -131,78 +306,82 @@ inline void Router::registerRoutes() {
     // -------------------------
     // HEALTH CHECK
     // -------------------------
-    addRoute("GET", "^/health$", [this](http_request req, std::smatch) {
+    addRoute("GET", "/health", [this](http_request req, const RouteParams&) {
         healthController->getHealth(req);
     });
 
     // -------------------------
     // USER ROUTES
     // -------------------------
-    addRoute("POST", "^/api/users$", [this](http_request req, std::smatch) {
+    addRoute("POST", "/api/users", [this](http_request req, const RouteParams&) {
         userController->createUser(req);
     });
 
-    addRoute("GET", "^/api/users/([^/]+)$", [this](http_request req, std::smatch match) {
-        userController->getUser(req, match[1].str());
+    addRoute("GET", "/api/users/{id}", [this](http_request req, const RouteParams& params) {
+        userController->getUser(req, param(params, 0));
     });
 
     // -------------------------
     // AUTH
     // -------------------------
-    addRoute("POST", "^/api/auth/login$", [this](http_request req, std::smatch) {
+    addRoute("POST", "/api/auth/login", [this](http_request req, const RouteParams&) {
         authController->login(req);
     });
 
     // -------------------------
     // WORKOUT
     // -------------------------
-    addRoute("POST", "^/api/workouts$", [this](http_request req, std::smatch) {
+    addRoute("POST", "/api/workouts", [this](http_request req, const RouteParams&) {
         workoutController->logWorkout(req);
     });
 
-    addRoute("GET", "^/api/workouts$", [this](http_request req, std::smatch) {
+    addRoute("GET", "/api/workouts", [this](http_request req, const RouteParams&) {
         workoutController->getWorkoutHistory(req);
     });
 
-    addRoute("GET", "^/api/workouts/([^/]+)$", [this](http_request req, std::smatch match) {
-        workoutController->getWorkout(req, match[1].str());
+    addRoute("GET", "/api/workouts/{id}", [this](http_request req, const RouteParams& params) {
+        workoutController->getWorkout(req, param(params, 0));
     });
 
     // -------------------------
     // QUEST ROUTES
     // -------------------------
-    addRoute("GET", "^/api/quests$", [this](http_request req, std::smatch) {
+    addRoute("GET", "/api/quests", [this](http_request req, const RouteParams&) {
         questController->getQuests(req);
     });
 
-    addRoute("POST", "^/api/quests/complete$", [this](http_request req, std::smatch) {
+    addRoute("POST", "/api/quests/complete", [this](http_request req, const RouteParams&) {
         questController->completeQuest(req);
     });
 
-    addRoute("GET", "^/api/quests/([^/]+)$", [this](http_request req, std::smatch match) {
-        questController->getQuest(req, match[1].str());
+    addRoute("GET", "/api/quests/{id}", [this](http_request req, const RouteParams& params) {
+        questController->getQuest(req, param(params, 0));
     });
 
     // =====================================================
     //              GAME ENGINE ROUTES
     // =====================================================
-    addRoute("GET", "^/api/game/state$", [this](http_request req, std::smatch) {
+    addRoute("GET", "/api/game/state", [this](http_request req, const RouteParams&) {
         gameController->syncGameState(req);
     });
 
-    addRoute("GET", "^/api/game/stats$", [this](http_request req, std::smatch) {
+    addRoute("GET", "/api/game/events", [this](http_request req, const RouteParams&) {
+        gameController->waitForEvents(req);
+    });
+
+    addRoute("GET", "/api/game/stats", [this](http_request req, const RouteParams&) {
         gameController->getPlayerStats(req);
     });
 
-    addRoute("GET", "^/api/game/quests$", [this](http_request req, std::smatch) {
+    addRoute("GET", "/api/game/quests", [this](http_request req, const RouteParams&) {
         gameController->getAvailableQuests(req);
     });
 
-    addRoute("GET", "^/api/game/leaderboard$", [this](http_request req, std::smatch) {
+    addRoute("GET", "/api/game/leaderboard", [this](http_request req, const RouteParams&) {
         gameController->getLeaderboard(req);
     });
 
-    addRoute("POST", "^/api/game/claim-reward$", [this](http_request req, std::smatch) {
+    addRoute("POST", "/api/game/claim-reward", [this](http_request req, const RouteParams&) {
         gameController->claimReward(req);
     });
 }
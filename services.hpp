@@ -240,6 +240,17 @@ public:
                                         double duration,
                                         double intensity,
                                         std::optional<double> formScore) {
+        return calculateWorkoutRewards(database->getUser(userId), type, duration, intensity, formScore);
+    }
+    
+    // Same as above for a user already read inside a transaction; does not
+    // touch the database, so it is safe while the transaction holds the lock.
+    RewardBundle calculateWorkoutRewards(const FitnessDB::User& user,
+                                        WorkoutType type,
+                                        double duration,
+                                        double intensity,
+                                        std::optional<double> formScore) {
+        const std::string& userId = user.id;
         RewardBundle bundle;
         
         GameReward baseRewards = RewardCalculation::calculateWorkoutRewards(
@@ -253,7 +264,6 @@ public:
         checkBonusRewards(bundle, userId, type);
         checkAchievements(bundle, userId, type, duration);
         
-        FitnessDB::User user = database->getUser(userId);
         int32_t oldLevel = RewardCalculation::calculateLevelFromXP(user.experience_points);
         int32_t newLevel = RewardCalculation::calculateLevelFromXP(
             user.experience_points + bundle.experience
@@ -1,6 +1,6 @@
 // ============================================================================
 // COMPREHENSIVE TEST SUITE - FITNESS QUEST
-// Compile: g++ -std=c++17 -o test_suite test_suite.cpp -lcpprest -lssl -lcrypto -pthread
+// Compile: g++ -std=c++20 -o test_suite test_suite.cpp -lcpprest -lssl -lcrypto -pthread
 // Run: ./test_suite
 // ============================================================================
 
@@ -13,6 +13,8 @@
 #include <memory>
 #include <chrono>
 #include <iomanip>
+#include <future>
+#include <filesystem>
 
 // Include project headers
 #include "config.hpp"
@@ -20,6 +22,10 @@
 #include "services.hpp"
 #include "utils.hpp"
 #include "GameSyncEngine.hpp"
+#include "router.hpp"
+#include "coroutines.hpp"
+#include "response_cache.hpp"
+#include "notification_hub.hpp"
 
 // ANSI color codes
 #define RESET   "\033[0m"
@@ -228,6 +234,290 @@ void testJWTVerification() {
     ASSERT_EQUAL(userId, verified);
 }
 
+void testJsonWriter() {
+    Utils::JsonWriter json;
+    json.beginObject();
+    json.field("success", true);
+    json.field("name", std::string("a \"quoted\"\\path\n\x01"));
+    json.key("stats");
+    json.beginObject();
+    json.field("level", 3);
+    json.field("xp", static_cast<int64_t>(-1250));
+    json.field("score", 0.5);
+    json.endObject();
+    json.key("empty");
+    json.beginArray();
+    json.endArray();
+    json.key("items");
+    json.beginArray();
+    json.value("x");
+    json.null();
+    json.endArray();
+    json.endObject();
+    
+    std::string text = json.take();
+    ASSERT_EQUAL(std::string("{\"success\":true,\"name\":\"a \\\"quoted\\\"\\\\path\\n\\u0001\","
+                             "\"stats\":{\"level\":3,\"xp\":-1250,\"score\":0.5},"
+                             "\"empty\":[],\"items\":[\"x\",null]}"), text);
+    
+    Utils::JsonWriter unbalanced;
+    unbalanced.beginObject();
+    ASSERT_THROWS(unbalanced.take());
+}
+
+struct ReaderPayload {
+    std::string name;
+    double score = 0;
+    int count = 0;
+    bool active = false;
+    std::optional<double> bonus;
+    Models::WorkoutType type = Models::WorkoutType::CORE;
+};
+
+} // namespace Testing
+
+namespace Utils {
+template <>
+struct JsonSchema<Testing::ReaderPayload> {
+    static constexpr auto fields = std::make_tuple(
+        jsonRequired("name", &Testing::ReaderPayload::name),
+        jsonRequired("score", &Testing::ReaderPayload::score),
+        jsonRequired("count", &Testing::ReaderPayload::count),
+        jsonOptional("active", &Testing::ReaderPayload::active),
+        jsonOptional("bonus", &Testing::ReaderPayload::bonus),
+        jsonRequired("type", &Testing::ReaderPayload::type, Models::stringToWorkoutType));
+};
+} // namespace Utils
+
+namespace Testing {
+
+// The 400 message a body is rejected with, or "" if it decodes.
+std::string readerError(const std::string& body) {
+    try {
+        Utils::JsonReader::decode<ReaderPayload>(body);
+    } catch (const Utils::HttpError& e) {
+        return e.status() == status_codes::BadRequest ? e.what() : "wrong status";
+    }
+    return "";
+}
+
+void testJsonReader() {
+    auto payload = Utils::JsonReader::decode<ReaderPayload>(
+        " { \"name\" : \"a\\\"b\\u00e9\\ud83d\\ude00\", \"extra\": {\"nested\": [1, 2.5e3, true, null, \"}\"]},"
+        "\"score\": -12.5, \"count\": 42, \"active\": true, \"bonus\": null, \"type\": \"CARDIO\" } ");
+    ASSERT_EQUAL(std::string("a\"b\xC3\xA9\xF0\x9F\x98\x80"), payload.name);
+    ASSERT_EQUAL(-12.5, payload.score);
+    ASSERT_EQUAL(42, payload.count);
+    ASSERT_TRUE(payload.active);
+    ASSERT_FALSE(payload.bonus.has_value());
+    ASSERT_TRUE(payload.type == Models::WorkoutType::CARDIO);
+    
+    const std::string valid = "\"name\":\"x\",\"score\":1,\"type\":\"CORE\"";
+    ASSERT_EQUAL(std::string(""), readerError("{" + valid + ",\"count\":1}"));
+    ASSERT_EQUAL(std::string("Missing required field: count"), readerError("{" + valid + "}"));
+    ASSERT_EQUAL(std::string("Missing required field: count"), readerError("{" + valid + ",\"count\":null}"));
+    ASSERT_EQUAL(std::string("Field 'count' must be an integer"), readerError("{" + valid + ",\"count\":1.5}"));
+    ASSERT_EQUAL(std::string("Field 'name' must be a string"), readerError("{\"name\":7}"));
+    ASSERT_EQUAL(std::string("Field 'type' has an invalid value: yoga"), readerError("{\"type\":\"yoga\"}"));
+    ASSERT_EQUAL(std::string("Malformed JSON at offset 8: expected ':'"), readerError("{\"name\" \"x\"}"));
+    ASSERT_EQUAL(std::string("Malformed JSON at offset 0: expected an object"), readerError("[]"));
+    ASSERT_TRUE(readerError("{" + valid + ",\"count\":1} x").find("trailing") != std::string::npos);
+    ASSERT_TRUE(readerError("{\"name\":\"\\ud83d\"}").find("surrogate") != std::string::npos);
+}
+
+// ============================================================================
+// REQUEST PIPELINE TESTS
+// ============================================================================
+
+void testRouteTrieMatching() {
+    Routes::RouteTrie<std::string> trie;
+    trie.add("GET", "/health", "health");
+    trie.add("GET", "/api/quests", "quests");
+    trie.add("POST", "/api/quests/complete", "complete");
+    trie.add("GET", "/api/quests/{id}", "quest");
+    trie.add("GET", "/api/users/{id}/workouts/{workout}", "userWorkout");
+    ASSERT_THROWS(trie.add("GET", "/api/quests/{id}", "again"));
+    ASSERT_THROWS(trie.add("GET", "/api/quests/{questId}/steps", "renamed"));
+
+    Routes::RouteParams params;
+    const std::string* handler = trie.find("GET", "/health", params);
+    ASSERT_TRUE(handler && *handler == "health");
+    ASSERT_EQUAL(static_cast<size_t>(0), params.size());
+
+    handler = trie.find("POST", "/api/quests/complete", params);
+    ASSERT_TRUE(handler && *handler == "complete");
+
+    // A static segment without the method falls back to the param route.
+    handler = trie.find("GET", "/api/quests/complete", params);
+    ASSERT_TRUE(handler && *handler == "quest");
+    ASSERT_TRUE(params[0] == "complete");
+
+    handler = trie.find("GET", "/api/users/USER_1/workouts/W%201", params);
+    ASSERT_TRUE(handler && *handler == "userWorkout");
+    ASSERT_EQUAL(static_cast<size_t>(2), params.size());
+    ASSERT_TRUE(params[0] == "USER_1" && params[1] == "W%201");
+
+    ASSERT_TRUE(trie.find("GET", "/api/quests/", params) == nullptr);
+    ASSERT_TRUE(trie.find("GET", "/api/quests/Q1/extra", params) == nullptr);
+    ASSERT_TRUE(trie.find("GET", "/health/", params) == nullptr);
+    ASSERT_TRUE(trie.find("GET", "", params) == nullptr);
+
+    // Misses split into 405 (path known, method not) and 404.
+    ASSERT_TRUE(trie.find("DELETE", "/api/quests/complete", params) == nullptr);
+    auto allowed = trie.allowedMethods("/api/quests/complete");
+    ASSERT_EQUAL(static_cast<size_t>(2), allowed.size());
+    ASSERT_TRUE(std::find(allowed.begin(), allowed.end(), "POST") != allowed.end());
+    ASSERT_TRUE(std::find(allowed.begin(), allowed.end(), "GET") != allowed.end());
+    ASSERT_TRUE(trie.allowedMethods("/api/nothing").empty());
+}
+
+void testExecutorTasks() {
+    Async::Executor executor("test", {1, 16});
+    auto value = executor.submit([]() { return 42; });
+    auto failure = executor.submit([]() -> int {
+        throw Utils::HttpError(status_codes::BadRequest, "bad input");
+    });
+    
+    // One worker runs tasks in order, so this also waits for both above.
+    std::promise<void> drained;
+    executor.post([&drained]() { drained.set_value(); });
+    drained.get_future().wait();
+    
+    ASSERT_EQUAL(42, value.get());
+    bool badRequest = false;
+    try {
+        failure.get();
+    } catch (const Utils::HttpError& e) {
+        badRequest = e.status() == status_codes::BadRequest;
+    }
+    ASSERT_TRUE(badRequest);
+    
+    // Shutdown runs whatever is still queued.
+    std::atomic<int> ran(0);
+    {
+        Async::Executor pool("test", {2, 128});
+        for (int i = 0; i < 100; i++) pool.post([&ran]() { ran++; });
+    }
+    ASSERT_EQUAL(100, ran.load());
+}
+
+void testExecutorBoundsAndStealing() {
+    // A task that spawns work onto its own worker's deque and waits for it:
+    // only the other worker can run the children, by stealing them.
+    {
+        Async::Executor stealing("test", {2, 64});
+        const int children = 20;
+        std::atomic<int> done(0);
+        std::promise<void> finished;
+        uint64_t stolenBefore = 0;
+        stealing.post([&]() {
+            // The parent itself may have been stolen on its way in.
+            stolenBefore = stealing.metrics().stolen;
+            for (int i = 0; i < children; i++) {
+                stealing.post([&done]() { done++; });
+            }
+            while (done.load() < children) std::this_thread::yield();
+            finished.set_value();
+        });
+        finished.get_future().wait();
+        ASSERT_EQUAL(static_cast<uint64_t>(children), stealing.metrics().stolen - stolenBefore);
+    }
+    
+    // Block both workers, then fill the queue: the next post is refused.
+    Async::Executor executor("test", {2, 4});
+    std::promise<void> release;
+    std::shared_future<void> gate = release.get_future().share();
+    std::atomic<int> started(0);
+    for (int i = 0; i < 2; i++) {
+        executor.post([gate, &started]() { started++; gate.wait(); });
+    }
+    while (started.load() < 2) std::this_thread::yield();
+    for (int i = 0; i < 4; i++) executor.post([]() {});
+    
+    bool busy = false;
+    try {
+        executor.post([]() {});
+    } catch (const Utils::HttpError& e) {
+        busy = e.status() == status_codes::ServiceUnavailable;
+    }
+    ASSERT_TRUE(busy);
+    release.set_value();
+    
+    auto metrics = executor.metrics();
+    ASSERT_EQUAL(static_cast<uint64_t>(1), metrics.rejected);
+    ASSERT_EQUAL(static_cast<size_t>(4), metrics.peakQueued);
+    ASSERT_EQUAL(std::string("test"), metrics.name);
+}
+
+void testResponseCache() {
+    Caching::ResponseCache cache;
+    ASSERT_TRUE(cache.find("/api/quests", 1) == nullptr);
+    
+    auto stored = cache.store("/api/quests", 1, "{\"quests\":[]}");
+    ASSERT_EQUAL(Caching::ResponseCache::etag("/api/quests", 1), stored->etag);
+    ASSERT_EQUAL(std::string("{\"quests\":[]}"), cache.find("/api/quests", 1)->body);
+    
+    // A bumped version misses; a late render of an older one does not win.
+    ASSERT_TRUE(cache.find("/api/quests", 2) == nullptr);
+    cache.store("/api/quests", 3, "three");
+    cache.store("/api/quests", 2, "two");
+    ASSERT_TRUE(cache.find("/api/quests", 2) == nullptr);
+    ASSERT_EQUAL(std::string("three"), cache.find("/api/quests", 3)->body);
+    ASSERT_TRUE(Caching::ResponseCache::etag("/api/quests", 3) != Caching::ResponseCache::etag("/api/quests", 2));
+    
+    std::string etag = Caching::ResponseCache::etag("/api/quests", 3);
+    http_request request;
+    ASSERT_FALSE(Utils::Request::matchesETag(request, etag));
+    request.headers().add(U("If-None-Match"), U("\"stale\", W/") + etag);
+    ASSERT_TRUE(Utils::Request::matchesETag(request, etag));
+    request.headers()[U("If-None-Match")] = U("\"stale\"");
+    ASSERT_FALSE(Utils::Request::matchesETag(request, etag));
+    request.headers()[U("If-None-Match")] = U("*");
+    ASSERT_TRUE(Utils::Request::matchesETag(request, etag));
+    
+    // Bounded: a full cache evicts a key not read since the last sweep.
+    Caching::ResponseCache users(2);
+    users.store("state:a", 1, "a");
+    users.store("state:b", 1, "b");
+    users.find("state:a", 1);
+    users.store("state:c", 1, "c");
+    ASSERT_EQUAL(static_cast<size_t>(2), users.size());
+    ASSERT_TRUE(users.find("state:a", 1) != nullptr);
+    ASSERT_TRUE(users.find("state:b", 1) == nullptr);
+    ASSERT_TRUE(users.find("state:c", 1) != nullptr);
+}
+
+void testCoroutineAdapters() {
+    Async::Executor executor("test", {1, 16});
+    std::promise<std::thread::id> hopped;
+    std::promise<int> awaited;
+    
+    // Awaits a task, hops onto the pool, then replies.
+    auto handler = [&](http_request) -> Async::Response {
+        int value = co_await pplx::task_from_result(41);
+        co_await executor;
+        hopped.set_value(std::this_thread::get_id());
+        awaited.set_value(value + 1);
+        co_return Async::Reply{status_codes::OK, json::value::object()};
+    };
+    handler(http_request());
+    
+    ASSERT_EQUAL(42, awaited.get_future().get());
+    ASSERT_TRUE(hopped.get_future().get() != std::this_thread::get_id());
+    
+    // A throwing handler becomes an error reply, not an escaping exception.
+    bool escaped = false;
+    try {
+        [](http_request) -> Async::Response {
+            throw Utils::HttpError(status_codes::NotFound, "missing");
+            co_return Async::Reply{status_codes::OK, json::value::object()};
+        }(http_request());
+    } catch (...) {
+        escaped = true;
+    }
+    ASSERT_FALSE(escaped);
+}
+
 // ============================================================================
 // SERVICE TESTS
 // ============================================================================
@@ -319,6 +609,134 @@ void testQuestRetrieval() {
     
     auto quests = engine.getAvailableQuests("test_user");
     ASSERT_TRUE(quests.size() >= 0); // Just verify it doesn't crash
+    
+    // An unreadable catalog falls back to the default quest and says so,
+    // so the controller doesn't cache it.
+    auto offline = std::make_shared<Config::Database>();
+    GameSync::GameSyncEngine offlineEngine(offline, rewardService);
+    bool fallback = false;
+    auto defaults = offlineEngine.getAvailableQuests("test_user", &fallback);
+    ASSERT_TRUE(fallback);
+    ASSERT_EQUAL(size_t(1), defaults.size());
+}
+
+void testStateChangeLog() {
+    GameSync::PlayerChangeLog log;
+    GameSync::PlayerSnapshot snapshot;
+    snapshot.fields = {{"level", 1}, {"xp", 0}};
+    snapshot.lists["achievements"] = {};
+    log.reset(snapshot, 100);
+    
+    ASSERT_TRUE(log.since(100).empty());
+    ASSERT_FALSE(log.since(100).full);
+    ASSERT_FALSE(log.record(snapshot, 101));
+    
+    snapshot.fields["xp"] = 50;
+    snapshot.lists["achievements"] = {"First Workout"};
+    ASSERT_TRUE(log.record(snapshot, 102));
+    snapshot.fields["xp"] = 80;
+    ASSERT_TRUE(log.record(snapshot, 103));
+    
+    auto delta = log.since(100);
+    ASSERT_EQUAL(static_cast<uint64_t>(103), delta.version);
+    ASSERT_FALSE(delta.full);
+    ASSERT_EQUAL(static_cast<size_t>(1), delta.fields.size());
+    ASSERT_EQUAL(80, delta.fields["xp"]);
+    ASSERT_EQUAL(std::string("First Workout"), delta.added["achievements"].at(0));
+    ASSERT_EQUAL(static_cast<size_t>(0), log.since(102).added.size());
+    
+    // An entry added and removed again within the window cancels out.
+    snapshot.lists["achievements"] = {};
+    log.record(snapshot, 104);
+    ASSERT_TRUE(log.since(100).added.empty());
+    ASSERT_TRUE(log.since(100).removed.empty());
+    ASSERT_EQUAL(static_cast<size_t>(1), log.since(103).removed["achievements"].size());
+    
+    // Once the ring has dropped changes a client needs, it gets everything.
+    for (int i = 0; i < static_cast<int>(GameSync::PlayerChangeLog::capacity); i++) {
+        snapshot.fields["xp"] = 100 + i;
+        log.record(snapshot, 105 + i);
+    }
+    ASSERT_TRUE(log.since(100).full);
+    ASSERT_EQUAL(static_cast<size_t>(2), log.since(100).fields.size());
+    ASSERT_FALSE(log.since(log.version() - 1).full);
+    ASSERT_TRUE(log.since(log.version() + 1).full);
+}
+
+void testGameStateSince() {
+    auto db = std::make_shared<Config::Database>();
+    db->connect();
+    auto rewardService = std::make_shared<Services::RewardService>(db);
+    GameSync::GameSyncEngine engine(db, rewardService);
+    
+    std::string userId = db->createUser("deltauser", "delta_" + std::to_string(time(nullptr)) + "@test.com", "password");
+    auto initial = engine.getGameStateSince(userId, 0);
+    ASSERT_TRUE(initial.full);
+    ASSERT_EQUAL(0, initial.fields["xp"]);
+    
+    auto unchanged = engine.getGameStateSince(userId, initial.version);
+    ASSERT_TRUE(unchanged.empty());
+    ASSERT_EQUAL(initial.version, unchanged.version);
+    
+    FitnessDB::User user = db->getUser(userId);
+    user.experience_points = 120;
+    db->updateUser(user);
+    
+    auto delta = engine.getGameStateSince(userId, initial.version);
+    ASSERT_FALSE(delta.full);
+    ASSERT_TRUE(delta.version > initial.version);
+    ASSERT_EQUAL(120, delta.fields["xp"]);
+    ASSERT_EQUAL(12, delta.fields["gold"]);
+    ASSERT_TRUE(delta.fields.find("level") == delta.fields.end());
+}
+
+void testNotificationHub() {
+    using Subscription = Events::NotificationHub::Subscription;
+    Events::NotificationHub hub;
+    
+    // Parks until something is published for its user or the timeout passes.
+    auto waiter = [&hub](http_request, std::string userId, std::chrono::milliseconds timeout,
+                         std::promise<std::vector<Events::Event>>& result) -> Async::Response {
+        Subscription subscription(hub, userId);
+        result.set_value(co_await subscription.next(timeout));
+        co_return Async::Reply{status_codes::OK, json::value::object()};
+    };
+    
+    std::promise<std::vector<Events::Event>> woken;
+    auto wokenEvents = woken.get_future();
+    waiter(http_request(), "alice", std::chrono::milliseconds(10000), woken);
+    ASSERT_EQUAL(static_cast<size_t>(1), hub.waiting());
+    
+    hub.publish("bob", {"levelUp", "3"});
+    ASSERT_TRUE(wokenEvents.wait_for(std::chrono::milliseconds(20)) == std::future_status::timeout);
+    
+    hub.publish("alice", {"levelUp", "2"});
+    ASSERT_TRUE(wokenEvents.wait_for(std::chrono::seconds(1)) == std::future_status::ready);
+    auto events = wokenEvents.get();
+    ASSERT_EQUAL(static_cast<size_t>(1), events.size());
+    ASSERT_EQUAL("levelUp", events[0].type);
+    ASSERT_EQUAL("2", events[0].detail);
+    ASSERT_EQUAL(static_cast<size_t>(0), hub.waiting());
+    
+    // Nothing published: the timer answers with no events.
+    std::promise<std::vector<Events::Event>> expired;
+    auto expiredEvents = expired.get_future();
+    waiter(http_request(), "alice", std::chrono::milliseconds(20), expired);
+    ASSERT_TRUE(expiredEvents.wait_for(std::chrono::seconds(1)) == std::future_status::ready);
+    ASSERT_TRUE(expiredEvents.get().empty());
+    ASSERT_EQUAL(static_cast<size_t>(0), hub.waiting());
+    
+    // Published between subscribing and waiting: returned without parking.
+    Subscription early(hub, "carol");
+    hub.publish("carol", {"questCompleted", "Q001"});
+    std::promise<std::vector<Events::Event>> drained;
+    [](http_request, Subscription& subscription,
+       std::promise<std::vector<Events::Event>>& result) -> Async::Response {
+        result.set_value(co_await subscription.next(std::chrono::seconds(10)));
+        co_return Async::Reply{status_codes::OK, json::value::object()};
+    }(http_request(), early, drained);
+    ASSERT_EQUAL(static_cast<size_t>(0), hub.waiting());
+    ASSERT_EQUAL("questCompleted", drained.get_future().get()[0].type);
 }
 
 // ============================================================================
@@ -378,6 +796,891 @@ void testWorkoutCreation() {
     ASSERT_EQUAL(userId, workout.user_id);
 }
 
+void testRecordWorkout() {
+    Config::Database db;
+    db.connect();
+    
+    std::string testEmail = "record_" + std::to_string(time(nullptr)) + "@test.com";
+    std::string userId = db.createUser("recorduser", testEmail, "password");
+    
+    FitnessDB::WorkoutSession session;
+    session.user_id = userId;
+    session.end_time = time(nullptr);
+    session.exercises = {"EX001"};
+    session.total_calories = 180;
+    session.form_score = 87.5f;
+    
+    std::string workoutId = db.logWorkout(session, 120, 3);
+    
+    FitnessDB::WorkoutSession stored = db.getWorkout(workoutId);
+    ASSERT_EQUAL(180, stored.total_calories);
+    ASSERT_EQUAL(static_cast<size_t>(1), stored.exercises.size());
+    ASSERT_TRUE(stored.end_time != 0);
+    
+    FitnessDB::User user = db.getUser(userId);
+    ASSERT_EQUAL(120, user.experience_points);
+    ASSERT_EQUAL(3, user.fitness_level);
+}
+
+void testWriteBehindUpdate() {
+    Config::Database db;
+    db.connect();
+    
+    std::string testEmail = "deferred_" + std::to_string(time(nullptr)) + "@test.com";
+    std::string userId = db.createUser("deferreduser", testEmail, "password");
+    
+    db.updateUserDeferred(userId, [](FitnessDB::User& user) { user.last_login = 12345; });
+    ASSERT_EQUAL(static_cast<time_t>(12345), db.getUser(userId).last_login);
+    
+    // A clean disconnect must persist the pending update.
+    db.disconnect();
+    ASSERT_TRUE(db.connect());
+    ASSERT_EQUAL(static_cast<time_t>(12345), db.getUser(userId).last_login);
+}
+
+void testZeroCopyUserRead() {
+    Config::Database db;
+    db.connect();
+    
+    std::string testEmail = "visit_" + std::to_string(time(nullptr)) + "@test.com";
+    std::string userId = db.createUser("visituser", testEmail, "password");
+    
+    size_t nameLength = db.withUser(userId, [](const FitnessDB::CompactUser& user) {
+        return user.username().size();
+    });
+    ASSERT_EQUAL(std::string("visituser").size(), nameLength);
+    ASSERT_THROWS(db.withUser("NO_SUCH_USER", [](const FitnessDB::CompactUser& user) { return user.fitness_level; }));
+}
+
+void testParallelTableLoad() {
+    std::string path = "./parallel_load_test.dat";
+    
+    FitnessDB::CompleteBTree<std::string, int> tree;
+    for (int i = 0; i < 5000; i++) {
+        tree.insert("KEY_" + std::to_string(i), i);
+    }
+    
+    auto save = [](std::ostream& os, const std::string& key, const int& value) {
+        FitnessDB::write_string(os, key);
+        os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+    auto load = [](std::istream& is, std::string& key, int& value) {
+        FitnessDB::read_string(is, key);
+        is.read(reinterpret_cast<char*>(&value), sizeof(value));
+    };
+    tree.save_to_file(path, save, 128);
+    
+    FitnessDB::CompleteBTree<std::string, int> loaded;
+    loaded.load_from_file(path, load, 4);
+    std::remove(path.c_str());
+    std::remove((path + ".idx").c_str());
+    
+    ASSERT_EQUAL(tree.get_size(), loaded.get_size());
+    ASSERT_TRUE(tree.get_all_keys() == loaded.get_all_keys());
+    ASSERT_EQUAL(4321, loaded.search("KEY_4321"));
+}
+
+void testSlabStorageTree() {
+    FitnessDB::CompleteBTree<std::string, std::string, FitnessDB::SlabStorage<std::string>> tree;
+    for (int i = 0; i < 2000; i++) {
+        tree.insert("KEY_" + std::to_string(i), "value_" + std::to_string(i));
+    }
+    for (int i = 0; i < 2000; i += 2) {
+        tree.insert("KEY_" + std::to_string(i), "updated_" + std::to_string(i));
+    }
+    
+    ASSERT_EQUAL(static_cast<size_t>(2000), tree.get_size());
+    ASSERT_EQUAL(std::string("updated_1234"), tree.search("KEY_1234"));
+    ASSERT_EQUAL(std::string("value_1235"), tree.search("KEY_1235"));
+    ASSERT_TRUE(tree.find("KEY_2000") == nullptr);
+}
+
+void testNormalizedKeyOrder() {
+    // Keys that share long prefixes, tie on their first normalized word or
+    // are prefixes of one another must still sort and resolve exactly.
+    std::vector<std::string> keys = {
+        "USER_1765130866_1", "USER_1765130866_10", "USER_1765130866_2",
+        "USER_1765130866_00000000_a", "USER_1765130866_00000000_b",
+        "USER_", "USER", "WORKOUT_1765130866_7", "EX001", "EX0010"
+    };
+    
+    FitnessDB::CompleteBTree<std::string, int> tree;
+    for (size_t i = 0; i < keys.size(); i++) {
+        tree.insert(keys[i], static_cast<int>(i));
+    }
+    
+    std::vector<std::string> sorted = keys;
+    std::sort(sorted.begin(), sorted.end());
+    ASSERT_TRUE(tree.get_all_keys() == sorted);
+    for (size_t i = 0; i < keys.size(); i++) {
+        ASSERT_EQUAL(static_cast<int>(i), tree.search(keys[i]));
+    }
+    ASSERT_FALSE(tree.exists("USER_1765130866_00000000_c"));
+    ASSERT_FALSE(tree.exists("USER_1765130866_"));
+}
+
+void testBatchInsert() {
+    FitnessDB::CompleteBTree<std::string, int> tree;
+    for (int i = 0; i < 500; i += 2) {
+        tree.insert("KEY_" + std::to_string(i), i);
+    }
+    
+    std::vector<std::pair<std::string, int>> batch;
+    for (int i = 999; i >= 0; i--) {
+        batch.emplace_back("KEY_" + std::to_string(i), -i);
+    }
+    batch.emplace_back("KEY_7", 7000); // later duplicate wins
+    tree.insert_batch(batch);
+    
+    ASSERT_EQUAL(static_cast<size_t>(1000), tree.get_size());
+    ASSERT_EQUAL(-42, tree.search("KEY_42"));
+    ASSERT_EQUAL(7000, tree.search("KEY_7"));
+    ASSERT_EQUAL(-999, tree.search("KEY_999"));
+    
+    auto keys = tree.get_all_keys();
+    ASSERT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+}
+
+void testConcurrentBLinkTree() {
+    FitnessDB::ConcurrentBLinkTree<std::string, std::string> tree;
+    for (int i = 0; i < 1000; i++) {
+        tree.insert("KEY_" + std::to_string(i), "value_" + std::to_string(i));
+    }
+    
+    // Writers split leaves and swap values while readers check that every
+    // key they find still maps to a value written for it.
+    std::atomic<bool> mismatch(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&tree, &mismatch, t]() {
+            for (int i = 0; i < 3000; i++) {
+                int k = (i * 7 + t * 131) % 2000;
+                std::string key = "KEY_" + std::to_string(k);
+                if (t % 2 == 0) {
+                    tree.insert(key, "value_" + std::to_string(k));
+                } else {
+                    tree.visit(key, [&](const std::string& value) {
+                        if (value != "value_" + std::to_string(k)) mismatch = true;
+                    });
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    
+    ASSERT_FALSE(mismatch.load());
+    auto keys = tree.get_all_keys();
+    ASSERT_EQUAL(tree.get_size(), keys.size());
+    ASSERT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+    ASSERT_EQUAL(std::string("value_1500"), tree.search("KEY_1500"));
+    ASSERT_FALSE(tree.exists("KEY_2000"));
+}
+
+void testBloomFilterLookups() {
+    FitnessDB::CompleteBTree<std::string, int> tree;
+    for (int i = 0; i < 5000; i++) {
+        tree.insert("WORKOUT_" + std::to_string(i), i);
+    }
+    
+    // No false negatives, and misses come back empty instead of throwing.
+    for (int i = 0; i < 5000; i++) {
+        ASSERT_TRUE(tree.exists("WORKOUT_" + std::to_string(i)));
+    }
+    ASSERT_EQUAL(4321, tree.try_get("WORKOUT_4321").value_or(-1));
+    ASSERT_FALSE(tree.try_get("WORKOUT_5000").has_value());
+    
+    FitnessDB::BlockedBloomFilter<std::string> filter(5000);
+    for (int i = 0; i < 5000; i++) {
+        filter.add("USER_" + std::to_string(i));
+    }
+    int falsePositives = 0;
+    for (int i = 5000; i < 15000; i++) {
+        if (filter.may_contain("USER_" + std::to_string(i))) falsePositives++;
+    }
+    ASSERT_TRUE(falsePositives < 200); // well under 2%
+    
+    // The filter sidecar round-trips next to the table file.
+    std::string dataPath = "./bloom_test.dat";
+    std::string data, index, bloom;
+    auto save = [](std::ostream& os, const std::string& key, const int& value) {
+        FitnessDB::write_string(os, key);
+        os.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+    auto load = [](std::istream& is, std::string& key, int& value) {
+        FitnessDB::read_string(is, key);
+        is.read(reinterpret_cast<char*>(&value), sizeof(value));
+    };
+    tree.serialize_to(data, index, save, 0, &bloom);
+    std::ofstream(dataPath, std::ios::binary) << data;
+    std::ofstream(FitnessDB::table_filter_path(dataPath), std::ios::binary) << bloom;
+    
+    FitnessDB::CompleteBTree<std::string, int> reloaded;
+    reloaded.load_from_file(dataPath, load);
+    ASSERT_EQUAL(static_cast<size_t>(5000), reloaded.get_size());
+    ASSERT_EQUAL(17, reloaded.try_get("WORKOUT_17").value_or(-1));
+    ASSERT_FALSE(reloaded.exists("WORKOUT_-1"));
+    
+    std::remove(dataPath.c_str());
+    std::remove(FitnessDB::table_filter_path(dataPath).c_str());
+    
+    Config::Database db;
+    db.connect();
+    ASSERT_FALSE(db.tryGetUser("NO_SUCH_USER").has_value());
+    ASSERT_FALSE(db.tryGetUserByEmail("nobody@example.com").has_value());
+    ASSERT_TRUE(db.tryGetUserByEmail("admin@fitnessquest.com").has_value());
+    ASSERT_FALSE(db.tryGetWorkout("NO_SUCH_WORKOUT").has_value());
+}
+
+// The email filter is sized when the index loads; registrations past that
+// size grow it at the next checkpoint instead of degrading every lookup.
+void testEmailFilterGrowth() {
+    std::string dir = "./email_filter_test";
+    FitnessDB::DatabaseOptions options;
+    options.checkpoint_interval = 1000000;
+    FitnessDB::PersistentFitnessDatabase db(dir, options);
+    db.clear_all_data();
+    
+    size_t capacity = db.get_stats().other.email_filter_capacity;
+    FitnessDB::PersistentFitnessDatabase::WriteBatch batch;
+    for (size_t i = 0; i <= capacity; i++) {
+        batch.add_email_index("grow" + std::to_string(i) + "@test.com", "USER_GROW_" + std::to_string(i));
+    }
+    db.commit(batch);
+    ASSERT_EQUAL(capacity, db.get_stats().other.email_filter_capacity);
+    
+    db.checkpoint();
+    auto stats = db.get_stats();
+    ASSERT_TRUE(stats.other.email_filter_capacity >= stats.other.email_index_size);
+    ASSERT_THROWS(db.create_user("dup", "grow7@test.com", "password"));
+    
+    db.clear_all_data();
+}
+
+void testPersistenceBackend() {
+    std::string log = "./backend_test.log";
+    std::string snapshot = "./backend_test.dat";
+    
+    for (const char* kind : {"auto", "pwrite"}) {
+        std::remove(log.c_str());
+        auto backend = FitnessDB::make_persistence_backend(kind);
+        backend->append(log, "first;");
+        backend->append(log, "second;");
+        backend->replace_file(snapshot, "stale");
+        backend->replace_file(snapshot, "staler");
+        backend->replace_file(snapshot, "fresh");
+        backend->flush();
+        
+        std::ifstream logFile(log, std::ios::binary);
+        std::string logData((std::istreambuf_iterator<char>(logFile)), std::istreambuf_iterator<char>());
+        ASSERT_EQUAL(std::string("first;second;"), logData);
+        
+        std::ifstream snapshotFile(snapshot, std::ios::binary);
+        std::string snapshotData((std::istreambuf_iterator<char>(snapshotFile)), std::istreambuf_iterator<char>());
+        ASSERT_EQUAL(std::string("fresh"), snapshotData);
+        
+        backend->truncate(log);
+        backend->append(log, "after;");
+        backend->flush();
+        ASSERT_EQUAL(static_cast<size_t>(6), FitnessDB::file_size(log));
+    }
+    
+    std::remove(log.c_str());
+    std::remove(snapshot.c_str());
+    
+    // A failed write fails the flush that covers it and every one after.
+    for (const char* kind : {"auto", "pwrite"}) {
+        auto backend = FitnessDB::make_persistence_backend(kind);
+        backend->replace_file("./no_such_dir/backend_test.dat", "lost");
+        ASSERT_THROWS(backend->flush());
+        backend->append(log, "after;");
+        ASSERT_THROWS(backend->flush());
+    }
+    std::remove(log.c_str());
+}
+
+// Holds its first batch until release(), so the ops queued meanwhile
+// reach the backend as one batch, and records what survives coalescing.
+class HeldWriteBackend : public FitnessDB::ThreadedWriteBackend {
+private:
+    std::mutex mutex;
+    std::condition_variable released;
+    bool holding = true;
+    
+protected:
+    void process_batch(std::vector<FitnessDB::WriteOp>& batch) override {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            released.wait(lock, [this]() { return !holding; });
+            for (const auto& op : batch) {
+                processed.push_back((op.kind == FitnessDB::WriteOp::Kind::REPLACE ? "R " :
+                                     op.kind == FitnessDB::WriteOp::Kind::TRUNCATE ? "T " : "A ") +
+                                    op.data);
+            }
+        }
+        ThreadedWriteBackend::process_batch(batch);
+    }
+    
+public:
+    std::vector<std::string> processed;
+    
+    ~HeldWriteBackend() override {
+        release();
+        stop();
+    }
+    
+    void release() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            holding = false;
+        }
+        released.notify_all();
+    }
+};
+
+void testCoalescingKeepsCheckpoints() {
+    std::string log = "./coalesce_test.log";
+    std::string snapshot = "./coalesce_test.dat";
+    std::string checkpoint = "./coalesce_test.ckpt";
+    std::remove(log.c_str());
+    
+    // Two checkpoints in one batch: the first one's snapshots must stay
+    // ahead of its truncate, or a crash after the truncate loses the log.
+    HeldWriteBackend backend;
+    backend.append(log, "op1");
+    backend.replace_file(snapshot, "snap1");
+    backend.replace_file(checkpoint, "ckpt1");
+    backend.truncate(log);
+    backend.append(log, "op2");
+    backend.replace_file(snapshot, "snap2a");
+    backend.replace_file(snapshot, "snap2b");
+    backend.replace_file(checkpoint, "ckpt2");
+    backend.truncate(log);
+    backend.release();
+    backend.flush();
+    
+    std::vector<std::string> expected = {"A op1", "R snap1", "R ckpt1", "T ",
+                                         "A op2", "R snap2b", "R ckpt2", "T "};
+    ASSERT_TRUE(backend.processed == expected);
+    ASSERT_EQUAL(static_cast<size_t>(0), FitnessDB::file_size(log));
+    
+    // Replacements of one file split by an append both survive; io_uring
+    // must not write them through the same temp file.
+    auto uring = FitnessDB::make_persistence_backend("auto");
+    uring->replace_file(snapshot, "first");
+    uring->append(log, "between;");
+    uring->replace_file(snapshot, "second");
+    uring->flush();
+    std::ifstream snapshotFile(snapshot, std::ios::binary);
+    std::string snapshotData((std::istreambuf_iterator<char>(snapshotFile)), std::istreambuf_iterator<char>());
+    ASSERT_EQUAL(std::string("second"), snapshotData);
+    
+    std::remove(log.c_str());
+    std::remove(snapshot.c_str());
+    std::remove(checkpoint.c_str());
+}
+
+void testTransactionCommit() {
+    Config::Database db;
+    db.connect();
+    
+    std::string testEmail = "txn_" + std::to_string(time(nullptr)) + "@test.com";
+    std::string userId = db.createUser("txnuser", testEmail, "password");
+    
+    std::string workoutId;
+    {
+        auto txn = db.begin();
+        FitnessDB::User user = txn.getUser(userId);
+        user.experience_points += 250;
+        txn.updateUser(user);
+        ASSERT_EQUAL(user.experience_points, txn.getUser(userId).experience_points);
+        
+        workoutId = txn.startWorkout(userId);
+        txn.completeWorkout(workoutId);
+        txn.commit();
+    }
+    ASSERT_EQUAL(250, db.getUser(userId).experience_points);
+    ASSERT_TRUE(db.getWorkout(workoutId).end_time != 0);
+    
+    {
+        auto txn = db.begin();
+        FitnessDB::User user = txn.getUser(userId);
+        user.experience_points = 0;
+        txn.updateUser(user);
+        // dropped without commit
+    }
+    ASSERT_EQUAL(250, db.getUser(userId).experience_points);
+}
+
+void testDurableCommit() {
+    std::string dir = "./durable_commit_test";
+    std::string wal = dir + "/wal.log";
+    std::filesystem::remove_all(dir);
+    {
+        Config::Database db(dir);
+        ASSERT_TRUE(db.connect());
+        
+        // No flush: a write is on disk by the time it returns.
+        size_t before = FitnessDB::file_size(wal);
+        std::string userId = db.createUser("durable", "durable@test.com", "password");
+        size_t afterCreate = FitnessDB::file_size(wal);
+        ASSERT_TRUE(afterCreate > before);
+        
+        auto txn = db.begin();
+        FitnessDB::User user = txn.getUser(userId);
+        user.experience_points += 10;
+        txn.updateUser(user);
+        txn.commit();
+        ASSERT_TRUE(FitnessDB::file_size(wal) > afterCreate);
+        ASSERT_THROWS(txn.commit());
+        
+        // commit() released the lock, so other requests are not stuck behind it.
+        ASSERT_EQUAL(10, db.getUser(userId).experience_points);
+    }
+    std::filesystem::remove_all(dir);
+}
+
+void testWalReplay() {
+    std::string dir = "./wal_replay_test";
+    FitnessDB::DatabaseOptions options;
+    options.checkpoint_interval = 1000;
+    std::filesystem::remove_all(dir);
+    
+    std::string userId;
+    {
+        // The writer checkpoints when it closes, so it must be gone before
+        // the directory is removed below.
+        FitnessDB::PersistentFitnessDatabase writer(dir, options);
+        userId = writer.create_user("waluser", "wal@test.com", "password");
+        writer.flush();
+        ASSERT_TRUE(FitnessDB::file_size(dir + "/wal.log") > 0);
+        
+        // Only the WAL holds the new user; opening the directory must replay it.
+        FitnessDB::PersistentFitnessDatabase reader(dir, options);
+        ASSERT_EQUAL(std::string("waluser"), reader.get_user(userId).username);
+        ASSERT_EQUAL(userId, reader.get_user_by_email("wal@test.com").id);
+    }
+    
+    std::filesystem::remove_all(dir);
+}
+
+static std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+static void writeFile(const std::string& path, const std::string& contents) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << contents;
+}
+
+void testCheckpointCrashReplay() {
+    std::string dir = "./checkpoint_crash_test";
+    FitnessDB::DatabaseOptions options;
+    options.checkpoint_interval = 1000;
+    {
+        FitnessDB::PersistentFitnessDatabase fresh(dir, options);
+        fresh.clear_all_data();
+    }
+    
+    FitnessDB::PersistentFitnessDatabase::DatabaseStats before;
+    std::string checkpoint, wal;
+    {
+        FitnessDB::PersistentFitnessDatabase db(dir, options);
+        before = db.get_stats();
+        db.create_user("crashuser", "crash@test.com", "password");
+        FitnessDB::Exercise lunge;
+        lunge.id = "EX_CRASH";
+        lunge.prerequisites = {"EX001"};
+        db.add_exercise(lunge);
+        FitnessDB::Quest high, mid;
+        high.id = "Q_CRASH_HIGH";
+        high.priority = 5;
+        mid.id = "Q_CRASH_MID";
+        mid.priority = 3;
+        db.add_quest(high);
+        db.add_quest(mid);
+        ASSERT_EQUAL(std::string("Q001"), db.get_next_quest().id);
+        db.flush();
+        checkpoint = readFile(dir + "/checkpoint.dat");
+        wal = readFile(dir + "/wal.log");
+    }
+    
+    // The closing checkpoint renamed every snapshot into place. Put back the
+    // old checkpoint.dat and log, as if power failed before its rename.
+    writeFile(dir + "/checkpoint.dat", checkpoint);
+    writeFile(dir + "/wal.log", wal);
+    
+    FitnessDB::PersistentFitnessDatabase reopened(dir, options);
+    auto after = reopened.get_stats();
+    ASSERT_EQUAL(before.other.email_index_size + 1, after.other.email_index_size);
+    ASSERT_EQUAL(before.other.graph_edges + 1, after.other.graph_edges);
+    ASSERT_EQUAL(before.other.priority_queue_size + 1, after.other.priority_queue_size);
+    ASSERT_EQUAL(std::string("Q_CRASH_MID"), reopened.get_next_quest().id);
+    
+    reopened.clear_all_data();
+}
+
+void testWorkoutTiering() {
+    std::string dir = "./tiering_test";
+    FitnessDB::DatabaseOptions options;
+    options.checkpoint_interval = 1000;
+    options.workout_hot_seconds = 3600;
+    options.segment_records = 3;
+    
+    std::string userId, agedId;
+    {
+        FitnessDB::PersistentFitnessDatabase writer(dir, options);
+        userId = writer.create_user("tieruser", "tier@test.com", "password");
+        for (int i = 0; i < 4; i++) {
+            FitnessDB::WorkoutSession session;
+            session.id = "WORKOUT_TIER_" + std::to_string(i);
+            session.user_id = i < 3 ? userId : "ADMIN001";
+            session.start_time = time(nullptr) - 2 * 24 * 3600 - i;
+            session.exercises = {"EX001"};
+            writer.record_workout(session, 10);
+        }
+        agedId = "WORKOUT_TIER_1";
+        writer.start_workout(userId);
+        
+        // Four aged sessions reach segment_records; the new one stays in memory.
+        writer.checkpoint();
+        writer.flush();
+        ASSERT_TRUE(FitnessDB::file_exists(dir + "/workouts.seg.1"));
+        ASSERT_EQUAL(size_t(4), writer.get_stats().btree.cold_workout_count);
+        ASSERT_EQUAL(size_t(5), writer.get_stats().btree.workout_count);
+    }
+    
+    FitnessDB::PersistentFitnessDatabase reopened(dir, options);
+    FitnessDB::WorkoutSession aged = reopened.get_workout(agedId);
+    ASSERT_EQUAL(userId, aged.user_id);
+    ASSERT_TRUE(aged.exercises.contains(std::string("EX001")));
+    ASSERT_FALSE(reopened.try_get_workout("WORKOUT_TIER_MISSING").has_value());
+    
+    auto workouts = reopened.get_user_workouts(userId);
+    ASSERT_EQUAL(size_t(4), workouts.size());
+    ASSERT_TRUE(workouts[0].start_time >= workouts[1].start_time);
+    ASSERT_EQUAL(std::string("WORKOUT_TIER_2"), workouts[3].id);
+    ASSERT_EQUAL(size_t(1), reopened.get_recent_user_workouts(userId).size());
+    
+    // An updated cold workout is shadowed by its copy in memory.
+    reopened.complete_workout(agedId);
+    ASSERT_TRUE(reopened.get_workout(agedId).end_time > 0);
+    ASSERT_EQUAL(size_t(4), reopened.get_user_workouts(userId).size());
+    
+    // An unreadable segment fails the open rather than losing its workouts.
+    std::string segment = dir + "/workouts.seg.1";
+    std::string intact = readFile(segment);
+    writeFile(segment, intact.substr(0, intact.size() / 2));
+    ASSERT_THROWS(FitnessDB::PersistentFitnessDatabase(dir, options));
+    writeFile(segment, intact);
+    
+    reopened.clear_all_data();
+    ASSERT_FALSE(FitnessDB::file_exists(dir + "/workouts.seg.1"));
+}
+
+void testLsmTableEngine() {
+    // Leftover B-tree files would be imported over the LSM ones.
+    std::string dir = "./lsm_test";
+    std::filesystem::remove_all(dir);
+    FitnessDB::create_directory(dir);
+    auto backend = FitnessDB::make_persistence_backend("pwrite");
+    FitnessDB::LsmOptions lsm;
+    lsm.l0_compaction_trigger = 2;
+    lsm.background_compaction = false;
+    
+    {
+        FitnessDB::LsmTable<std::string, FitnessDB::Quest> table(dir + "/quests", *backend, lsm);
+        for (int round = 0; round < 3; round++) {
+            for (int i = 0; i < 50; i++) {
+                FitnessDB::Quest quest;
+                quest.id = "Q" + std::to_string(i);
+                quest.priority = round;
+                table.insert(quest.id, quest);
+            }
+            table.snapshot(0);
+        }
+        table.compact();
+        ASSERT_EQUAL(size_t(0), table.level_sizes()[0]);
+        ASSERT_EQUAL(size_t(50), table.get_size());
+        ASSERT_EQUAL(2, table.search("Q7").priority);
+        ASSERT_FALSE(table.exists("Q50"));
+        
+        uint64_t mark = table.durability_mark();
+        backend->flush();
+        table.on_durable(mark);
+    }
+    
+    // A manifest written while the memtable holds records, then a crash:
+    // the WAL replays those records, and they must not be counted twice.
+    FitnessDB::LsmOptions eager = lsm;
+    eager.l0_compaction_trigger = 1;
+    auto replayed = [](FitnessDB::LsmTable<std::string, FitnessDB::Quest>& table) {
+        for (const char* id : {"C0", "C1", "N0", "N1"}) {
+            FitnessDB::Quest quest;
+            quest.id = id;
+            table.insert(quest.id, quest);
+        }
+    };
+    {
+        FitnessDB::LsmTable<std::string, FitnessDB::Quest> table(dir + "/counted", *backend, eager);
+        for (const char* id : {"C0", "C1", "C2"}) {
+            FitnessDB::Quest quest;
+            quest.id = id;
+            table.insert(quest.id, quest);
+        }
+        table.snapshot(0);
+        replayed(table);
+        ASSERT_EQUAL(size_t(5), table.get_size());
+        table.compact();
+        backend->flush();
+    }
+    {
+        FitnessDB::LsmTable<std::string, FitnessDB::Quest> table(dir + "/counted", *backend, eager);
+        table.load(1);
+        ASSERT_EQUAL(size_t(3), table.get_size());
+        replayed(table);
+        ASSERT_EQUAL(size_t(5), table.get_size());
+        table.snapshot(0);
+        ASSERT_EQUAL(size_t(5), table.get_size());
+        backend->flush();
+    }
+    
+    // Whole database on the LSM engine, then switched back to B-trees.
+    FitnessDB::DatabaseOptions options;
+    options.checkpoint_interval = 1000;
+    options.table_engines = {{"users", "lsm"}, {"workouts", "lsm"}, {"quests", "lsm"}};
+    options.lsm = lsm;
+    std::string userId, workoutId;
+    {
+        FitnessDB::PersistentFitnessDatabase db(dir, options);
+        userId = db.create_user("lsmuser", "lsm@test.com", "password");
+        workoutId = db.start_workout(userId);
+    }
+    {
+        FitnessDB::PersistentFitnessDatabase db(dir, options);
+        ASSERT_TRUE(FitnessDB::file_exists(dir + "/users.lsm"));
+        ASSERT_EQUAL(std::string("lsmuser"), db.get_user(userId).username);
+        ASSERT_EQUAL(userId, db.get_workout(workoutId).user_id);
+        ASSERT_EQUAL(size_t(1), db.get_user_workouts(userId).size());
+    }
+    
+    options.table_engines.clear();
+    FitnessDB::PersistentFitnessDatabase db(dir, options);
+    ASSERT_EQUAL(std::string("lsmuser"), db.get_user(userId).username);
+    ASSERT_EQUAL(std::string("Q7"), db.get_quest("Q7").id);
+    db.flush();
+    ASSERT_FALSE(FitnessDB::file_exists(dir + "/users.lsm"));
+    
+    db.clear_all_data();
+    ASSERT_FALSE(FitnessDB::file_exists(dir + "/quests.sst.1"));
+}
+
+void testInternedSymbols() {
+    FitnessDB::SymbolList muscles = {"chest", "triceps"};
+    muscles.push_back("chest");
+    ASSERT_EQUAL(muscles.symbol(0), muscles.symbol(2));
+    ASSERT_EQUAL(std::string("triceps"), muscles[1]);
+    ASSERT_TRUE(muscles.contains(FitnessDB::intern("triceps")));
+    ASSERT_FALSE(muscles.contains(std::string("never_interned_muscle")));
+    
+    std::string dir = "./symbols_test";
+    std::string reward = "Badge_" + std::to_string(time(nullptr));
+    FitnessDB::DatabaseOptions options;
+    options.checkpoint_interval = 1000;
+    
+    {
+        // The reward symbol is newer than the writer's symbols.dat, so only
+        // the WAL record can name it.
+        FitnessDB::PersistentFitnessDatabase writer(dir, options);
+        FitnessDB::Quest quest;
+        quest.id = "QSYM";
+        quest.required_exercises = {"EX001", "EX002"};
+        quest.rewards.push_back(reward);
+        writer.add_quest(quest);
+        writer.flush();
+        
+        FitnessDB::PersistentFitnessDatabase reader(dir, options);
+        FitnessDB::Quest replayed = reader.get_quest("QSYM");
+        ASSERT_EQUAL(reward, replayed.rewards[0]);
+        ASSERT_TRUE(replayed.required_exercises.contains(std::string("EX002")));
+    }
+    
+    // Reopen from the checkpointed snapshot and dictionary.
+    FitnessDB::PersistentFitnessDatabase reopened(dir, options);
+    ASSERT_TRUE(FitnessDB::file_exists(dir + "/symbols.dat"));
+    ASSERT_EQUAL(reward, reopened.get_quest("QSYM").rewards[0]);
+    reopened.clear_all_data();
+}
+
+// Turns a checkpointed directory back into the pre-dictionary format: no
+// symbols.dat, and the queued quest's lists stored as names. The quest
+// table goes, since only the queue is rewritten; the remaining files hold
+// no symbols, so their bytes are the same in both formats.
+static void writeLegacyQueue(const std::string& dir) {
+    for (const char* file : {"symbols.dat", "quests.dat", "quests.dat.idx", "quests.dat.bloom"}) {
+        std::remove((dir + "/" + file).c_str());
+    }
+    
+    std::ofstream out(dir + "/priority_queue.dat", std::ios::binary | std::ios::trunc);
+    size_t count = 1;
+    int priority = 1, difficulty = 1;
+    time_t deadline = 0, timestamp = time(nullptr);
+    bool completed = false;
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    FitnessDB::write_string(out, "Q001");
+    FitnessDB::write_string(out, "Daily Challenge");
+    FitnessDB::write_string(out, "Complete basic exercises");
+    out.write(reinterpret_cast<const char*>(&priority), sizeof(priority));
+    out.write(reinterpret_cast<const char*>(&difficulty), sizeof(difficulty));
+    FitnessDB::write_vector_string(out, {"EX001", "EX002"});
+    FitnessDB::write_vector_string(out, {"100 XP"});
+    out.write(reinterpret_cast<const char*>(&deadline), sizeof(deadline));
+    out.write(reinterpret_cast<const char*>(&completed), sizeof(completed));
+    out.write(reinterpret_cast<const char*>(&priority), sizeof(priority));
+    out.write(reinterpret_cast<const char*>(&timestamp), sizeof(timestamp));
+}
+
+void testLegacySymbolMigration() {
+    std::string dir = "./legacy_symbols_test";
+    FitnessDB::DatabaseOptions options;
+    options.checkpoint_interval = 1000;
+    options.io_threads = 8;
+    
+    {
+        // A large exercise table keeps the opening thread busy, so the
+        // other files are parsed on pool workers.
+        FitnessDB::PersistentFitnessDatabase fresh(dir, options);
+        fresh.clear_all_data();
+        FitnessDB::PersistentFitnessDatabase::WriteBatch batch;
+        for (int i = 0; i < 20000; i++) {
+            FitnessDB::Exercise exercise;
+            exercise.id = "EX_LEGACY_" + std::to_string(i);
+            exercise.name = "Legacy exercise";
+            batch.put_exercise(exercise);
+        }
+        fresh.commit(batch);
+    }
+    
+    for (int run = 0; run < 10; run++) {
+        writeLegacyQueue(dir);
+        FitnessDB::PersistentFitnessDatabase db(dir, options);
+        FitnessDB::Quest queued = db.get_next_quest();
+        ASSERT_EQUAL(std::string("Q001"), queued.id);
+        ASSERT_EQUAL(size_t(2), queued.required_exercises.size());
+        ASSERT_EQUAL(std::string("EX001"), queued.required_exercises[0]);
+        ASSERT_EQUAL(std::string("EX002"), queued.required_exercises[1]);
+        ASSERT_EQUAL(size_t(1), queued.rewards.size());
+        ASSERT_EQUAL(std::string("100 XP"), queued.rewards[0]);
+    }
+    
+    FitnessDB::PersistentFitnessDatabase cleanup(dir, options);
+    cleanup.clear_all_data();
+}
+
+void testCatalogVersion() {
+    Config::Database db;
+    db.connect();
+    uint64_t start = db.catalogVersion();
+    
+    FitnessDB::Quest quest;
+    quest.id = "QUEST_cache_" + std::to_string(time(nullptr));
+    quest.title = "Cache Buster";
+    db.addQuest(quest);
+    uint64_t added = db.catalogVersion();
+    ASSERT_TRUE(added > start);
+    
+    // Only commits that touch the catalog invalidate it.
+    std::string userId = db.createUser("cacheuser", "cache_" + std::to_string(time(nullptr)) + "@test.com", "password");
+    {
+        auto txn = db.begin();
+        FitnessDB::User user = txn.getUser(userId);
+        user.experience_points += 10;
+        txn.updateUser(user);
+        txn.commit();
+    }
+    ASSERT_EQUAL(added, db.catalogVersion());
+    {
+        auto txn = db.begin();
+        quest.completed = true;
+        txn.updateQuest(quest);
+        txn.commit();
+    }
+    ASSERT_TRUE(db.catalogVersion() > added);
+}
+
+void testUserVersion() {
+    Config::Database db;
+    db.connect();
+    std::string stamp = std::to_string(time(nullptr));
+    std::string userId = db.createUser("versionuser", "version_" + stamp + "@test.com", "password");
+    
+    uint64_t created = db.userVersion(userId);
+    ASSERT_EQUAL(created, db.userVersion(userId));
+    
+    FitnessDB::User user = db.getUser(userId);
+    user.experience_points += 5;
+    db.updateUser(user);
+    uint64_t updated = db.userVersion(userId);
+    ASSERT_TRUE(updated > created);
+    
+    // Workout logging and quest completion commit through transactions.
+    FitnessDB::WorkoutSession session;
+    session.user_id = userId;
+    session.end_time = time(nullptr);
+    {
+        auto txn = db.begin();
+        txn.logWorkout(session, 25);
+        txn.commit();
+    }
+    uint64_t logged = db.userVersion(userId);
+    ASSERT_TRUE(logged > updated);
+    
+    db.updateUserDeferred(userId, [](FitnessDB::User& u) { u.last_login = time(nullptr); });
+    ASSERT_TRUE(db.userVersion(userId) > logged);
+}
+
+void testCompactUser() {
+    FitnessDB::User user;
+    user.id = "USER_1765130866_42";
+    user.username = "packer";
+    user.email = "packer@test.com";
+    user.password_hash = std::to_string(std::hash<std::string>{}("password"));
+    user.fitness_level = 7;
+    user.experience_points = 1234;
+    user.completed_exercises = {"EX001", "EX002", "EX003", "EX004", "EX005", "EX006"};
+    user.achievements = {"First Workout"};
+    user.created_at = 1765130866;
+    
+    FitnessDB::CompactUser packed = FitnessDB::CompactUser::pack(user);
+    ASSERT_EQUAL(std::string("packer"), std::string(packed.username()));
+    ASSERT_EQUAL(user.password_hash, packed.password_hash());
+    ASSERT_EQUAL(user.id.size() + user.username.size() + user.email.size(), packed.text_bytes());
+    ASSERT_TRUE(packed.has_completed(FitnessDB::intern("EX006")));
+    
+    FitnessDB::User copy = FitnessDB::CompactUser(packed).unpack();
+    ASSERT_EQUAL(user.email, copy.email);
+    ASSERT_EQUAL(7, copy.fitness_level);
+    ASSERT_EQUAL(1234, copy.experience_points);
+    ASSERT_TRUE(copy.completed_exercises == user.completed_exercises);
+    ASSERT_EQUAL(std::string("First Workout"), copy.achievements[0]);
+    ASSERT_EQUAL(user.created_at, copy.created_at);
+    
+    // Hashes that are not decimal digests are kept verbatim.
+    user.password_hash = "hashed_password";
+    ASSERT_EQUAL(std::string("hashed_password"), FitnessDB::CompactUser::pack(user).password_hash());
+    user.password_hash = "007";
+    ASSERT_EQUAL(std::string("007"), FitnessDB::CompactUser::pack(user).password_hash());
+    
+    std::stringstream stream;
+    packed.serialize(stream);
+    FitnessDB::User fromDisk;
+    fromDisk.deserialize(stream);
+    ASSERT_EQUAL(user.id, fromDisk.id);
+    ASSERT_EQUAL(std::string(packed.password_hash()), fromDisk.password_hash);
+}
+
 // ============================================================================
 // INTEGRATION TESTS
 // ============================================================================
@@ -463,8 +1766,19 @@ int main() {
         utilityTests.add("Password Validation", testPasswordValidation);
         utilityTests.add("JWT Generation", testJWTGeneration);
         utilityTests.add("JWT Verification", testJWTVerification);
+        utilityTests.add("JSON Writer", testJsonWriter);
+        utilityTests.add("JSON Reader", testJsonReader);
         utilityTests.run();
         
+        // Request Pipeline Tests
+        TestSuite routingTests("Request Pipeline");
+        routingTests.add("Route Trie Matching", testRouteTrieMatching);
+        routingTests.add("Executor Tasks", testExecutorTasks);
+        routingTests.add("Executor Bounds And Stealing", testExecutorBoundsAndStealing);
+        routingTests.add("Coroutine Adapters", testCoroutineAdapters);
+        routingTests.add("Response Cache", testResponseCache);
+        routingTests.run();
+        
         // Service Tests
         TestSuite serviceTests("Service Layer");
         serviceTests.add("Reward Service Creation", testRewardServiceCreation);
@@ -477,6 +1791,9 @@ int main() {
         gameSyncTests.add("Engine Creation", testGameSyncEngineCreation);
         gameSyncTests.add("Game State Retrieval", testGameStateRetrieval);
         gameSyncTests.add("Quest Retrieval", testQuestRetrieval);
+        gameSyncTests.add("State Change Log", testStateChangeLog);
+        gameSyncTests.add("Game State Since", testGameStateSince);
+        gameSyncTests.add("Notification Hub", testNotificationHub);
         gameSyncTests.run();
         
         // Database Tests
@@ -486,6 +1803,29 @@ int main() {
         databaseTests.add("User Creation", testUserCreation);
         databaseTests.add("User Retrieval", testUserRetrieval);
         databaseTests.add("Workout Creation", testWorkoutCreation);
+        databaseTests.add("Record Workout", testRecordWorkout);
+        databaseTests.add("Write-Behind Update", testWriteBehindUpdate);
+        databaseTests.add("Zero-Copy User Read", testZeroCopyUserRead);
+        databaseTests.add("Parallel Table Load", testParallelTableLoad);
+        databaseTests.add("Slab Storage Tree", testSlabStorageTree);
+        databaseTests.add("Normalized Key Order", testNormalizedKeyOrder);
+        databaseTests.add("Batch Insert", testBatchInsert);
+        databaseTests.add("Concurrent B-Link Tree", testConcurrentBLinkTree);
+        databaseTests.add("Bloom Filter Lookups", testBloomFilterLookups);
+        databaseTests.add("Email Filter Growth", testEmailFilterGrowth);
+        databaseTests.add("Persistence Backend", testPersistenceBackend);
+        databaseTests.add("Coalescing Keeps Checkpoints", testCoalescingKeepsCheckpoints);
+        databaseTests.add("Transaction Commit", testTransactionCommit);
+        databaseTests.add("Durable Commit", testDurableCommit);
+        databaseTests.add("WAL Replay", testWalReplay);
+        databaseTests.add("Interned Symbols", testInternedSymbols);
+        databaseTests.add("Legacy Symbol Migration", testLegacySymbolMigration);
+        databaseTests.add("Checkpoint Crash Replay", testCheckpointCrashReplay);
+        databaseTests.add("Workout Tiering", testWorkoutTiering);
+        databaseTests.add("LSM Table Engine", testLsmTableEngine);
+        databaseTests.add("Compact User Record", testCompactUser);
+        databaseTests.add("Catalog Version", testCatalogVersion);
+        databaseTests.add("User Version", testUserVersion);
         databaseTests.run();
         
         // Integration Tests
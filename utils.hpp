@@ -6,6 +6,15 @@
 #define FITNESS_QUEST_UTILS_HPP
 
 #include <string>
+#include <string_view>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <regex>
 #include <ctime>
 #include <sstream>
@@ -185,6 +194,511 @@ public:
         
         return authHeader.substr(7);
     }
+    
+    // True when If-None-Match lists `etag` (weak or strong) or is "*".
+    static bool matchesETag(http_request& request, const std::string& etag) {
+        if (!request.headers().has(U("If-None-Match"))) return false;
+        std::string header = utility::conversions::to_utf8string(request.headers()[U("If-None-Match")]);
+        
+        size_t pos = 0;
+        while (pos < header.size()) {
+            size_t end = header.find(',', pos);
+            if (end == std::string::npos) end = header.size();
+            size_t first = header.find_first_not_of(" \t", pos);
+            size_t last = header.find_last_not_of(" \t", end - 1);
+            if (first != std::string::npos && first < end) {
+                std::string_view candidate(header.data() + first, last - first + 1);
+                if (candidate.substr(0, 2) == "W/") candidate.remove_prefix(2);
+                if (candidate == "*" || candidate == etag) return true;
+            }
+            pos = end + 1;
+        }
+        return false;
+    }
+};
+
+// ============================================================================
+// HttpError - failure with the status code the client should see
+// ============================================================================
+class HttpError : public std::runtime_error {
+private:
+    status_code code;
+    
+public:
+    HttpError(status_code code, const std::string& message)
+        : std::runtime_error(message), code(code) {}
+    
+    status_code status() const { return code; }
+};
+
+// ============================================================================
+// JsonWriter - streaming JSON serializer for response bodies
+// ============================================================================
+// Appends straight into one string buffer, escaping as it goes: no DOM,
+// no per-field allocation. Commas are tracked with a bit per nesting level.
+//
+//     JsonWriter json;
+//     json.beginObject();
+//     json.field("success", true);
+//     json.key("quests"); json.beginArray(); ... json.endArray();
+//     json.endObject();
+//     Response::sendJsonText(request, status_codes::OK, json.take());
+class JsonWriter {
+private:
+    static constexpr size_t maxDepth = 64;
+    
+    std::string out;
+    uint64_t hasItems = 0;   // bit d: container at depth d already has a member
+    size_t depth = 0;
+    bool afterKey = false;
+    
+    void separate() {
+        if (afterKey) {
+            afterKey = false;
+            return;
+        }
+        if (depth == 0) return;
+        uint64_t bit = uint64_t(1) << (depth - 1);
+        if (hasItems & bit) out += ',';
+        hasItems |= bit;
+    }
+    
+    void open(char bracket) {
+        separate();
+        if (depth == maxDepth) throw std::runtime_error("JSON nesting too deep");
+        out += bracket;
+        hasItems &= ~(uint64_t(1) << depth);
+        depth++;
+    }
+    
+    void close(char bracket) {
+        if (depth == 0) throw std::runtime_error("Unbalanced JSON container");
+        depth--;
+        out += bracket;
+    }
+    
+    void writeString(std::string_view text) {
+        static const char hex[] = "0123456789abcdef";
+        out += '"';
+        size_t run = 0;   // start of the pending unescaped run
+        for (size_t i = 0; i < text.size(); i++) {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+            out.append(text.data() + run, i - run);
+            run = i + 1;
+            switch (c) {
+                case '"':  out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\b': out += "\\b"; break;
+                case '\f': out += "\\f"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default: {
+                    char escaped[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+                    out.append(escaped, sizeof(escaped));
+                }
+            }
+        }
+        out.append(text.data() + run, text.size() - run);
+        out += '"';
+    }
+    
+    template <typename Number>
+    void writeNumber(Number number) {
+        char digits[32];
+        auto result = std::to_chars(digits, digits + sizeof(digits), number);
+        out.append(digits, result.ptr);
+    }
+    
+public:
+    explicit JsonWriter(size_t capacity = 256) { out.reserve(capacity); }
+    
+    void beginObject() { open('{'); }
+    void endObject() { close('}'); }
+    void beginArray() { open('['); }
+    void endArray() { close(']'); }
+    
+    void key(std::string_view name) {
+        separate();
+        writeString(name);
+        out += ':';
+        afterKey = true;
+    }
+    
+    void value(std::string_view text) { separate(); writeString(text); }
+    void value(const char* text) { value(std::string_view(text)); }
+    void value(const std::string& text) { value(std::string_view(text)); }
+    void value(bool flag) { separate(); out += flag ? "true" : "false"; }
+    void value(int number) { separate(); writeNumber(number); }
+    void value(long number) { separate(); writeNumber(number); }
+    void value(long long number) { separate(); writeNumber(number); }
+    void value(unsigned number) { separate(); writeNumber(number); }
+    void value(unsigned long number) { separate(); writeNumber(number); }
+    void value(unsigned long long number) { separate(); writeNumber(number); }
+    void value(double number) {
+        separate();
+        // JSON has no NaN or infinity; cpprest writes those as null too.
+        if (std::isfinite(number)) writeNumber(number);
+        else out += "null";
+    }
+    void null() { separate(); out += "null"; }
+    
+    template <typename T>
+    void field(std::string_view name, const T& v) {
+        key(name);
+        value(v);
+    }
+    
+    const std::string& str() const { return out; }
+    
+    // Hands the buffer over (to a response body) without copying.
+    std::string take() {
+        if (depth != 0) throw std::runtime_error("Unbalanced JSON container");
+        hasItems = 0;
+        afterKey = false;
+        return std::move(out);
+    }
+    
+    // Starts a new document, keeping the buffer's capacity.
+    void clear() {
+        out.clear();
+        hasItems = 0;
+        depth = 0;
+        afterKey = false;
+    }
+};
+
+// ============================================================================
+// JsonReader - typed, single-pass decoding of request bodies
+// ============================================================================
+// Request structs describe their JSON fields once, at compile time:
+//
+//     template <> struct JsonSchema<Credentials> {
+//         static constexpr auto fields = std::make_tuple(
+//             jsonRequired("email", &Credentials::email),
+//             jsonRequired("password", &Credentials::password));
+//     };
+//
+// and JsonReader::decode<Credentials>(body) fills one straight from the
+// bytes: no DOM, unknown fields skipped, null treated as absent. Every
+// failure is an HttpError(400) naming the field or the byte offset.
+template <typename T>
+struct JsonSchema;
+
+template <typename Owner, typename Member, typename Convert>
+struct JsonField {
+    std::string_view name;
+    Member Owner::* member;
+    bool required;
+    Convert convert;   // string -> Member for enum-like fields, or nullptr
+};
+
+template <typename Owner, typename Member>
+constexpr auto jsonRequired(std::string_view name, Member Owner::* member) {
+    return JsonField<Owner, Member, std::nullptr_t>{name, member, true, nullptr};
+}
+
+template <typename Owner, typename Member>
+constexpr auto jsonOptional(std::string_view name, Member Owner::* member) {
+    return JsonField<Owner, Member, std::nullptr_t>{name, member, false, nullptr};
+}
+
+// `convert` turns the field's string into the member and throws
+// std::exception on values it does not know.
+template <typename Owner, typename Member>
+constexpr auto jsonRequired(std::string_view name, Member Owner::* member, Member (*convert)(const std::string&)) {
+    return JsonField<Owner, Member, Member (*)(const std::string&)>{name, member, true, convert};
+}
+
+class JsonReader {
+private:
+    static constexpr size_t maxDepth = 64;
+    
+    std::string_view text;
+    size_t pos = 0;
+    std::string scratch;   // reused for keys and converted strings
+    
+    template <typename T>
+    struct IsOptional : std::false_type {};
+    template <typename T>
+    struct IsOptional<std::optional<T>> : std::true_type {};
+    
+    [[noreturn]] void fail(const std::string& what) const {
+        throw HttpError(status_codes::BadRequest, "Malformed JSON at offset " + std::to_string(pos) + ": " + what);
+    }
+    
+    [[noreturn]] static void fieldError(std::string_view field, const std::string& what) {
+        throw HttpError(status_codes::BadRequest, "Field '" + std::string(field) + "' " + what);
+    }
+    
+    void skipSpace() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\n' || text[pos] == '\r' || text[pos] == '\t')) {
+            pos++;
+        }
+    }
+    
+    char peek() {
+        skipSpace();
+        if (pos >= text.size()) fail("unexpected end of input");
+        return text[pos];
+    }
+    
+    bool consume(char c) {
+        if (peek() != c) return false;
+        pos++;
+        return true;
+    }
+    
+    void expect(char c) {
+        if (!consume(c)) fail(std::string("expected '") + c + "'");
+    }
+    
+    bool consumeLiteral(std::string_view literal) {
+        skipSpace();
+        if (text.substr(pos, literal.size()) != literal) return false;
+        pos += literal.size();
+        return true;
+    }
+    
+    unsigned readHex4() {
+        if (pos + 4 > text.size()) fail("truncated \\u escape");
+        unsigned code = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = text[pos++];
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= static_cast<unsigned>(c - '0');
+            else if (c >= 'a' && c <= 'f') code |= static_cast<unsigned>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') code |= static_cast<unsigned>(c - 'A' + 10);
+            else fail("bad \\u escape");
+        }
+        return code;
+    }
+    
+    static void appendUtf8(std::string& out, unsigned code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+    
+    // Decodes the string at `pos` into `out`, copying unescaped runs whole.
+    void readString(std::string& out) {
+        if (peek() != '"') fail("expected a string");
+        pos++;
+        out.clear();
+        size_t run = pos;
+        for (;;) {
+            if (pos >= text.size()) fail("unterminated string");
+            char c = text[pos];
+            if (c == '"') break;
+            if (static_cast<unsigned char>(c) < 0x20) fail("control character in string");
+            if (c != '\\') {
+                pos++;
+                continue;
+            }
+            out.append(text.data() + run, pos - run);
+            if (++pos >= text.size()) fail("unterminated string");
+            switch (text[pos++]) {
+                case '"':  out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/':  out += '/'; break;
+                case 'b':  out += '\b'; break;
+                case 'f':  out += '\f'; break;
+                case 'n':  out += '\n'; break;
+                case 'r':  out += '\r'; break;
+                case 't':  out += '\t'; break;
+                case 'u': {
+                    unsigned code = readHex4();
+                    if (code >= 0xD800 && code < 0xDC00) {
+                        if (text.substr(pos, 2) != "\\u") fail("unpaired surrogate");
+                        pos += 2;
+                        unsigned low = readHex4();
+                        if (low < 0xDC00 || low >= 0xE000) fail("unpaired surrogate");
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    } else if (code >= 0xDC00 && code < 0xE000) {
+                        fail("unpaired surrogate");
+                    }
+                    appendUtf8(out, code);
+                    break;
+                }
+                default:
+                    pos--;
+                    fail("bad escape");
+            }
+            run = pos;
+        }
+        out.append(text.data() + run, pos - run);
+        pos++;
+    }
+    
+    // Checks the JSON number grammar; returns its span and whether it has a
+    // fraction or exponent.
+    std::string_view scanNumber(bool& integral) {
+        skipSpace();
+        size_t start = pos;
+        auto digits = [this]() {
+            size_t from = pos;
+            while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') pos++;
+            return pos - from;
+        };
+        if (pos < text.size() && text[pos] == '-') pos++;
+        if (pos < text.size() && text[pos] == '0') pos++;
+        else if (digits() == 0) { pos = start; fail("expected a number"); }
+        integral = true;
+        if (pos < text.size() && text[pos] == '.') {
+            pos++;
+            integral = false;
+            if (digits() == 0) fail("expected digits after '.'");
+        }
+        if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+            pos++;
+            integral = false;
+            if (pos < text.size() && (text[pos] == '+' || text[pos] == '-')) pos++;
+            if (digits() == 0) fail("expected exponent digits");
+        }
+        return text.substr(start, pos - start);
+    }
+    
+    bool isNumberStart() {
+        char c = peek();
+        return c == '-' || (c >= '0' && c <= '9');
+    }
+    
+    void skipValue(size_t depth = 0) {
+        if (depth > maxDepth) fail("nesting too deep");
+        char c = peek();
+        if (c == '"') {
+            readString(scratch);
+        } else if (c == '{') {
+            pos++;
+            if (consume('}')) return;
+            do {
+                readString(scratch);
+                expect(':');
+                skipValue(depth + 1);
+            } while (consume(','));
+            expect('}');
+        } else if (c == '[') {
+            pos++;
+            if (consume(']')) return;
+            do {
+                skipValue(depth + 1);
+            } while (consume(','));
+            expect(']');
+        } else if (!consumeLiteral("true") && !consumeLiteral("false") && !consumeLiteral("null")) {
+            bool integral;
+            scanNumber(integral);
+        }
+    }
+    
+    void readValue(std::string_view field, std::string& out) {
+        if (peek() != '"') fieldError(field, "must be a string");
+        readString(out);
+    }
+    
+    void readValue(std::string_view field, bool& out) {
+        if (consumeLiteral("true")) out = true;
+        else if (consumeLiteral("false")) out = false;
+        else fieldError(field, "must be true or false");
+    }
+    
+    template <typename Number>
+    std::enable_if_t<std::is_arithmetic_v<Number>> readValue(std::string_view field, Number& out) {
+        if (!isNumberStart()) fieldError(field, "must be a number");
+        bool integral;
+        std::string_view digits = scanNumber(integral);
+        if constexpr (std::is_integral_v<Number>) {
+            if (!integral) fieldError(field, "must be an integer");
+        }
+        auto result = std::from_chars(digits.data(), digits.data() + digits.size(), out);
+        if (result.ec != std::errc()) fieldError(field, "is out of range");
+    }
+    
+    template <typename T>
+    void readValue(std::string_view field, std::optional<T>& out) {
+        readValue(field, out.emplace());
+    }
+    
+    // Reads one member's value; false when it was null (treated as absent).
+    template <typename T, typename Owner, typename Member, typename Convert>
+    bool readField(T& result, const JsonField<Owner, Member, Convert>& field) {
+        if (consumeLiteral("null")) {
+            if constexpr (IsOptional<Member>::value) (result.*field.member).reset();
+            return false;
+        }
+        if constexpr (std::is_same_v<Convert, std::nullptr_t>) {
+            readValue(field.name, result.*field.member);
+        } else {
+            readValue(field.name, scratch);
+            try {
+                result.*field.member = field.convert(scratch);
+            } catch (const std::exception&) {
+                fieldError(field.name, "has an invalid value: " + scratch);
+            }
+        }
+        return true;
+    }
+    
+    template <typename T, size_t... I>
+    void decodeMember(T& result, std::string_view key, uint64_t& seen, std::index_sequence<I...>) {
+        constexpr const auto& fields = JsonSchema<T>::fields;
+        bool matched = ((key == std::get<I>(fields).name
+                         && (readField(result, std::get<I>(fields)) ? (seen |= uint64_t(1) << I, true) : true)) || ...);
+        if (!matched) skipValue();
+    }
+    
+    template <typename T, size_t... I>
+    static void checkRequired(uint64_t seen, std::index_sequence<I...>) {
+        constexpr const auto& fields = JsonSchema<T>::fields;
+        ((std::get<I>(fields).required && !(seen & (uint64_t(1) << I))
+          ? throw HttpError(status_codes::BadRequest, "Missing required field: " + std::string(std::get<I>(fields).name))
+          : void()), ...);
+    }
+    
+public:
+    explicit JsonReader(std::string_view body) : text(body) {}
+    
+    template <typename T>
+    T decode() {
+        constexpr size_t count = std::tuple_size_v<std::decay_t<decltype(JsonSchema<T>::fields)>>;
+        static_assert(count <= 64, "JsonSchema supports up to 64 fields");
+        using Indices = std::make_index_sequence<count>;
+        
+        T result{};
+        uint64_t seen = 0;
+        std::string key;
+        if (peek() != '{') fail("expected an object");
+        pos++;
+        if (!consume('}')) {
+            do {
+                readString(key);
+                expect(':');
+                decodeMember(result, key, seen, Indices{});
+            } while (consume(','));
+            expect('}');
+        }
+        skipSpace();
+        if (pos != text.size()) fail("trailing characters");
+        checkRequired<T>(seen, Indices{});
+        return result;
+    }
+    
+    template <typename T>
+    static T decode(std::string_view body) {
+        return JsonReader(body).decode<T>();
+    }
 };
 
 // ============================================================================
@@ -202,6 +716,29 @@ public:
         request.reply(response);
     }
     
+    // Send an already serialized JSON body (see JsonWriter) as is. With an
+    // ETag the client is told to revalidate instead of reusing it blindly.
+    static void sendJsonText(http_request request, status_code code, std::string body,
+                             const std::string& etag = "") {
+        http_response response(code);
+        response.headers().add(U("Access-Control-Allow-Origin"), U("*"));
+        if (!etag.empty()) {
+            response.headers().add(U("ETag"), utility::conversions::to_string_t(etag));
+            response.headers().add(U("Cache-Control"), U("private, no-cache"));
+        }
+        response.set_body(std::move(body), "application/json");
+        request.reply(response);
+    }
+    
+    // 304: the client's copy (If-None-Match) is still current.
+    static void sendNotModified(http_request request, const std::string& etag) {
+        http_response response(status_codes::NotModified);
+        response.headers().add(U("Access-Control-Allow-Origin"), U("*"));
+        response.headers().add(U("ETag"), utility::conversions::to_string_t(etag));
+        response.headers().add(U("Cache-Control"), U("private, no-cache"));
+        request.reply(response);
+    }
+    
     // Send error response
     static void sendError(http_request request, status_code code, const std::string& message) {
         web::json::value response = web::json::value::object();
@@ -212,20 +749,26 @@ public:
         sendJsonResponse(request, code, response);
     }
     
-    // Send success response with optional data
-    static void sendSuccess(http_request request, const web::json::value& data = web::json::value::object()) {
-        web::json::value response = web::json::value::object();
-        response[U("success")] = web::json::value::boolean(true);
-        
-        // Merge data into response
-        if (data.is_object()) {
-            auto obj = data.as_object();
-            for (const auto& pair : obj) {
-                response[pair.first] = pair.second;
-            }
+    // Reply from the end of an async handler chain: the body on success,
+    // an HttpError's own status, or 500 for anything else.
+    static void sendResult(http_request request, status_code code,
+                           const pplx::task<web::json::value>& result) {
+        try {
+            sendJsonResponse(request, code, result.get());
+        } catch (const HttpError& e) {
+            sendError(request, e.status(), e.what());
+        } catch (const std::exception& e) {
+            sendError(request, status_codes::InternalError, e.what());
         }
-        
-        sendJsonResponse(request, status_codes::OK, response);
+    }
+    
+    // Send success response with optional data
+    static void sendSuccess(http_request request, web::json::value data = web::json::value::object()) {
+        // Mark the caller's object in place rather than merging it into a
+        // second one.
+        if (!data.is_object()) data = web::json::value::object();
+        data[U("success")] = web::json::value::boolean(true);
+        sendJsonResponse(request, status_codes::OK, data);
     }
 };
 